@@ -6,9 +6,11 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <limits>
 #include <string>
 #include <math.h>
 #include "./InvertedIndex.h"
+#include "./Normalizer.h"
 
 // Define a infinity threshold
 #define INF std::numeric_limits<double>::max()-42.0
@@ -23,28 +25,22 @@ void InvertedIndex::readFromFile(const string& fileName, double b, double k) {
   _avgDocLen = 0.0;
 
   // 1st pass: compute tf, docs len & avg doc len
+  std::vector<string> words;
   while (std::getline(in, line)) {
     recordId++;
     _docLen.push_back(0);
-    size_t i = 0;
-    size_t start = 0;
-    while (i <= line.size()) {
-      // The > 0 so that we don't split at non-ascii chars.
-      // It is very important that one can search for "björn" :-).
-      if (i == line.size() || (line[i] > 0 && !isalnum(line[i])))  {
-        if (i > start) {
-         string word = getLowercase(line.substr(start, i - start));
-         _docLen[recordId]++;
-          // Automatically default constructs a list if the
-          // word is seen for the first time.
-          if (_invertedLists[word].empty()
-            || _invertedLists[word].back().first != recordId)
-            _invertedLists[word].push_back({recordId, 0.0});
-          _invertedLists[word].back().second+=1.0;
-        }
-        start = i + 1;
-      }
-      ++i;
+    // Words are split at non-word characters only, so that one can search
+    // for "björn" :-) (and "Björn").
+    words.clear();
+    tokenizeUtf8(line.data(), line.size(), words);
+    for (const string& word : words) {
+      _docLen[recordId]++;
+      // Automatically default constructs a list if the
+      // word is seen for the first time.
+      vector<Posting>& list = _invertedLists[word];
+      if (list.empty() || list.back().first != recordId)
+        list.push_back({recordId, 0.0});
+      list.back().second+=1.0;
     }
     // Update avg doc len of recordId-th doc
     _avgDocLen+=_docLen[recordId];
@@ -82,12 +78,6 @@ void InvertedIndex::readFromFile(const string& fileName, double b, double k) {
   }
 }
 
-// ____________________________________________________________________________
-inline string InvertedIndex::getLowercase(string orig) {
-  std::transform(orig.begin(), orig.end(), orig.begin(), ::tolower);
-  return orig;
-}
-
 // ____________________________________________________________________________
 const InvLists& InvertedIndex::getInvertedLists() const {
   return _invertedLists;
@@ -107,7 +97,7 @@ std::ostream& operator<<(std::ostream& os, const InvertedIndex &ii) {
   for (auto it = ii.getInvertedLists().begin();
       it != ii.getInvertedLists().end();
       ++it) {
-    os << it->first << '\t';
+    os << normalizedToUtf8(it->first) << '\t';
     os << "[" << it->second << "]";
     os << std::endl;
   }
@@ -155,22 +145,15 @@ std::vector<Posting> InvertedIndex::process_querry(string querry,
     std::cout << "Ups, use_refinements not implemented.\n";
 
   std::vector<Posting> querry_res;
-  size_t i = 0;
-  size_t start = 0;
-  while (i <= querry.size()) {
-    // As in readFromFile: The > 0 so that we don't split at non-ascii chars.
-    if (i == querry.size() || (querry[i] > 0 && !isalnum(querry[i])))  {
-      if (i > start) {
-       string word = getLowercase(querry.substr(start, i - start));
-       if (querry_res.empty()) {
-         querry_res = _invertedLists[word];
-       } else {
-         querry_res = merge(querry_res, _invertedLists[word]);
-       }
-      }
-      start = i + 1;
+  // Split into words as in readFromFile.
+  std::vector<string> words;
+  tokenizeUtf8(querry.data(), querry.size(), words);
+  for (const string& word : words) {
+    if (querry_res.empty()) {
+      querry_res = _invertedLists[word];
+    } else {
+      querry_res = merge(querry_res, _invertedLists[word]);
     }
-    ++i;
   }
   std::sort(querry_res.begin(), querry_res.end(), postingCompDesc);
   if (querry_res.size() < 3)
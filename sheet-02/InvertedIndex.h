@@ -23,7 +23,8 @@ class InvertedIndex {
   // Constructs the inverted index from given file (one record per line).
   void readFromFile(const string& fileName, double b, double k);
 
-  // Returns the inverted lists.
+  // Returns the inverted lists. The words are in normalized form (see
+  // Normalizer.h), e.g. normalizeUtf8("Björn").
   const InvLists& getInvertedLists() const;
 
   // Returns intersection of two given sorted inverted lists
@@ -49,9 +50,6 @@ class InvertedIndex {
 
   // Average document length
   double _avgDocLen;
-
-  // Returns the lowercase version of a string.
-  inline static string getLowercase(string orig);
 };
 
 // Print inverted list in human readable format
@@ -4,7 +4,9 @@
 // Patrick Brosi <brosi@cs.uni-freiburg.de>.
 
 #include <gtest/gtest.h>
+#include <fstream>
 #include "./InvertedIndex.h"
+#include "./Normalizer.h"
 #include "./EvaluateInvertedIndex.h"
 
 /*
@@ -174,6 +176,23 @@ TEST(InvertedIndexTest, process_querry) {
   ASSERT_DOUBLE_EQ(0.6, res[2].second);
 }
 
+// _____________________________________________________________________________
+TEST(InvertedIndexTest, readFromFileUtf8) {
+  {
+    std::ofstream out("InvertedIndexTest.TMP.txt");
+    out << "Björn Borg\tSwedish tennis player.\n";
+    out << "BJÖRN\tA name.\n";
+  }
+  InvertedIndex ii;
+  ii.readFromFile("InvertedIndexTest.TMP.txt", 0.75, 1.75);
+  const InvLists& lists = ii.getInvertedLists();
+  ASSERT_EQ(lists.end(), lists.find("bjrn"));
+  ASSERT_EQ(2, lists.find(normalizeUtf8("björn"))->second.size());
+  auto res = ii.process_querry("Björn borg", false);
+  ASSERT_EQ(2, res.size());
+  ASSERT_EQ(1, res[0].first);
+}
+
 // _____________________________________________________________________________
 TEST(EvaluateInvertedIndexTest, read_benchmark) {
   EvaluateInvertedIndex eii;
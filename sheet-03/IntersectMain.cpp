@@ -4,11 +4,20 @@
 //          Claudius Korzen <korzen@cs.uni-freiburg.de>.
 
 #include <stddef.h>
+#include <algorithm>
 #include <chrono>
 #include <iostream>
+#include <random>
 #include <vector>
 #include "math.h"
 #include "./PostingList.h"
+#include "./PerfCounters.h"
+
+// The number of random probes per list for the search layout benchmark.
+const size_t NUM_PROBES = 1000000;
+
+// The number of ways to probe a list: binary search and the seek strategies.
+const size_t NUM_PROBE_METHODS = 4;
 
 // _____________________________________________________________________________
 int main(int argc, char **argv) {
@@ -19,15 +28,94 @@ int main(int argc, char **argv) {
 
   size_t numLists = argc - 1;
 
+  // Hardware counters per region, so that we can explain (not just observe)
+  // why one algorithm is faster than the other.
+  PerfRegions perf;
+
   // Read the posting lists.
   std::vector<PostingList> lists;
   for (size_t i = 0; i < numLists; i++) {
     std::cout << "Reading list '" << argv[i + 1] << "'\t...\t";
     PostingList list;
-    list.readFromFile(argv[i + 1]);
+    {
+      PerfRegion region(perf, "readFromFile");
+      list.readFromFile(argv[i + 1]);
+    }
     list.addPosting(INF, 42);
+    if (list.size() >= SEARCH_LAYOUT_MIN_SIZE) {
+      list.buildSearchLayout();
+      list.buildLearnedIndex();
+    }
     lists.push_back(list);
-    std::cout << "Done. Size: " << lists[i].size() << "." << std::endl;
+    std::cout << "Done. Size: " << lists[i].size() << "."
+              << (lists[i].hasSearchLayout() ? " (with seek indexes)" : "")
+              << std::endl;
+  }
+
+  // Random probes into the large lists: plain binary search on the sorted ids
+  // vs. nextGEQ() with each seek strategy. The faster of the search layout
+  // and the learned index is then used for the intersections below.
+  std::mt19937 gen(42);
+  for (size_t i = 0; i < numLists; i++) {
+    if (!lists[i].hasSearchLayout()) continue;
+    PostingList& list = lists[i];
+    std::uniform_int_distribution<size_t> dist(0, list.getId(list.size() - 2));
+    std::vector<size_t> probes(NUM_PROBES);
+    for (size_t k = 0; k < probes.size(); k++) probes[k] = dist(gen);
+
+    std::cout << "\n> Random probes into '" << argv[i + 1] << "'." << std::endl;
+    std::cout << "Space:    \t    ids: " << list.ids.size() * sizeof(size_t)
+              << " bytes, search layout: "
+              << (list.eytzinger.size() + list.eytzingerRank.size())
+                 * sizeof(size_t)
+              << " bytes, learned index: "
+              << list.segments.size() * sizeof(PostingList::Segment)
+              << " bytes (" << list.segments.size() << " segments)."
+              << std::endl;
+
+    // Counters of this list only (difference to the totals before), so that
+    // the totals at the end still cover all lists.
+    const char* names[NUM_PROBE_METHODS] = { "probeBinarySearch",
+                                             "probeGallop",
+                                             "probeSearchLayout",
+                                             "probeLearnedIndex" };
+    SeekStrategy strategies[] = { SEEK_GALLOP, SEEK_SEARCH_LAYOUT,
+                                  SEEK_LEARNED_INDEX };
+    PerfRegions::Stats stats[NUM_PROBE_METHODS];
+    for (size_t s = 0; s < NUM_PROBE_METHODS; s++) {
+      stats[s] = perf.get(names[s]);
+    }
+
+    size_t checksumBinary = 0;
+    {
+      PerfRegion region(perf, names[0]);
+      for (size_t k = 0; k < probes.size(); k++) {
+        checksumBinary += std::lower_bound(list.ids.begin(), list.ids.end(),
+                                           probes[k]) - list.ids.begin();
+      }
+    }
+    stats[0] = perf.get(names[0]) - stats[0];
+    perf.report(std::cout, names[0], stats[0]);
+
+    for (size_t s = 1; s < NUM_PROBE_METHODS; s++) {
+      list.seekStrategy = strategies[s - 1];
+      size_t checksum = 0;
+      {
+        PerfRegion region(perf, names[s]);
+        for (size_t k = 0; k < probes.size(); k++) {
+          checksum += list.nextGEQ(0, probes[k]);
+        }
+      }
+      stats[s] = perf.get(names[s]) - stats[s];
+      perf.report(std::cout, names[s], stats[s]);
+      std::cout << "Ratio:    \t    "
+                << round(100.0 * stats[0].total.seconds /
+                         stats[s].total.seconds) / 100.0
+                << (checksumBinary == checksum ? "" : " (MISMATCH!)")
+                << std::endl;
+    }
+    list.seekStrategy = stats[3].total.seconds < stats[2].total.seconds ?
+        SEEK_LEARNED_INDEX : SEEK_SEARCH_LAYOUT;
   }
 
   // Intersect the lists pairwise.
@@ -42,25 +130,34 @@ int main(int argc, char **argv) {
       size_t sizeBaseline = 0;
       size_t timeMy = 0;
       size_t sizeMy = 0;
+      PerfRegions::Stats perfBaseline = perf.get("intersectBaseline");
+      PerfRegions::Stats perfMy = perf.get("intersect");
 
       for (size_t r = 0; r < 5; r++) {
-        // Measure performance of baseline algorithm
-        auto time1 = std::chrono::high_resolution_clock::now();
-        PostingList list = PostingList::intersectBaseline(lists[i], lists[j]);
-        auto time2 = std::chrono::high_resolution_clock::now();
-
-        timeBaseline += std::chrono::duration_cast<std::chrono::microseconds>
-                    (time2 - time1).count();
-        sizeBaseline = list.size();
+        // Measure performance of baseline algorithm. The counters are read
+        // outside of the timed part, so they don't distort the timings.
+        {
+          PerfRegion region(perf, "intersectBaseline");
+          auto time1 = std::chrono::high_resolution_clock::now();
+          PostingList list = PostingList::intersectBaseline(lists[i],
+                                                            lists[j]);
+          auto time2 = std::chrono::high_resolution_clock::now();
 
+          timeBaseline += std::chrono::duration_cast<std::chrono::microseconds>
+                      (time2 - time1).count();
+          sizeBaseline = list.size();
+        }
 
-        auto time3 = std::chrono::high_resolution_clock::now();
-        PostingList list2 = PostingList::intersect(lists[i], lists[j]);
-        auto time4 = std::chrono::high_resolution_clock::now();
+        {
+          PerfRegion region(perf, "intersect");
+          auto time3 = std::chrono::high_resolution_clock::now();
+          PostingList list2 = PostingList::intersect(lists[i], lists[j]);
+          auto time4 = std::chrono::high_resolution_clock::now();
 
-        timeMy += std::chrono::duration_cast<std::chrono::microseconds>
-                    (time4 - time3).count();
-        sizeMy = list2.size();
+          timeMy += std::chrono::duration_cast<std::chrono::microseconds>
+                      (time4 - time3).count();
+          sizeMy = list2.size();
+        }
         }
         std::cout << "[Baseline]\t Time: " << timeBaseline/5 << "µs. \t|\t"
                   << "size: " << sizeBaseline << std::endl;
@@ -68,8 +165,17 @@ int main(int argc, char **argv) {
                   << "size: " << sizeMy << std::endl;
         std::cout << "Ratio:    \t    "
                   << round(100.0*timeBaseline/timeMy)/100.0 << std::endl;
+
+        // Counters of this pair only (difference to the totals before).
+        perf.report(std::cout, "intersectBaseline",
+                    perf.get("intersectBaseline") - perfBaseline);
+        perf.report(std::cout, "intersect", perf.get("intersect") - perfMy);
         std::cout << std::endl;
     }
   }
+
+  // Totals per region over the whole run.
+  std::cout << "\nTotals:" << std::endl;
+  perf.report(std::cout);
   return 0;
 }
@@ -123,17 +123,34 @@ PostingList PostingList::intersect(const PostingList& A,
   PostingList res;
   res.reserve(A.size());
 
+  // Very short list against a huge one: every docId of A is (almost) a random
+  // probe into B, which the cache-friendly search layout or the learned index
+  // answer faster than galloping.
+  if (B.seekStrategy != SEEK_GALLOP &&
+      A.size() * SEARCH_LAYOUT_MIN_RATIO <= B.size()) {
+    size_t j = 0;
+    for (size_t i = 0; i < A.size() && A.getId(i) != INF; i++) {
+      j = B.nextGEQ(j, A.getId(i));
+      if (j == B.size()) break;
+      if (B.getId(j) == A.getId(i)) {
+        res.addPosting(A.getId(i), A.getScore(i) + B.getScore(j));
+      }
+    }
+    return res;
+  }
+
 
   size_t a = 0;  // Binary search will be in
   size_t b = 1;  // range [a,b] of B;
   size_t s = 0;  // s ← (a+b)/2
   size_t i = 0;  // index of current element in A
   while (true) {
-    if ( A.getId(i) == INF )
+    // The sentinel ends the loop, the size check covers lists without one.
+    if ( i == A.size() || A.getId(i) == INF )
       return res;
     b = 1;
     // Gallop - find upper bounds
-    while ((a+b) <= B.size() && B.getId(a+b) < A.getId(i)) b*=2;
+    while ((a+b) < B.size() && B.getId(a+b) < A.getId(i)) b*=2;
     b = std::min(a+b, B.size());
     while ( a < b ) {
       s = (a+b)/2;
@@ -142,6 +159,8 @@ PostingList PostingList::intersect(const PostingList& A,
       else
         b = s;
     }
+    if ( a == B.size() )
+      return res;
     if ( B.getId(a) == A.getId(i) ) {
       res.addPosting(A.getId(i), A.getScore(i) + B.getScore(a));
     }
@@ -164,6 +183,158 @@ size_t PostingList::bin_search(size_t a, size_t b, size_t id) const {
   return INF;
 }
 
+// _____________________________________________________________________________
+void PostingList::buildSearchLayout(size_t rate) {
+  sampleRate = rate;
+  std::vector<size_t> samples;
+  for (size_t i = 0; i < size(); i += sampleRate) {
+    samples.push_back(ids[i]);
+  }
+  eytzinger.assign(samples.size() + 1, 0);
+  eytzingerRank.assign(samples.size() + 1, 0);
+  fillEytzinger(samples, 0, 1);
+  seekStrategy = SEEK_SEARCH_LAYOUT;
+}
+
+// _____________________________________________________________________________
+size_t PostingList::fillEytzinger(const std::vector<size_t>& samples, size_t i,
+    size_t k) {
+  if (k < eytzinger.size()) {
+    i = fillEytzinger(samples, i, 2 * k);
+    eytzinger[k] = samples[i];
+    eytzingerRank[k] = i++;
+    i = fillEytzinger(samples, i, 2 * k + 1);
+  }
+  return i;
+}
+
+// _____________________________________________________________________________
+void PostingList::buildLearnedIndex(size_t eps) {
+  // Greedy "shrinking cone": extend the current segment as long as there is
+  // a slope that predicts all its docIds within +-eps. The docIds are
+  // strictly increasing, so every segment is a monotone function.
+  epsilon = eps;
+  segments.clear();
+  double lo = 0;
+  double hi = 0;
+  for (size_t i = 0; i < size(); i++) {
+    if (!segments.empty()) {
+      const Segment& seg = segments.back();
+      double dx = ids[i] - seg.firstId;
+      double dy = i - seg.firstPos;
+      double newLo = std::max(lo, (dy - epsilon) / dx);
+      double newHi = std::min(hi, (dy + epsilon) / dx);
+      if (newLo <= newHi) {
+        lo = newLo;
+        hi = newHi;
+        continue;
+      }
+      segments.back().slope = (lo + hi) / 2;
+    }
+    Segment seg = { ids[i], i, 0 };
+    segments.push_back(seg);
+    lo = 0;
+    hi = std::numeric_limits<double>::max();
+  }
+  if (!segments.empty() && hi != std::numeric_limits<double>::max()) {
+    segments.back().slope = (lo + hi) / 2;
+  }
+  seekStrategy = SEEK_LEARNED_INDEX;
+}
+
+// _____________________________________________________________________________
+size_t PostingList::nextGEQ(size_t from, size_t id) const {
+  switch (seekStrategy) {
+    case SEEK_SEARCH_LAYOUT:
+      return std::max(searchLayout(id), from);
+    case SEEK_LEARNED_INDEX:
+      return std::max(searchLearnedIndex(id), from);
+    default:
+      return gallop(from, id);
+  }
+}
+
+// _____________________________________________________________________________
+size_t PostingList::searchLearnedIndex(size_t id) const {
+  // The segment responsible for id (the last one with firstId <= id).
+  size_t a = 0;
+  size_t b = segments.size();
+  while (a < b) {
+    size_t s = (a + b) / 2;
+    if (segments[s].firstId <= id)
+      a = s + 1;
+    else
+      b = s;
+  }
+  if (a == 0) return 0;
+  const Segment& seg = segments[a - 1];
+  size_t segEnd = a < segments.size() ? segments[a].firstPos : size();
+
+  // One model evaluation, then a search in a window of 2 * epsilon docIds.
+  // The window is one larger on each side for rounding errors and docIds
+  // that fall between two postings.
+  double predicted = seg.firstPos + seg.slope * (id - seg.firstId);
+  size_t pos = std::min(static_cast<size_t>(predicted), segEnd);
+  size_t lo = std::max(seg.firstPos, pos > epsilon + 1 ? pos - epsilon - 1 : 0);
+  size_t hi = std::min(segEnd, pos + epsilon + 2);
+  while (lo < hi) {
+    size_t s = (lo + hi) / 2;
+    if (ids[s] < id)
+      lo = s + 1;
+    else
+      hi = s;
+  }
+  return lo;
+}
+
+// _____________________________________________________________________________
+size_t PostingList::searchLayout(size_t id) const {
+  // Branchless descent: go right iff the node is smaller than id. The nodes
+  // three levels further down share a cache line, fetch it in advance.
+  const size_t* e = eytzinger.data();
+  size_t n = eytzinger.size() - 1;
+  size_t k = 1;
+  while (k <= n) {
+    __builtin_prefetch(e + 8 * k);
+    k = 2 * k + (e[k] < id);
+  }
+  // Undo the right turns after the last left turn; k is then the smallest
+  // sample >= id (or 0 if there is none).
+  k >>= __builtin_ffsll(~k);
+
+  // The answer lies between the previous sample and this one.
+  size_t hi = k == 0 ? size() : eytzingerRank[k] * sampleRate;
+  size_t lo = k == 0 ? (n - 1) * sampleRate
+                     : (eytzingerRank[k] > 0 ? hi - sampleRate + 1 : 0);
+  size_t pos = lo;
+  for (size_t i = lo; i < hi; i++) {
+    pos += ids[i] < id;
+  }
+  return pos;
+}
+
+// _____________________________________________________________________________
+size_t PostingList::gallop(size_t from, size_t id) const {
+  // Invariant: all ids before a are < id, ids[b] >= id (or b is the end).
+  size_t a = from;
+  size_t b = from;
+  size_t step = 1;
+  while (b < size() && ids[b] < id) {
+    a = b + 1;
+    b = from + step;
+    step *= 2;
+  }
+  b = std::min(b, size());
+  while (a < b) {
+    size_t s = (a + b) / 2;
+    if (ids[s] < id)
+      a = s + 1;
+    else
+      b = s;
+  }
+  return a;
+}
+
 // _____________________________________________________________________________
 void PostingList::reserve(size_t n) {
   ids.reserve(n);
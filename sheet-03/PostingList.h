@@ -12,15 +12,39 @@
 
 #define INF std::numeric_limits<size_t>::max()
 
+// Every SEARCH_LAYOUT_SAMPLE_RATE-th docId goes into the search layout, so
+// the final scan in the list touches a single cache line of docIds.
+const size_t SEARCH_LAYOUT_SAMPLE_RATE = 8;
+
+// Lists shorter than this are searched fast enough without a layout.
+const size_t SEARCH_LAYOUT_MIN_SIZE = 1 << 16;
+
+// intersect() uses the seek index (layout or learned index) of the longer list
+// only if it is at least this many times longer than the other one (otherwise
+// galloping wins).
+const size_t SEARCH_LAYOUT_MIN_RATIO = 32;
+
+// The maximal error (in positions) of the learned index.
+const size_t LEARNED_INDEX_EPSILON = 16;
+
+// How nextGEQ() finds the next posting.
+enum SeekStrategy {
+  SEEK_GALLOP,         // Galloping from the current position.
+  SEEK_SEARCH_LAYOUT,  // The Eytzinger layout, see buildSearchLayout().
+  SEEK_LEARNED_INDEX   // The learned index, see buildLearnedIndex().
+};
+
 /**
  * A list of postings of form (docId, score).
  */
 class PostingList {
  public:
   PostingList(const std::vector<size_t>& ids, const std::vector<size_t>& scores)
-  : ids(ids), scores(scores) {}
+  : ids(ids), scores(scores), capacity(ids.size()), numPostings(ids.size()),
+    sampleRate(0), epsilon(0), seekStrategy(SEEK_GALLOP) {}
 
-  PostingList() : ids(), scores() {}
+  PostingList() : ids(), scores(), capacity(0), numPostings(0),
+      sampleRate(0), epsilon(0), seekStrategy(SEEK_GALLOP) {}
 
   /**
    * Reads a posting list from the given file.
@@ -75,6 +99,30 @@ class PostingList {
    */
   size_t bin_search(size_t first, size_t last, size_t id) const;
 
+  /**
+   * Builds the optional search layout: a copy of every sampleRate-th docId in
+   * Eytzinger (BFS) order, see nextGEQ(). Pays off for large lists only.
+   */
+  void buildSearchLayout(size_t sampleRate = SEARCH_LAYOUT_SAMPLE_RATE);
+
+  /**
+   * Returns true if buildSearchLayout() was called.
+   */
+  bool hasSearchLayout() const { return eytzinger.size() > 1; }
+
+  /**
+   * Builds the optional learned index: a piecewise linear function that maps
+   * a docId to its position in this list with an error of at most epsilon.
+   */
+  void buildLearnedIndex(size_t epsilon = LEARNED_INDEX_EPSILON);
+
+  /**
+   * Returns the index of the first posting at or after index "from" whose
+   * docId is >= id, or size() if there is no such posting. How the posting is
+   * found depends on seekStrategy.
+   */
+  size_t nextGEQ(size_t from, size_t id) const;
+
   // ==========================================================================
 
   /**
@@ -96,6 +144,65 @@ class PostingList {
    * The number of postings in this list.
    */
   size_t numPostings;
+
+  /**
+   * The sampled docIds in Eytzinger order, 1-based (element 0 is unused), so
+   * that the children of node k are 2k and 2k + 1 and the nodes three levels
+   * below k are adjacent in memory (and can be prefetched at once).
+   */
+  std::vector<size_t> eytzinger;
+
+  /**
+   * eytzingerRank[k] is the rank of eytzinger[k] among the samples.
+   */
+  std::vector<size_t> eytzingerRank;
+
+  /**
+   * The sample rate of the search layout.
+   */
+  size_t sampleRate;
+
+  /**
+   * A segment of the learned index: the docIds from firstId on (up to the
+   * firstId of the next segment) are predicted to be at position
+   * firstPos + slope * (docId - firstId).
+   */
+  struct Segment {
+    size_t firstId;
+    size_t firstPos;
+    double slope;
+  };
+
+  /**
+   * The segments of the learned index, sorted by firstId.
+   */
+  std::vector<Segment> segments;
+
+  /**
+   * The maximal error of the learned index.
+   */
+  size_t epsilon;
+
+  /**
+   * The strategy used by nextGEQ(). Set by the build methods above, but can
+   * be changed freely (as long as the corresponding structure is built).
+   */
+  SeekStrategy seekStrategy;
+
+ private:
+  // Fills the Eytzinger layout from the sorted samples (in-order traversal).
+  size_t fillEytzinger(const std::vector<size_t>& samples, size_t i, size_t k);
+
+  // Computes nextGEQ() by galloping from index "from".
+  size_t gallop(size_t from, size_t id) const;
+
+  // Returns the index of the first posting with docId >= id using the
+  // Eytzinger layout.
+  size_t searchLayout(size_t id) const;
+
+  // Returns the index of the first posting with docId >= id using the learned
+  // index.
+  size_t searchLearnedIndex(size_t id) const;
 };
 
 #endif  // POSTINGLIST_H_
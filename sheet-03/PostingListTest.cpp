@@ -4,6 +4,7 @@
 //          Claudius Korzen <korzen@cs.uni-freiburg.de>.
 
 #include <gtest/gtest.h>
+#include <algorithm>
 #include "./PostingList.h"
 
 // _____________________________________________________________________________
@@ -114,3 +115,118 @@ TEST(PostingList, intersect) {
   // PostingList result2 = PostingList::intersect(list1, list3);
   // ASSERT_EQ(0, result2.size());
 }
+
+// _____________________________________________________________________________
+TEST(PostingList, nextGEQ) {
+  PostingList p;
+  size_t arr[] = {2, 3, 5, 8, 13, 21, 34, 55, 89, 144, 233};
+  for (size_t i = 0; i < 11; i++)
+    p.addPosting(arr[i], 1);
+
+  // Without a layout (galloping), then with layouts of several sample rates.
+  for (size_t rate = 0; rate <= 4; rate++) {
+    if (rate > 0) p.buildSearchLayout(rate);
+    ASSERT_EQ(rate > 0, p.hasSearchLayout());
+    ASSERT_EQ(0, p.nextGEQ(0, 0));
+    ASSERT_EQ(0, p.nextGEQ(0, 2));
+    ASSERT_EQ(2, p.nextGEQ(0, 4));
+    ASSERT_EQ(2, p.nextGEQ(0, 5));
+    ASSERT_EQ(10, p.nextGEQ(0, 144 + 1));
+    ASSERT_EQ(10, p.nextGEQ(0, 233));
+    ASSERT_EQ(11, p.nextGEQ(0, 234));
+    ASSERT_EQ(7, p.nextGEQ(7, 3));
+    ASSERT_EQ(11, p.nextGEQ(11, 3));
+    for (size_t k = 0; k < 11; k++) {
+      ASSERT_EQ(k, p.nextGEQ(0, arr[k]));
+      ASSERT_EQ(k + 1, p.nextGEQ(k, arr[k] + 1));
+    }
+  }
+}
+
+// _____________________________________________________________________________
+TEST(PostingList, intersectWithSearchLayout) {
+  // A short list against a long one, so that intersect() uses the layout.
+  PostingList shortList;
+  PostingList longList;
+  for (size_t i = 1; i <= 50000; i++) longList.addPosting(3 * i, 1);
+  for (size_t i = 1; i <= 500; i++) shortList.addPosting(7 * i * i, 2);
+  longList.buildSearchLayout();
+
+  PostingList expected = PostingList::intersectBaseline(shortList, longList);
+  PostingList result = PostingList::intersect(shortList, longList);
+  ASSERT_LT(0, expected.size());
+  ASSERT_EQ(expected.size(), result.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    ASSERT_EQ(expected.getId(i), result.getId(i));
+    ASSERT_EQ(3, result.getScore(i));
+  }
+
+  // The example lists must work as well.
+  PostingList list1;
+  list1.readFromFile("example1.txt");
+  PostingList list2;
+  list2.readFromFile("example2.txt");
+  list2.buildSearchLayout(1);
+  PostingList result1 = PostingList::intersect(list1, list2);
+  ASSERT_EQ(2, result1.size());
+  ASSERT_EQ(2, result1.getId(0));
+  ASSERT_EQ(6, result1.getId(1));
+}
+
+// _____________________________________________________________________________
+TEST(PostingList, nextGEQLearnedIndex) {
+  PostingList p;
+  size_t arr[] = {2, 3, 5, 8, 13, 21, 34, 55, 89, 144, 233};
+  for (size_t i = 0; i < 11; i++)
+    p.addPosting(arr[i], 1);
+
+  for (size_t eps = 0; eps <= 4; eps++) {
+    p.buildLearnedIndex(eps);
+    ASSERT_EQ(SEEK_LEARNED_INDEX, p.seekStrategy);
+    ASSERT_LT(0, p.segments.size());
+    ASSERT_EQ(0, p.nextGEQ(0, 0));
+    ASSERT_EQ(2, p.nextGEQ(0, 4));
+    ASSERT_EQ(10, p.nextGEQ(0, 144 + 1));
+    ASSERT_EQ(11, p.nextGEQ(0, 234));
+    ASSERT_EQ(7, p.nextGEQ(7, 3));
+    for (size_t k = 0; k < 11; k++) {
+      ASSERT_EQ(k, p.nextGEQ(0, arr[k]));
+      ASSERT_EQ(k + 1, p.nextGEQ(k, arr[k] + 1));
+    }
+  }
+
+  // Irregular gaps and a sentinel, compared against std::lower_bound.
+  PostingList q;
+  size_t id = 0;
+  for (size_t i = 0; i < 20000; i++) {
+    id += 1 + (i * i) % 97 + (i % 1000 == 0 ? 100000 : 0);
+    q.addPosting(id, 1);
+  }
+  q.addPosting(INF, 42);
+  q.buildLearnedIndex();
+  ASSERT_LT(1, q.segments.size());
+  for (size_t x = 0; x < id + 10; x += 7) {
+    size_t expected = std::lower_bound(q.ids.begin(), q.ids.end(), x)
+                    - q.ids.begin();
+    ASSERT_EQ(expected, q.nextGEQ(0, x));
+  }
+  ASSERT_EQ(q.size() - 1, q.nextGEQ(0, INF));
+}
+
+// _____________________________________________________________________________
+TEST(PostingList, intersectWithLearnedIndex) {
+  PostingList shortList;
+  PostingList longList;
+  for (size_t i = 1; i <= 50000; i++) longList.addPosting(3 * i + i % 5, 1);
+  for (size_t i = 1; i <= 500; i++) shortList.addPosting(7 * i * i, 2);
+  longList.buildLearnedIndex();
+
+  PostingList expected = PostingList::intersectBaseline(shortList, longList);
+  PostingList result = PostingList::intersect(shortList, longList);
+  ASSERT_LT(0, expected.size());
+  ASSERT_EQ(expected.size(), result.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    ASSERT_EQ(expected.getId(i), result.getId(i));
+    ASSERT_EQ(3, result.getScore(i));
+  }
+}
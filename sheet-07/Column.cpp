@@ -0,0 +1,39 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+
+#include "./Column.h"
+
+// _____________________________________________________________________________
+MappedFile::MappedFile(const std::string& fileName) : _data(nullptr),
+    _size(0) {
+  int fd = open(fileName.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("could not open '" + fileName + "'");
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw std::runtime_error("could not stat '" + fileName + "'");
+  }
+  _size = st.st_size;
+  if (_size > 0) {
+    void* data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("could not map '" + fileName + "'");
+    }
+    _data = static_cast<const char*>(data);
+  }
+  close(fd);
+}
+
+// _____________________________________________________________________________
+MappedFile::~MappedFile() {
+  if (_data) { munmap(const_cast<char*>(_data), _size); }
+}
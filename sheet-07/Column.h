@@ -0,0 +1,144 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#ifndef COLUMN_H_
+#define COLUMN_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A read-only memory mapping of a whole file.
+class MappedFile {
+ public:
+  // Maps the given file. Throws std::runtime_error if that fails.
+  explicit MappedFile(const std::string& fileName);
+
+  // Unmaps the file.
+  ~MappedFile();
+
+  const char* data() const { return _data; }
+  size_t size() const { return _size; }
+
+ private:
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+
+  const char* _data;
+  size_t _size;
+};
+
+// An array of plain values that either owns its elements or refers to memory
+// that someone else keeps alive (like a MappedFile). Only an owning column can
+// grow.
+template <typename T>
+class Column {
+ public:
+  Column() : _data(nullptr), _size(0) {}
+  Column(const Column& other) { *this = other; }
+  Column& operator=(const Column& other) {
+    _owned = other._owned;
+    _data = other.isOwned() ? _owned.data() : other._data;
+    _size = other._size;
+    return *this;
+  }
+
+  // Takes over the given values.
+  void assign(std::vector<T>&& values) {
+    _owned = std::move(values);
+    _data = _owned.data();
+    _size = _owned.size();
+  }
+
+  // Refers to the given elements, which must outlive the column.
+  void refer(const T* data, size_t size) {
+    _owned.clear();
+    _owned.shrink_to_fit();
+    _data = data;
+    _size = size;
+  }
+
+  // Appends to an owning column.
+  void push_back(const T& value) {
+    _owned.push_back(value);
+    _data = _owned.data();
+    _size = _owned.size();
+  }
+  void append(const T* values, size_t n) {
+    _owned.insert(_owned.end(), values, values + n);
+    _data = _owned.data();
+    _size = _owned.size();
+  }
+
+  void clear() { assign(std::vector<T>()); }
+
+  const T& operator[](size_t i) const { return _data[i]; }
+  const T& back() const { return _data[_size - 1]; }
+  const T* data() const { return _data; }
+  const T* begin() const { return _data; }
+  const T* end() const { return _data + _size; }
+  size_t size() const { return _size; }
+  bool empty() const { return _size == 0; }
+  size_t sizeInBytes() const { return _size * sizeof(T); }
+
+ private:
+  bool isOwned() const { return _data == _owned.data(); }
+
+  std::vector<T> _owned;
+  const T* _data;
+  size_t _size;
+};
+
+// Columns are stored as their number of elements (a uint64_t), then the
+// elements, padded to a multiple of 8 bytes, so that the elements of every
+// column in a file that starts at an aligned address are aligned.
+const size_t COLUMN_ALIGNMENT = 8;
+
+// Appends the given column to the given stream.
+template <typename T>
+void writeColumn(std::ostream& out, const Column<T>& column) {
+  uint64_t size = column.size();
+  out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+  out.write(reinterpret_cast<const char*>(column.data()),
+      column.sizeInBytes());
+  static const char padding[COLUMN_ALIGNMENT] = {0};
+  out.write(padding, (COLUMN_ALIGNMENT - column.sizeInBytes() %
+      COLUMN_ALIGNMENT) % COLUMN_ALIGNMENT);
+}
+
+// Reads a column written by writeColumn from the memory at 'pos' and moves pos
+// past it. The column refers to that memory if 'map' is true, and copies it
+// otherwise. Throws std::runtime_error if the column doesn't end before
+// 'end'.
+template <typename T>
+void readColumn(const char*& pos, const char* end, bool map,
+    Column<T>& column) {
+  uint64_t size;
+  if (static_cast<size_t>(end - pos) < sizeof(size)) {
+    throw std::runtime_error("truncated column");
+  }
+  std::memcpy(&size, pos, sizeof(size));
+  pos += sizeof(size);
+  size_t numBytes = size * sizeof(T);
+  size_t numPadded = (numBytes + COLUMN_ALIGNMENT - 1) / COLUMN_ALIGNMENT *
+      COLUMN_ALIGNMENT;
+  if (size > static_cast<size_t>(end - pos) / sizeof(T) ||
+      numPadded > static_cast<size_t>(end - pos)) {
+    throw std::runtime_error("truncated column");
+  }
+  const T* data = reinterpret_cast<const T*>(pos);
+  if (map) {
+    column.refer(data, size);
+  } else {
+    column.assign(std::vector<T>(data, data + size));
+  }
+  pos += numPadded;
+}
+
+#endif  // COLUMN_H_
@@ -0,0 +1,328 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#include "./CountFilter.h"
+#include <math.h>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// The factor mu of CountFilter::numLongLists.
+const double DIVIDE_SKIP_MU = 0.0085;
+
+// Prefix filtering costs about as much per element of the lists it reads as
+// ScanCount per element of all lists times this factor (measured on 300K
+// entities; for DivideSkip, it's 16).
+const size_t PREFIX_COST_FACTOR = 6;
+
+// _____________________________________________________________________________
+void ListMerger::reset(const std::vector<InvertedList>& lists) {
+  _cursors.resize(lists.size());
+  _heap.clear();
+  _numConsumed = 0;
+  _numTotal = 0;
+
+  // Initially, put all first elements of each list into the heap.
+  std::greater<std::pair<size_t, size_t> > cmp;
+  for (size_t i = 0; i < lists.size(); ++i) {
+    _numTotal += lists[i].size;
+    _cursors[i].reset(lists[i]);
+    if (!_cursors[i].done()) {
+      _heap.push_back(std::pair<size_t, size_t>(_cursors[i].id(), i));
+      std::push_heap(_heap.begin(), _heap.end(), cmp);
+    }
+  }
+}
+
+// _____________________________________________________________________________
+bool ListMerger::next(size_t& id, size_t& count) {
+  if (_heap.empty()) { return false; }
+
+  std::greater<std::pair<size_t, size_t> > cmp;
+  id = _heap.front().first;
+  count = 0;
+  while (!_heap.empty() && _heap.front().first == id) {
+    count++;
+    _numConsumed++;
+    size_t listId = _heap.front().second;
+    std::pop_heap(_heap.begin(), _heap.end(), cmp);
+    _heap.pop_back();
+
+    // Add the next element of the corresponding list to the heap.
+    ListCursor& cursor = _cursors[listId];
+    cursor.next();
+    if (!cursor.done()) {
+      _heap.push_back(std::pair<size_t, size_t>(cursor.id(), listId));
+      std::push_heap(_heap.begin(), _heap.end(), cmp);
+    }
+  }
+  return true;
+}
+
+// _____________________________________________________________________________
+size_t CountFilter::numLongLists(const std::vector<InvertedList>& lists,
+    size_t threshold) {
+  size_t maxLength = 0;
+  for (const InvertedList& list : lists) {
+    maxLength = std::max(maxLength, list.size);
+  }
+  if (threshold <= 1 || maxLength == 0) { return 0; }
+  size_t numLong = threshold / (DIVIDE_SKIP_MU * log2(maxLength) + 1);
+  return std::min(std::min(numLong, threshold - 1), lists.size());
+}
+
+// _____________________________________________________________________________
+CountFilterMode CountFilter::chooseMode(
+    const std::vector<InvertedList>& lists, size_t threshold) {
+  if (threshold <= 1) { return COUNT_FILTER_SCAN_COUNT; }
+  std::vector<size_t> lengths;
+  size_t total = 0;
+  for (const InvertedList& list : lists) {
+    lengths.push_back(list.size);
+    total += list.size;
+  }
+  std::sort(lengths.begin(), lengths.end(), std::greater<size_t>());
+  size_t shortTotal = total;
+  for (size_t i = 0; i + 1 < threshold && i < lengths.size(); i++) {
+    shortTotal -= lengths[i];
+  }
+  if (PREFIX_COST_FACTOR * shortTotal < total) { return COUNT_FILTER_PREFIX; }
+  return COUNT_FILTER_SCAN_COUNT;
+}
+
+// _____________________________________________________________________________
+void CountFilter::reset(const std::vector<InvertedList>& lists,
+    size_t threshold, CountFilterMode mode) {
+  _threshold = std::max<size_t>(threshold, 1);
+  _cursors.resize(lists.size());
+  for (size_t i = 0; i < lists.size(); i++) { _cursors[i].reset(lists[i]); }
+  _lastIds.assign(lists.size(), 0);
+  _pending.clear();
+  _numPending = 0;
+  _numReturned = 0;
+  _numPlainFound = 0;
+  _numTotal = 0;
+  for (const InvertedList& list : lists) { _numTotal += list.size; }
+  _exhausted = false;
+
+  if (mode == COUNT_FILTER_AUTO) { mode = chooseMode(lists, _threshold); }
+  // ScanCount keeps two 8-bit counts per id.
+  bool isScan = mode == COUNT_FILTER_SCAN_COUNT || mode == COUNT_FILTER_PREFIX;
+  if (isScan && lists.size() > UINT8_MAX) {
+    mode = COUNT_FILTER_MERGE_SKIP;
+    isScan = false;
+  }
+  _mode = mode;
+
+  // The longest lists first. DivideSkip and prefix filtering only probe the
+  // first _numLong of them.
+  _popped.clear();
+  for (size_t i = 0; i < lists.size(); i++) { _popped.push_back(i); }
+  std::sort(_popped.begin(), _popped.end(), [&lists](uint32_t a,
+      uint32_t b) { return lists[a].size > lists[b].size; });
+  _numLong = 0;
+  if (mode == COUNT_FILTER_DIVIDE_SKIP) {
+    _numLong = numLongLists(lists, _threshold);
+  } else if (mode == COUNT_FILTER_PREFIX) {
+    _numLong = std::min(_threshold - 1, lists.size());
+  }
+  _longLists.assign(_popped.begin(), _popped.begin() + _numLong);
+
+  if (isScan) {
+    _shortLists.assign(_popped.begin() + _numLong, _popped.end());
+    _blockStart = 0;
+    _blockSize = SCAN_COUNT_MIN_BLOCK_SIZE;
+    if (_counts.size() < SCAN_COUNT_MAX_BLOCK_SIZE) {
+      _counts.assign(SCAN_COUNT_MAX_BLOCK_SIZE, 0);
+    }
+  } else {
+    _heap.clear();
+    for (size_t i = _numLong; i < _popped.size(); i++) {
+      pushHead(_popped[i]);
+    }
+  }
+}
+
+// _____________________________________________________________________________
+size_t CountFilter::next(size_t maxCandidates,
+    std::vector<uint32_t>& candidates) {
+  if (_pending.size() - _numPending < maxCandidates) {
+    // Drop the candidates handed out already.
+    _pending.erase(_pending.begin(), _pending.begin() + _numPending);
+    _numPending = 0;
+    if (_mode == COUNT_FILTER_SCAN_COUNT || _mode == COUNT_FILTER_PREFIX) {
+      fillScanCount(maxCandidates);
+    } else {
+      fillSkip(maxCandidates);
+    }
+  }
+  size_t num = std::min(maxCandidates, _pending.size() - _numPending);
+  candidates.insert(candidates.end(), _pending.begin() + _numPending,
+      _pending.begin() + _numPending + num);
+  _numPending += num;
+  _numReturned += num;
+  return num;
+}
+
+// _____________________________________________________________________________
+size_t CountFilter::numConsumed() const {
+  size_t numConsumed = 0;
+  for (const ListCursor& cursor : _cursors) { numConsumed += cursor.index(); }
+  return numConsumed;
+}
+
+// _____________________________________________________________________________
+void CountFilter::fillScanCount(size_t maxCandidates) {
+  const size_t threshold = _threshold - _numLong;
+  while (!_exhausted && _pending.size() < maxCandidates) {
+    size_t blockEnd = _blockStart + _blockSize;
+    size_t numOld = _pending.size();
+    _exhausted = true;
+    for (uint32_t i : _shortLists) {
+      ListCursor& cursor = _cursors[i];
+      const InvertedList list = cursor.list();
+      uint32_t lastId = _lastIds[i];
+      uint32_t lastInWindow = 0;
+      // Read the decoded blocks of the list directly, which keeps the loop
+      // state in registers.
+      while (!cursor.done() && cursor.id() < blockEnd) {
+        const uint32_t* ids = cursor.blockIds();
+        const uint8_t* positions = cursor.blockPositions();
+        size_t pos = cursor.blockIndex();
+        size_t n = cursor.blockSize();
+        for (; pos < n && ids[pos] < blockEnd; pos++) {
+          // Count the first element of each id, and the first one in the
+          // window.
+          uint32_t id = ids[pos];
+          bool isFirst = id != lastId;
+          bool isFirstInWindow = id != lastInWindow &&
+              list.inWindow(positions[pos]);
+          lastId = id;
+          if (!isFirst && !isFirstInWindow) { continue; }
+          if (isFirstInWindow) { lastInWindow = id; }
+          uint16_t count = _counts[id - _blockStart] += (isFirst << 8) |
+              isFirstInWindow;
+          if (isFirst && (count >> 8) == threshold) { _numPlainFound++; }
+          if (isFirstInWindow && (count & 0xFF) == threshold) {
+            _pending.push_back(id);
+          }
+        }
+        cursor.seek(pos);
+      }
+      _lastIds[i] = lastId;
+      if (!cursor.done()) { _exhausted = false; }
+    }
+    std::sort(_pending.begin() + numOld, _pending.end());
+
+    // Look up the candidates of the short lists in the long lists, as long as
+    // they can still reach the threshold.
+    if (_numLong > 0) {
+      size_t numKept = numOld;
+      for (size_t j = numOld; j < _pending.size(); j++) {
+        uint32_t id = _pending[j];
+        size_t count = _counts[id - _blockStart] & 0xFF;
+        for (size_t i = 0; i < _numLong && count < _threshold &&
+             count + _numLong - i >= _threshold; i++) {
+          if (skipPast(_longLists[i], id)) { count++; }
+        }
+        if (count >= _threshold) { _pending[numKept++] = id; }
+      }
+      _pending.resize(numKept);
+      if (_exhausted) { finish(); }
+    }
+    std::fill(_counts.begin(), _counts.begin() + _blockSize, 0);
+    _blockStart = blockEnd;
+    _blockSize = std::min(2 * _blockSize, SCAN_COUNT_MAX_BLOCK_SIZE);
+  }
+}
+
+// _____________________________________________________________________________
+void CountFilter::fillSkip(size_t maxCandidates) {
+  uint32_t id;
+  size_t count;
+  while (!_exhausted && _pending.size() < maxCandidates) {
+    if (!nextMergeSkip(_threshold - _numLong, id, count)) {
+      finish();
+      _exhausted = true;
+      break;
+    }
+    // Look up the candidates of the short lists in the long lists.
+    for (size_t i = 0; i < _numLong && count < _threshold; i++) {
+      if (skipPast(_longLists[i], id)) { count++; }
+    }
+    if (count >= _threshold) { _pending.push_back(id); }
+  }
+}
+
+// _____________________________________________________________________________
+bool CountFilter::nextMergeSkip(size_t threshold, uint32_t& id,
+    size_t& count) {
+  std::greater<std::pair<uint32_t, uint32_t> > cmp;
+  while (!_heap.empty()) {
+    // Take all lists with the smallest head off the heap.
+    uint32_t head = _heap.front().first;
+    _popped.clear();
+    count = 0;
+    while (!_heap.empty() && _heap.front().first == head) {
+      _popped.push_back(_heap.front().second);
+      std::pop_heap(_heap.begin(), _heap.end(), cmp);
+      _heap.pop_back();
+      skipPast(_popped.back(), head);
+      count++;
+    }
+    if (count >= threshold) {
+      for (uint32_t listId : _popped) { pushHead(listId); }
+      id = head;
+      return true;
+    }
+
+    // Take more lists off the heap, up to threshold - 1 in total. Ids below
+    // the smallest head left on the heap occur in those lists only, so less
+    // than threshold times.
+    while (_popped.size() + 1 < threshold && !_heap.empty()) {
+      _popped.push_back(_heap.front().second);
+      std::pop_heap(_heap.begin(), _heap.end(), cmp);
+      _heap.pop_back();
+    }
+    if (_heap.empty()) { return false; }
+    uint32_t target = _heap.front().first;
+    for (uint32_t listId : _popped) {
+      skipTo(listId, target);
+      pushHead(listId);
+    }
+  }
+  return false;
+}
+
+// _____________________________________________________________________________
+void CountFilter::skipTo(size_t listId, uint32_t id) {
+  _cursors[listId].skipTo(id);
+}
+
+// _____________________________________________________________________________
+bool CountFilter::skipPast(size_t listId, uint32_t id) {
+  ListCursor& cursor = _cursors[listId];
+  cursor.skipTo(id);
+  bool found = false;
+  for (; !cursor.done() && cursor.id() == id; cursor.next()) {
+    found = found || cursor.inWindow();
+  }
+  return found;
+}
+
+// _____________________________________________________________________________
+void CountFilter::pushHead(size_t listId) {
+  ListCursor& cursor = _cursors[listId];
+  while (!cursor.done() && !cursor.inWindow()) { cursor.next(); }
+  if (!cursor.done()) {
+    _heap.push_back(std::pair<uint32_t, uint32_t>(cursor.id(), listId));
+    std::push_heap(_heap.begin(), _heap.end(),
+        std::greater<std::pair<uint32_t, uint32_t> >());
+  }
+}
+
+// _____________________________________________________________________________
+void CountFilter::finish() {
+  for (ListCursor& cursor : _cursors) { cursor.finish(); }
+}
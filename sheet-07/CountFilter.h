@@ -0,0 +1,188 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#ifndef COUNTFILTER_H_
+#define COUNTFILTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+#include "./InvertedList.h"
+
+// Merges inverted lists step by step, with a min-heap over the list heads, so
+// that the caller can stop early. Keeps its memory across merges.
+class ListMerger {
+ public:
+  ListMerger() : _numConsumed(0), _numTotal(0) {}
+
+  // Starts merging the given lists (whose store must outlive the merging).
+  void reset(const std::vector<InvertedList>& lists);
+
+  // Sets the next (smallest) id and the number of lists that contain it.
+  // Returns false if all lists are exhausted.
+  bool next(size_t& id, size_t& count);
+
+  // The number of list elements merged so far, and in total.
+  size_t numConsumed() const { return _numConsumed; }
+  size_t numTotal() const { return _numTotal; }
+
+ private:
+  // The current position in each list.
+  std::vector<ListCursor> _cursors;
+
+  // The heap of (element, listId) pairs, smallest element on top.
+  std::vector<std::pair<size_t, size_t> > _heap;
+
+  size_t _numConsumed;
+  size_t _numTotal;
+};
+
+// How CountFilter finds the ids that occur in at least T lists (the
+// T-occurrence problem, see Li, Lu and Lu, ICDE 2008).
+enum CountFilterMode {
+  // One of the modes below, chosen from the list lengths.
+  COUNT_FILTER_AUTO,
+  // Counts the elements of all lists in a dense array, one id range (block)
+  // at a time: no heap and no comparisons, but touches every element.
+  COUNT_FILTER_SCAN_COUNT,
+  // Merges the lists with a heap over the list heads, but whenever the
+  // smallest id occurs in less than T lists, takes the T - 1 smallest heads
+  // off the heap and jumps their lists to the next head (no id in between
+  // can occur in T lists).
+  COUNT_FILTER_MERGE_SKIP,
+  // MergeSkip with threshold T - L over all but the L longest lists, and a
+  // search in the long lists for each of the resulting candidates only.
+  COUNT_FILTER_DIVIDE_SKIP,
+  // Prefix filtering: an id in T of n lists is in at least one of the
+  // n - T + 1 shortest ones. Reads only those (with ScanCount) and searches
+  // the T - 1 longest lists for each of their ids, by galloping.
+  COUNT_FILTER_PREFIX
+};
+
+// The number of ids ScanCount counts in its first block. Later blocks double
+// in size, up to SCAN_COUNT_MAX_BLOCK_SIZE.
+const size_t SCAN_COUNT_MIN_BLOCK_SIZE = 4096;
+const size_t SCAN_COUNT_MAX_BLOCK_SIZE = 65536;
+
+// Finds the ids that occur in at least T of a set of sorted lists, step by
+// step and in ascending order, so that the caller can stop early. A list
+// counts once per id, even if it contains the id several times (an inverted
+// list has one element per occurrence of its q-gram in a name or synonym).
+// That is still a valid count filter, since the
+// prefix shares at least |x| - q * delta q-gram occurrences with a match.
+// Only the elements in the position window of their list count, which makes
+// it a positional count filter. Keeps its memory across searches.
+class CountFilter {
+ public:
+  CountFilter() : _threshold(1),
+      _mode(COUNT_FILTER_SCAN_COUNT),
+      _numLong(0), _blockStart(0), _blockSize(0), _numPlainFound(0),
+      _numPending(0), _numReturned(0), _numTotal(0), _exhausted(true) {}
+
+  // Starts searching the ids that occur at least threshold >= 1 times in the
+  // given lists (whose store must outlive the search).
+  void reset(const std::vector<InvertedList>& lists, size_t threshold,
+      CountFilterMode mode = COUNT_FILTER_AUTO);
+
+  // Appends the next up to maxCandidates ids to 'candidates', in ascending
+  // order. Returns their number, 0 iff there are none left.
+  size_t next(size_t maxCandidates, std::vector<uint32_t>& candidates);
+
+  // Returns the mode of the current search.
+  CountFilterMode mode() const { return _mode; }
+
+  // The number of list elements merged or skipped so far, and in total.
+  size_t numConsumed() const;
+  size_t numTotal() const { return _numTotal; }
+
+  // The number of ids found so far, and handed out by next() so far.
+  size_t numFound() const { return _numReturned + _pending.size() -
+      _numPending; }
+  size_t numReturned() const { return _numReturned; }
+
+  // The number of ids that occur in at least T lists, but not in the
+  // position windows of T lists, in the part of the lists seen so far.
+  // ScanCount only, 0 in the other modes.
+  size_t numPositionDropped() const {
+    return _mode == COUNT_FILTER_SCAN_COUNT ? _numPlainFound - numFound() : 0;
+  }
+
+  // Picks the mode for the given lists and threshold: prefix filtering if the
+  // lists it reads are tiny compared to the ones it only probes, ScanCount
+  // otherwise. On dense ids, ScanCount beats MergeSkip even when it could
+  // skip a lot, and prefix filtering reads fewer lists than DivideSkip, so
+  // AUTO never picks those two.
+  static CountFilterMode chooseMode(const std::vector<InvertedList>& lists,
+      size_t threshold);
+
+  // The number of long lists of DivideSkip, T / (mu * log2(M) + 1) (but less
+  // than T), where M is the length of the longest list.
+  static size_t numLongLists(const std::vector<InvertedList>& lists,
+      size_t threshold);
+
+ private:
+  // Adds candidates to _pending until it has maxCandidates or the search is
+  // exhausted, with the algorithm of the current mode.
+  void fillScanCount(size_t maxCandidates);
+  void fillSkip(size_t maxCandidates);
+
+  // Sets the next id that occurs at least 'threshold' times in the lists on
+  // the heap and that number, skipping where possible. Returns false if
+  // there is none.
+  bool nextMergeSkip(size_t threshold, uint32_t& id, size_t& count);
+
+  // Moves the position in the given list to the first element >= id.
+  void skipTo(size_t listId, uint32_t id);
+
+  // Same, but also moves past the elements equal to id. Returns true if there
+  // were any in the position window.
+  bool skipPast(size_t listId, uint32_t id);
+
+  // Moves the given list to its next element in the position window and puts
+  // that on the heap, unless the list is exhausted.
+  void pushHead(size_t listId);
+
+  // Moves all positions to the end of their lists.
+  void finish();
+
+  size_t _threshold;
+  CountFilterMode _mode;
+
+  // The current position in each list, and the last id read from it (0 for
+  // none).
+  std::vector<ListCursor> _cursors;
+  std::vector<uint32_t> _lastIds;
+
+  // The _numLong longest lists, which DIVIDE_SKIP and PREFIX only probe.
+  std::vector<uint32_t> _longLists;
+  size_t _numLong;
+
+  // MERGE_SKIP and DIVIDE_SKIP: the heap of (head, listId) pairs over all
+  // lists but the long ones, smallest head on top, and the lists just taken
+  // off the heap.
+  std::vector<std::pair<uint32_t, uint32_t> > _heap;
+  std::vector<uint32_t> _popped;
+
+  // SCAN_COUNT and PREFIX: the lists they read.
+  std::vector<uint32_t> _shortLists;
+
+  // SCAN_COUNT and PREFIX: the counts of the ids from _blockStart to
+  // _blockStart + _blockSize - 1 in the lists they read, without the position
+  // windows in the high byte and with them in the low byte, and the number of
+  // ids where the former reached the threshold.
+  std::vector<uint16_t> _counts;
+  size_t _blockStart;
+  size_t _blockSize;
+  size_t _numPlainFound;
+
+  // The candidates found but not yet handed out, from _numPending on.
+  std::vector<uint32_t> _pending;
+  size_t _numPending;
+  size_t _numReturned;
+
+  size_t _numTotal;
+  bool _exhausted;
+};
+
+#endif  // COUNTFILTER_H_
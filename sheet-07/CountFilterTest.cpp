@@ -0,0 +1,167 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "./CountFilter.h"
+
+// Returns the ids that occur in at least 'threshold' of the given lists,
+// counting every list at most once per id.
+std::vector<uint32_t> referenceCandidates(
+    const std::vector<std::vector<uint32_t> >& lists, size_t threshold) {
+  std::vector<size_t> counts;
+  for (const std::vector<uint32_t>& list : lists) {
+    for (size_t i = 0; i < list.size(); i++) {
+      if (i > 0 && list[i] == list[i - 1]) continue;
+      if (counts.size() <= list[i]) counts.resize(list[i] + 1, 0);
+      counts[list[i]]++;
+    }
+  }
+  std::vector<uint32_t> result;
+  for (size_t id = 0; id < counts.size(); id++) {
+    if (counts[id] >= threshold) result.push_back(id);
+  }
+  return result;
+}
+
+// _____________________________________________________________________________
+TEST(CountFilterTest, next) {
+  std::vector<uint32_t> a = {1, 3, 3, 5, 7};
+  std::vector<uint32_t> b = {3, 5, 9};
+  std::vector<uint32_t> c = {5, 7, 9};
+  InvertedListStore store;
+  store.add(a.data(), nullptr, a.size());
+  store.add(b.data(), nullptr, b.size());
+  store.add(c.data(), nullptr, c.size());
+  std::vector<InvertedList> lists = {store.list(0), store.list(1),
+      store.list(2)};
+  for (CountFilterMode mode : {COUNT_FILTER_AUTO, COUNT_FILTER_SCAN_COUNT,
+      COUNT_FILTER_MERGE_SKIP, COUNT_FILTER_DIVIDE_SKIP, COUNT_FILTER_PREFIX}) {
+    CountFilter filter;
+    std::vector<uint32_t> candidates;
+    // The duplicate 3 in a counts once.
+    filter.reset(lists, 2, mode);
+    ASSERT_EQ(2, filter.next(2, candidates)) << mode;
+    ASSERT_EQ(2, filter.numReturned());
+    ASSERT_EQ(2, filter.next(2, candidates)) << mode;
+    ASSERT_EQ(0, filter.next(2, candidates)) << mode;
+    ASSERT_EQ(std::vector<uint32_t>({3, 5, 7, 9}), candidates) << mode;
+    ASSERT_EQ(11, filter.numConsumed());
+    ASSERT_EQ(11, filter.numTotal());
+
+    candidates.clear();
+    filter.reset(lists, 3, mode);
+    while (filter.next(1, candidates)) {}
+    ASSERT_EQ(std::vector<uint32_t>({5}), candidates) << mode;
+
+    candidates.clear();
+    filter.reset(lists, 4, mode);
+    ASSERT_EQ(0, filter.next(10, candidates)) << mode;
+  }
+}
+
+// _____________________________________________________________________________
+TEST(CountFilterTest, nextRandom) {
+  // Lists of very different lengths, with some duplicates, over an id range
+  // that needs several ScanCount blocks.
+  std::mt19937 gen(42);
+  for (size_t round = 0; round < 40; round++) {
+    size_t numLists = 1 + gen() % 12;
+    std::vector<std::vector<uint32_t> > lists(numLists);
+    InvertedListStore store;
+    for (std::vector<uint32_t>& list : lists) {
+      size_t length = gen() % 3 == 0 ? gen() % 50000 : gen() % 200;
+      for (size_t i = 0; i < length; i++) list.push_back(1 + gen() % 150000);
+      std::sort(list.begin(), list.end());
+      store.add(list.data(), nullptr, list.size());
+    }
+    std::vector<InvertedList> views;
+    for (size_t i = 0; i < numLists; i++) views.push_back(store.list(i));
+    size_t threshold = 1 + gen() % numLists;
+    std::vector<uint32_t> expected = referenceCandidates(lists, threshold);
+    for (CountFilterMode mode : {COUNT_FILTER_SCAN_COUNT,
+        COUNT_FILTER_MERGE_SKIP, COUNT_FILTER_DIVIDE_SKIP,
+        COUNT_FILTER_PREFIX}) {
+      CountFilter filter;
+      filter.reset(views, threshold, mode);
+      std::vector<uint32_t> candidates;
+      while (filter.next(1 + gen() % 300, candidates)) {}
+      ASSERT_EQ(expected, candidates) << mode << " " << threshold;
+      ASSERT_EQ(filter.numTotal(), filter.numConsumed());
+    }
+  }
+}
+
+// _____________________________________________________________________________
+TEST(CountFilterTest, nextWithPositions) {
+  // The same lists, with random positions and windows. The reference keeps
+  // only the elements in the windows.
+  std::mt19937 gen(23);
+  for (size_t round = 0; round < 40; round++) {
+    size_t numLists = 1 + gen() % 12;
+    std::vector<std::vector<uint32_t> > lists(numLists), inWindow(numLists);
+    std::vector<std::vector<uint8_t> > positions(numLists);
+    InvertedListStore store;
+    std::vector<InvertedList> views;
+    for (size_t i = 0; i < numLists; i++) {
+      size_t length = gen() % 3 == 0 ? gen() % 50000 : gen() % 200;
+      for (size_t j = 0; j < length; j++) {
+        lists[i].push_back(1 + gen() % 100000);
+      }
+      std::sort(lists[i].begin(), lists[i].end());
+      for (size_t j = 0; j < length; j++) positions[i].push_back(gen() % 8);
+      store.add(lists[i].data(), positions[i].data(), length);
+    }
+    // The views point into the store, so take them once it is complete.
+    for (size_t i = 0; i < numLists; i++) {
+      views.push_back(store.list(i));
+      views.back().minPosition = gen() % 4;
+      views.back().maxPosition = views.back().minPosition + gen() % 4;
+      for (size_t j = 0; j < lists[i].size(); j++) {
+        if (views.back().inWindow(positions[i][j])) {
+          inWindow[i].push_back(lists[i][j]);
+        }
+      }
+    }
+    size_t threshold = 1 + gen() % numLists;
+    std::vector<uint32_t> expected = referenceCandidates(inWindow, threshold);
+    size_t numPlain = referenceCandidates(lists, threshold).size();
+    for (CountFilterMode mode : {COUNT_FILTER_SCAN_COUNT,
+        COUNT_FILTER_MERGE_SKIP, COUNT_FILTER_DIVIDE_SKIP,
+        COUNT_FILTER_PREFIX}) {
+      CountFilter filter;
+      filter.reset(views, threshold, mode);
+      std::vector<uint32_t> candidates;
+      while (filter.next(1 + gen() % 300, candidates)) {}
+      ASSERT_EQ(expected, candidates) << mode << " " << threshold;
+      if (mode == COUNT_FILTER_SCAN_COUNT) {
+        ASSERT_EQ(numPlain - expected.size(), filter.numPositionDropped());
+      }
+    }
+  }
+}
+
+// _____________________________________________________________________________
+TEST(CountFilterTest, chooseMode) {
+  std::vector<uint32_t> longList(100000), shortList(10);
+  for (size_t i = 0; i < longList.size(); i++) longList[i] = i + 1;
+  for (size_t i = 0; i < shortList.size(); i++) shortList[i] = 1000 * i + 1;
+  InvertedListStore store;
+  store.add(longList.data(), nullptr, longList.size());
+  store.add(shortList.data(), nullptr, shortList.size());
+  InvertedList longView = store.list(0);
+  InvertedList shortView = store.list(1);
+
+  std::vector<InvertedList> lists = {longView, shortView, shortView};
+  ASSERT_EQ(COUNT_FILTER_SCAN_COUNT, CountFilter::chooseMode(lists, 1));
+  ASSERT_EQ(1, CountFilter::numLongLists(lists, 2));
+  ASSERT_EQ(COUNT_FILTER_PREFIX, CountFilter::chooseMode(lists, 2));
+  // With T = 3, prefix filtering would have to read a long list.
+  lists = {longView, longView, longView, shortView};
+  ASSERT_EQ(COUNT_FILTER_SCAN_COUNT, CountFilter::chooseMode(lists, 3));
+  ASSERT_EQ(COUNT_FILTER_PREFIX, CountFilter::chooseMode(lists, 4));
+  lists = {shortView, shortView, shortView};
+  ASSERT_EQ(COUNT_FILTER_SCAN_COUNT, CountFilter::chooseMode(lists, 2));
+}
@@ -0,0 +1,198 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#include <zlib.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "./EntityStore.h"
+
+namespace {
+
+// The first bytes of a file written by EntityStore::save, and its version.
+const char ENTITY_STORE_MAGIC[8] = {'E', 'N', 'T', 'I', 'T', 'I', 'E', 'S'};
+const uint64_t ENTITY_STORE_VERSION = 1;
+}  // namespace
+
+// _____________________________________________________________________________
+void EntityStore::clear() {
+  _strings.clear();
+  _stringOffsets.assign(std::vector<uint64_t>(1, 0));
+  _firstStrings.assign(std::vector<uint32_t>(1, 0));
+  _scores.clear();
+  _descriptionBlocks.clear();
+  _blockOffsets.assign(std::vector<uint64_t>(1, 0));
+  _pendingDescriptions.clear();
+  _pendingOffsets.assign(1, 0);
+  _file.reset();
+}
+
+// _____________________________________________________________________________
+void EntityStore::add(boost::string_ref name, uint32_t score,
+    boost::string_ref description, boost::string_ref wikipediaUrl,
+    boost::string_ref wikidataId,
+    const std::vector<boost::string_ref>& synonyms,
+    boost::string_ref imageUrl) {
+  boost::string_ref fields[ENTITY_NUM_FIELDS];
+  fields[ENTITY_NAME] = name;
+  fields[ENTITY_WIKIPEDIA_URL] = wikipediaUrl;
+  fields[ENTITY_WIKIDATA_ID] = wikidataId;
+  fields[ENTITY_IMAGE_URL] = imageUrl;
+  for (size_t i = 0; i < ENTITY_NUM_FIELDS + synonyms.size(); i++) {
+    boost::string_ref str = i < ENTITY_NUM_FIELDS ? fields[i] :
+        synonyms[i - ENTITY_NUM_FIELDS];
+    _strings.append(str.data(), str.size());
+    _stringOffsets.push_back(_strings.size());
+  }
+  _firstStrings.push_back(_stringOffsets.size() - 1);
+  _scores.push_back(score);
+
+  _pendingDescriptions.append(description.data(), description.size());
+  _pendingOffsets.push_back(_pendingDescriptions.size());
+  if (_pendingOffsets.size() > DESCRIPTION_BLOCK_SIZE) { compressPending(); }
+}
+
+// _____________________________________________________________________________
+void EntityStore::finish() {
+  if (_pendingOffsets.size() > 1) { compressPending(); }
+}
+
+// _____________________________________________________________________________
+void EntityStore::append(const EntityStore& other) {
+  if (size() % DESCRIPTION_BLOCK_SIZE != 0) {
+    throw std::logic_error("the store ends in a partial description block");
+  }
+  uint64_t stringBase = _strings.size();
+  uint32_t firstStringBase = _stringOffsets.size() - 1;
+  uint64_t blockBase = _descriptionBlocks.size();
+  _strings.append(other._strings.data(), other._strings.size());
+  for (size_t i = 1; i < other._stringOffsets.size(); i++) {
+    _stringOffsets.push_back(stringBase + other._stringOffsets[i]);
+  }
+  for (size_t i = 1; i < other._firstStrings.size(); i++) {
+    _firstStrings.push_back(firstStringBase + other._firstStrings[i]);
+  }
+  _scores.append(other._scores.data(), other._scores.size());
+  _descriptionBlocks.append(other._descriptionBlocks.data(),
+      other._descriptionBlocks.size());
+  for (size_t i = 1; i < other._blockOffsets.size(); i++) {
+    _blockOffsets.push_back(blockBase + other._blockOffsets[i]);
+  }
+}
+
+// _____________________________________________________________________________
+void EntityStore::compressPending() {
+  std::string block(reinterpret_cast<const char*>(_pendingOffsets.data()),
+      _pendingOffsets.size() * sizeof(uint32_t));
+  block += _pendingDescriptions;
+  uint32_t rawSize = block.size();
+  uLongf compressedSize = compressBound(rawSize);
+  std::vector<char> compressed(sizeof(rawSize) + compressedSize);
+  std::memcpy(compressed.data(), &rawSize, sizeof(rawSize));
+  // Level 1: descriptions are read rarely, but all of them are compressed at
+  // build time.
+  if (compress2(reinterpret_cast<Bytef*>(compressed.data() + sizeof(rawSize)),
+      &compressedSize, reinterpret_cast<const Bytef*>(block.data()), rawSize,
+      1) != Z_OK) {
+    throw std::runtime_error("could not compress descriptions");
+  }
+  _descriptionBlocks.append(compressed.data(),
+      sizeof(rawSize) + compressedSize);
+  _blockOffsets.push_back(_descriptionBlocks.size());
+  _pendingDescriptions.clear();
+  _pendingOffsets.assign(1, 0);
+}
+
+// _____________________________________________________________________________
+std::string EntityStore::description(uint32_t id) const {
+  size_t b = (id - 1) / DESCRIPTION_BLOCK_SIZE;
+  size_t i = (id - 1) % DESCRIPTION_BLOCK_SIZE;
+  const char* compressed = _descriptionBlocks.data() + _blockOffsets[b];
+  uint32_t rawSize;
+  std::memcpy(&rawSize, compressed, sizeof(rawSize));
+  std::vector<char> block(rawSize);
+  uLongf blockSize = rawSize;
+  if (uncompress(reinterpret_cast<Bytef*>(block.data()), &blockSize,
+      reinterpret_cast<const Bytef*>(compressed + sizeof(rawSize)),
+      _blockOffsets[b + 1] - _blockOffsets[b] - sizeof(rawSize)) != Z_OK) {
+    throw std::runtime_error("corrupt description block");
+  }
+  size_t numDescriptions = std::min(DESCRIPTION_BLOCK_SIZE,
+      size() - b * DESCRIPTION_BLOCK_SIZE);
+  uint32_t offsets[2];
+  std::memcpy(offsets, block.data() + i * sizeof(uint32_t), sizeof(offsets));
+  const char* text = block.data() + (numDescriptions + 1) * sizeof(uint32_t);
+  return std::string(text + offsets[0], text + offsets[1]);
+}
+
+// _____________________________________________________________________________
+size_t EntityStore::sizeInBytes() const {
+  return _strings.sizeInBytes() + _stringOffsets.sizeInBytes()
+      + _firstStrings.sizeInBytes() + _scores.sizeInBytes()
+      + _descriptionBlocks.sizeInBytes() + _blockOffsets.sizeInBytes();
+}
+
+// _____________________________________________________________________________
+void EntityStore::write(std::ostream& out) const {
+  writeColumn(out, _strings);
+  writeColumn(out, _stringOffsets);
+  writeColumn(out, _firstStrings);
+  writeColumn(out, _scores);
+  writeColumn(out, _descriptionBlocks);
+  writeColumn(out, _blockOffsets);
+}
+
+// _____________________________________________________________________________
+void EntityStore::read(const char*& pos, const char* end, bool map,
+    std::shared_ptr<const MappedFile> file) {
+  clear();
+  readColumn(pos, end, map, _strings);
+  readColumn(pos, end, map, _stringOffsets);
+  readColumn(pos, end, map, _firstStrings);
+  readColumn(pos, end, map, _scores);
+  readColumn(pos, end, map, _descriptionBlocks);
+  readColumn(pos, end, map, _blockOffsets);
+  if (_stringOffsets.empty() || _stringOffsets.back() != _strings.size() ||
+      _firstStrings.size() != _scores.size() + 1 ||
+      _firstStrings.back() + 1 != _stringOffsets.size() ||
+      _blockOffsets.size() != (size() + DESCRIPTION_BLOCK_SIZE - 1) /
+          DESCRIPTION_BLOCK_SIZE + 1 ||
+      _blockOffsets.back() != _descriptionBlocks.size()) {
+    throw std::runtime_error("inconsistent entity store");
+  }
+  if (map) { _file = file; }
+}
+
+// _____________________________________________________________________________
+void EntityStore::save(const std::string& fileName) const {
+  std::ofstream out(fileName.c_str(), std::ios_base::binary);
+  out.write(ENTITY_STORE_MAGIC, sizeof(ENTITY_STORE_MAGIC));
+  out.write(reinterpret_cast<const char*>(&ENTITY_STORE_VERSION),
+      sizeof(ENTITY_STORE_VERSION));
+  write(out);
+  if (!out) {
+    throw std::runtime_error("could not write '" + fileName + "'");
+  }
+}
+
+// _____________________________________________________________________________
+void EntityStore::load(const std::string& fileName, bool map) {
+  std::shared_ptr<const MappedFile> file(new MappedFile(fileName));
+  const char* pos = file->data();
+  const char* end = pos + file->size();
+  uint64_t version;
+  if (file->size() < sizeof(ENTITY_STORE_MAGIC) + sizeof(version) ||
+      std::memcmp(pos, ENTITY_STORE_MAGIC, sizeof(ENTITY_STORE_MAGIC)) != 0) {
+    throw std::runtime_error("'" + fileName + "' is no entity store");
+  }
+  pos += sizeof(ENTITY_STORE_MAGIC);
+  std::memcpy(&version, pos, sizeof(version));
+  pos += sizeof(version);
+  if (version != ENTITY_STORE_VERSION) {
+    throw std::runtime_error("'" + fileName + "' has an unknown version");
+  }
+  read(pos, end, map, file);
+}
@@ -0,0 +1,125 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#ifndef ENTITYSTORE_H_
+#define ENTITYSTORE_H_
+
+#include <boost/utility/string_ref.hpp>
+#include <stdint.h>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "./Column.h"
+
+// The number of descriptions EntityStore compresses together.
+const size_t DESCRIPTION_BLOCK_SIZE = 64;
+
+// The fields of an entity (besides its score and description) in the order
+// EntityStore keeps them, followed by the synonyms.
+enum EntityField {
+  ENTITY_NAME,
+  ENTITY_WIKIPEDIA_URL,
+  ENTITY_WIKIDATA_ID,
+  ENTITY_IMAGE_URL,
+  ENTITY_NUM_FIELDS
+};
+
+// The entities of the index, column by column: all strings in one blob with
+// an offset array, the scores in one array, and the descriptions compressed
+// (with zlib) in blocks of DESCRIPTION_BLOCK_SIZE, which are only decompressed
+// when a description is asked for. Either owns its columns or maps them from
+// a file written by save(). Entity ids are 1-based, in the order of add().
+class EntityStore {
+ public:
+  EntityStore() { clear(); }
+
+  // Removes all entities.
+  void clear();
+
+  // Appends an entity. Call finish() after the last one.
+  void add(boost::string_ref name, uint32_t score,
+      boost::string_ref description, boost::string_ref wikipediaUrl,
+      boost::string_ref wikidataId,
+      const std::vector<boost::string_ref>& synonyms,
+      boost::string_ref imageUrl);
+
+  // Compresses the descriptions that are not compressed yet.
+  void finish();
+
+  // Appends the entities of the given (finished) store. The size of this
+  // store must be a multiple of DESCRIPTION_BLOCK_SIZE.
+  void append(const EntityStore& other);
+
+  // The number of entities.
+  size_t size() const { return _scores.size(); }
+
+  uint32_t score(uint32_t id) const { return _scores[id - 1]; }
+  boost::string_ref field(uint32_t id, EntityField field) const {
+    return stringAt(_firstStrings[id - 1] + field);
+  }
+  boost::string_ref name(uint32_t id) const {
+    return field(id, ENTITY_NAME);
+  }
+  size_t numSynonyms(uint32_t id) const {
+    return _firstStrings[id] - _firstStrings[id - 1] - ENTITY_NUM_FIELDS;
+  }
+  boost::string_ref synonym(uint32_t id, size_t i) const {
+    return stringAt(_firstStrings[id - 1] + ENTITY_NUM_FIELDS + i);
+  }
+
+  // Decompresses the description of the given entity.
+  std::string description(uint32_t id) const;
+
+  // The memory used by the columns in bytes (also when they are mapped).
+  size_t sizeInBytes() const;
+
+  // Writes the (finished) store to the given stream, or reads one written
+  // like that from the memory at 'pos' and moves pos past it. See
+  // readColumn() for 'end' and 'map'. If 'map' is true, 'file' must hold
+  // the memory and is kept alive with the store.
+  void write(std::ostream& out) const;
+  void read(const char*& pos, const char* end, bool map,
+      std::shared_ptr<const MappedFile> file);
+
+  // Writes the store to the given file, or replaces it by the one in the
+  // given file, mapped or copied into memory. Throw std::runtime_error if
+  // the file can't be written or read or has the wrong format.
+  void save(const std::string& fileName) const;
+  void load(const std::string& fileName, bool map);
+
+ private:
+  boost::string_ref stringAt(size_t i) const {
+    return boost::string_ref(_strings.data() + _stringOffsets[i],
+        _stringOffsets[i + 1] - _stringOffsets[i]);
+  }
+
+  // Compresses _pendingDescriptions into a new block.
+  void compressPending();
+
+  // The strings of entity i + 1 are _strings[_stringOffsets[j] ..
+  // _stringOffsets[j + 1] - 1] for _firstStrings[i] <= j <
+  // _firstStrings[i + 1]: the fields of EntityField, then the synonyms.
+  Column<char> _strings;
+  Column<uint64_t> _stringOffsets;
+  Column<uint32_t> _firstStrings;
+  Column<uint32_t> _scores;
+
+  // Block b of descriptions is _descriptionBlocks[_blockOffsets[b] ..
+  // _blockOffsets[b + 1] - 1]: its uncompressed size as a uint32_t, then
+  // the zlib stream of the uncompressed block. That is the offsets of its n
+  // descriptions as n + 1 uint32_t (relative to the first description), then
+  // the descriptions.
+  Column<char> _descriptionBlocks;
+  Column<uint64_t> _blockOffsets;
+
+  // The uncompressed block of the descriptions added since the last block
+  // was compressed, without its offsets.
+  std::string _pendingDescriptions;
+  std::vector<uint32_t> _pendingOffsets;
+
+  // The file the columns are mapped from, if any.
+  std::shared_ptr<const MappedFile> _file;
+};
+
+#endif  // ENTITYSTORE_H_
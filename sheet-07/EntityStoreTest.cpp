@@ -0,0 +1,98 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#include <gtest/gtest.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "./EntityStore.h"
+
+// Adds the entities with index begin to end - 1 of n entities, with fields
+// that depend on their index.
+void addEntities(EntityStore& store, size_t n, size_t begin, size_t end) {
+  for (size_t i = begin; i < end; i++) {
+    std::string name = "name" + std::to_string(i);
+    std::string description = std::string(i % 7, 'd') + std::to_string(i);
+    std::string url = "url" + std::to_string(i);
+    std::vector<std::string> synonymStrings(i % 3, "syn" + std::to_string(i));
+    std::vector<boost::string_ref> synonyms(synonymStrings.begin(),
+        synonymStrings.end());
+    store.add(name, n - i, description, url, "Q" + std::to_string(i),
+        synonyms, "");
+  }
+  store.finish();
+}
+
+// Adds all n entities.
+void addEntities(EntityStore& store, size_t n) { addEntities(store, n, 0, n); }
+
+// Checks the entities added by addEntities.
+void checkEntities(const EntityStore& store, size_t n) {
+  ASSERT_EQ(n, store.size());
+  for (uint32_t id = 1; id <= n; id++) {
+    size_t i = id - 1;
+    ASSERT_EQ("name" + std::to_string(i), store.name(id));
+    ASSERT_EQ(n - i, store.score(id));
+    ASSERT_EQ(std::string(i % 7, 'd') + std::to_string(i),
+              store.description(id));
+    ASSERT_EQ("url" + std::to_string(i),
+              store.field(id, ENTITY_WIKIPEDIA_URL));
+    ASSERT_EQ("Q" + std::to_string(i), store.field(id, ENTITY_WIKIDATA_ID));
+    ASSERT_EQ("", store.field(id, ENTITY_IMAGE_URL));
+    ASSERT_EQ(i % 3, store.numSynonyms(id));
+    for (size_t j = 0; j < store.numSynonyms(id); j++) {
+      ASSERT_EQ("syn" + std::to_string(i), store.synonym(id, j));
+    }
+  }
+}
+
+// _____________________________________________________________________________
+TEST(EntityStoreTest, add) {
+  EntityStore store;
+  ASSERT_EQ(0, store.size());
+  // Three blocks of descriptions, the last one not full.
+  addEntities(store, 2 * DESCRIPTION_BLOCK_SIZE + 5);
+  checkEntities(store, 2 * DESCRIPTION_BLOCK_SIZE + 5);
+
+  store.clear();
+  addEntities(store, 1);
+  checkEntities(store, 1);
+}
+
+// _____________________________________________________________________________
+TEST(EntityStoreTest, append) {
+  EntityStore store, part;
+  const size_t n = 2 * DESCRIPTION_BLOCK_SIZE + 5;
+  addEntities(store, n, 0, DESCRIPTION_BLOCK_SIZE);
+  addEntities(part, n, DESCRIPTION_BLOCK_SIZE, n);
+  store.append(part);
+  checkEntities(store, n);
+  ASSERT_THROW(store.append(part), std::logic_error);
+}
+
+// _____________________________________________________________________________
+TEST(EntityStoreTest, saveAndLoad) {
+  EntityStore store;
+  addEntities(store, DESCRIPTION_BLOCK_SIZE + 1);
+  store.save("EntityStoreTest.TMP.bin");
+  for (bool map : {true, false}) {
+    EntityStore loaded;
+    loaded.load("EntityStoreTest.TMP.bin", map);
+    checkEntities(loaded, DESCRIPTION_BLOCK_SIZE + 1);
+    ASSERT_EQ(store.sizeInBytes(), loaded.sizeInBytes());
+    // A copy of a mapped store still refers to the file.
+    EntityStore copy = loaded;
+    loaded.clear();
+    checkEntities(copy, DESCRIPTION_BLOCK_SIZE + 1);
+  }
+
+  {
+    std::ofstream out("EntityStoreTest.TMP.bin");
+    out << "no entity store";
+  }
+  EntityStore loaded;
+  ASSERT_THROW(loaded.load("EntityStoreTest.TMP.bin", true),
+               std::runtime_error);
+  ASSERT_THROW(loaded.load("EntityStoreTest.TMP.missing", true),
+               std::runtime_error);
+}
@@ -0,0 +1,281 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "./PerfCounters.h"
+#include "./QGramIndex.h"
+
+// The number of (query, string) pairs for the PED microbenchmark.
+const size_t NUM_PED_PAIRS = 1000000;
+
+// The number of strings for the q-gram microbenchmark.
+const size_t NUM_QGRAM_STRINGS = 200000;
+
+// The number of queries for the merge microbenchmark.
+const size_t NUM_MERGE_QUERIES = 500;
+
+// The percentiles in all reports, and their names.
+const size_t NUM_PERCENTILES = 4;
+const double PERCENTILES[NUM_PERCENTILES] = {0.5, 0.9, 0.99, 0.999};
+const char* const PERCENTILE_NAMES[NUM_PERCENTILES] = {
+  "p50", "p90", "p99", "p99.9"
+};
+
+// Returns the given percentile of the given values (sorted in place).
+double percentile(std::vector<double>& values, double p) {
+  std::sort(values.begin(), values.end());
+  return values[static_cast<size_t>(p * (values.size() - 1) + 0.5)];
+}
+
+// Prints the mean, the percentiles and the maximum of the given values.
+void printDistribution(const std::string& name, std::vector<double> values,
+    const std::string& unit) {
+  double sum = 0;
+  for (double value : values) { sum += value; }
+  std::cout << std::left << std::setw(12) << name << std::right << std::fixed
+            << std::setprecision(1) << " mean " << std::setw(9)
+            << sum / values.size();
+  for (size_t i = 0; i < NUM_PERCENTILES; i++) {
+    std::cout << "  " << std::left << std::setw(5) << PERCENTILE_NAMES[i]
+              << std::right << std::setw(9)
+              << percentile(values, PERCENTILES[i]);
+  }
+  std::cout << "  max " << std::setw(9) << values.back() << unit
+            << std::setprecision(6) << std::endl;
+}
+
+// Prints the time of one stage, per query and as a part of the total.
+void printStage(const std::string& name, double seconds, size_t numQueries,
+    double totalSeconds) {
+  std::cout << std::left << std::setw(12) << name << std::right << std::fixed
+            << std::setprecision(2) << std::setw(9)
+            << 1e6 * seconds / numQueries << "µs/query" << std::setw(7)
+            << std::setprecision(1) << 100 * seconds / totalSeconds << "%"
+            << std::setprecision(6) << std::endl;
+}
+
+// Reads the queries from the given file, one per line. With keystrokes, also
+// adds all (non-empty) prefixes of each query before it, as typed.
+std::vector<std::string> readQueries(const std::string& fileName,
+    bool keystrokes) {
+  std::ifstream file(fileName.c_str());
+  if (!file) {
+    std::cerr << "Could not read '" << fileName << "'" << std::endl;
+    exit(1);
+  }
+  std::vector<std::string> queries;
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty()) { continue; }
+    for (size_t i = 1; keystrokes && i < line.size(); i++) {
+      // Don't cut a UTF-8 sequence.
+      if ((line[i] & 0xC0) != 0x80) { queries.push_back(line.substr(0, i)); }
+    }
+    queries.push_back(line);
+  }
+  return queries;
+}
+
+// Replays a query log against a q-gram index: throughput, latency
+// percentiles, where the time goes (per stage of a query), the distributions
+// of the candidates and PED computations per query, and microbenchmarks of
+// the building blocks.
+int main(int argc, char** argv) {
+  // Parse the command line arguments.
+  if (argc < 3) {
+    std::cerr << "Usage: " << argv[0] << " <file> <query log>"
+              << " [--with-synonyms] [--snapshot <snapshot file>]"
+              << " [--keystrokes] [--top <k>]" << std::endl;
+    std::cerr << "The query log has one query per line. With --keystrokes, "
+              << "each query is replayed as typed: one query per prefix. "
+              << "With --top, the queries ask for the top k matches (as the "
+              << "search server does) instead of all of them." << std::endl;
+    exit(1);
+  }
+  std::string fileName = argv[1];
+  std::string queryFileName = argv[2];
+  bool withSynonyms = false;
+  std::string snapshotFileName;
+  bool keystrokes = false;
+  size_t k = 0;
+  for (int i = 3; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--with-synonyms") {
+      withSynonyms = true;
+    } else if (arg == "--snapshot" && i + 1 < argc) {
+      snapshotFileName = argv[++i];
+    } else if (arg == "--keystrokes") {
+      keystrokes = true;
+    } else if (arg == "--top" && i + 1 < argc) {
+      k = std::max(atoi(argv[++i]), 1);
+    }
+  }
+
+  // Build the index, or map it from the snapshot.
+  QGramIndex index(3, withSynonyms);
+  PerfRegions perf;
+  if (!snapshotFileName.empty() &&
+      std::ifstream(snapshotFileName.c_str()).good()) {
+    std::cout << "Mapping the q-gram index from '" << snapshotFileName
+              << "' ... " << std::flush;
+    PerfRegion region(perf, "load");
+    index.load(snapshotFileName, true);
+  } else {
+    std::cout << "Building the q-gram index from '" << fileName << "' ... "
+              << std::flush;
+    PerfRegion region(perf, "buildFromFile");
+    index.buildFromFile(fileName);
+  }
+  std::cout << "Done! " << index._entities.size() << " entities."
+            << std::endl;
+  std::vector<std::string> queries = readQueries(queryFileName, keystrokes);
+  if (queries.empty()) {
+    std::cerr << "No queries in '" << queryFileName << "'" << std::endl;
+    exit(1);
+  }
+  std::cout << "Replaying " << queries.size() << " queries"
+            << (keystrokes ? " (one per keystroke)" : "")
+            << (k > 0 ? ", top " + std::to_string(k) : std::string(", all"))
+            << " matches." << std::endl;
+
+  // Replay the queries once to warm up, once for the latencies and once with
+  // the stages timed (which reads the clock a few times per batch).
+  MatchBuffers buffers;
+  std::vector<Match> matches;
+  std::vector<double> latencies, candidates, pedComputations;
+  double totalSeconds = 0;
+  const char* passes[] = {"warmup", "replay", "replayStages"};
+  for (const char* pass : passes) {
+    buffers.times = StageTimes();
+    buffers.times.enabled = std::string(pass) == "replayStages";
+    latencies.clear();
+    candidates.clear();
+    pedComputations.clear();
+    PerfRegion region(perf, pass);
+    auto passStart = std::chrono::steady_clock::now();
+    for (const std::string& query : queries) {
+      auto start = std::chrono::steady_clock::now();
+      size_t numPedComputations;
+      if (k > 0) {
+        size_t numFound;
+        bool isExact;
+        numPedComputations = index.findTopMatches(query, k, false, buffers,
+            matches, numFound, isExact);
+      } else {
+        numPedComputations = index.findMatches(query, buffers, matches);
+      }
+      auto end = std::chrono::steady_clock::now();
+      latencies.push_back(
+          std::chrono::duration<double, std::micro>(end - start).count());
+
+      // What passed the count filter was either dropped by the string
+      // filters or verified (see FilterStats).
+      candidates.push_back(buffers.stats.numLength +
+          buffers.stats.numSignature + numPedComputations);
+      pedComputations.push_back(numPedComputations);
+    }
+    totalSeconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - passStart).count();
+    if (std::string(pass) != "replay") { continue; }
+
+    std::cout << "\n> Replay." << std::endl;
+    std::cout << "Throughput:  " << std::fixed << std::setprecision(0)
+              << queries.size() / totalSeconds << " queries/s"
+              << std::setprecision(6) << std::endl;
+    printDistribution("Latency:", latencies, "µs");
+    printDistribution("Candidates:", candidates, "");
+    printDistribution("PEDs:", pedComputations, "");
+  }
+
+  // The stages, and whatever is left (the completion table, the loop).
+  std::cout << "\n> Time per stage." << std::endl;
+  double stagesSeconds = 0;
+  for (size_t i = 0; i < NUM_QUERY_STAGES; i++) {
+    double seconds = buffers.times.seconds[i];
+    stagesSeconds += seconds;
+    printStage(QUERY_STAGE_NAMES[i], seconds, queries.size(), totalSeconds);
+  }
+  printStage("other", totalSeconds - stagesSeconds, queries.size(),
+      totalSeconds);
+
+  // Microbenchmarks: the building blocks on their own, on the normalized
+  // queries and the normalized strings of the index.
+  std::vector<std::string> normalized;
+  for (const std::string& query : queries) {
+    std::string nQuery = QGramIndex::normalize(query);
+    if (!nQuery.empty()) { normalized.push_back(nQuery); }
+  }
+  if (normalized.empty()) { return 0; }
+  size_t numStrings = index._stringEntities.size();
+  std::mt19937 gen(42);
+  std::cout << "\n> Microbenchmarks." << std::endl;
+
+  std::vector<std::string> xs, ys;
+  for (size_t i = 0; i < NUM_PED_PAIRS; i++) {
+    xs.push_back(normalized[gen() % normalized.size()]);
+    ys.push_back(index.normalizedString(1 + gen() % numStrings).to_string());
+  }
+  size_t checksum = 0;
+  {
+    PerfRegion region(perf, "prefixEditDistance");
+    for (size_t i = 0; i < NUM_PED_PAIRS; i++) {
+      checksum += QGramIndex::prefixEditDistance(xs[i], ys[i],
+          xs[i].size() / 4);
+    }
+  }
+  perf.report(std::cout, "prefixEditDistance",
+      perf.get("prefixEditDistance"));
+  std::cout << "Per call:   " << std::fixed << std::setprecision(1)
+            << 1e9 * perf.get("prefixEditDistance").total.seconds /
+               NUM_PED_PAIRS << "ns (checksum " << checksum << ")"
+            << std::setprecision(6) << std::endl;
+
+  size_t numQGramStrings = std::min(NUM_QGRAM_STRINGS, numStrings);
+  checksum = 0;
+  {
+    PerfRegion region(perf, "computeQGrams");
+    for (size_t i = 0; i < numQGramStrings; i++) {
+      checksum += index.computeQGrams(ys[i]).size();
+    }
+  }
+  perf.report(std::cout, "computeQGrams", perf.get("computeQGrams"));
+  std::cout << "Per call:   " << std::fixed << std::setprecision(1)
+            << 1e9 * perf.get("computeQGrams").total.seconds /
+               numQGramStrings << "ns (" << checksum << " q-grams)"
+            << std::setprecision(6) << std::endl;
+
+  std::vector<std::vector<InvertedList> > queryLists(
+      std::min(NUM_MERGE_QUERIES, normalized.size()));
+  for (size_t i = 0; i < queryLists.size(); i++) {
+    for (QGram qGram : index.computeQGrams(normalized[i])) {
+      queryLists[i].push_back(index.getInvertedList(qGram));
+    }
+  }
+  checksum = 0;
+  size_t numElements = 0;
+  {
+    PerfRegion region(perf, "mergeLists");
+    for (const std::vector<InvertedList>& lists : queryLists) {
+      checksum += QGramIndex::mergeLists(lists).size();
+      for (const InvertedList& list : lists) { numElements += list.size; }
+    }
+  }
+  perf.report(std::cout, "mergeLists", perf.get("mergeLists"));
+  std::cout << "Per call:   " << std::fixed << std::setprecision(1)
+            << 1e6 * perf.get("mergeLists").total.seconds / queryLists.size()
+            << "µs, per list element " << std::setprecision(2)
+            << 1e9 * perf.get("mergeLists").total.seconds / numElements
+            << "ns (" << checksum << " ids)" << std::setprecision(6)
+            << std::endl;
+
+  std::cout << "\n> Totals." << std::endl;
+  perf.report(std::cout);
+}
@@ -0,0 +1,266 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#include "./InvertedList.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// The number of bits of the given value (0 for 0).
+size_t bitWidth(uint32_t value) {
+  return value == 0 ? 0 : 32 - __builtin_clz(value);
+}
+
+// The number of bytes of the n - 1 gaps of a block, and of the whole block.
+size_t gapBytes(size_t n, size_t idBits) { return ((n - 1) * idBits + 7) / 8; }
+size_t blockBytes(size_t n, size_t idBits, size_t positionBits) {
+  return 3 + gapBytes(n, idBits) + (n * positionBits + 7) / 8;
+}
+
+// Writes the given value (of at most 32 bits) at the given bit offset of the
+// zeroed data, least significant bit first. Like unpack(), touches the 8
+// bytes from the byte of that offset on.
+void pack(uint8_t* data, size_t bit, uint32_t value) {
+  uint64_t word;
+  std::memcpy(&word, data + bit / 8, sizeof(word));
+  word |= static_cast<uint64_t>(value) << (bit % 8);
+  std::memcpy(data + bit / 8, &word, sizeof(word));
+}
+
+// Reads n values of W <= 32 bits from the start of the data. Each value is
+// one unaligned 64-bit load, so the data must be readable up to 8 bytes past
+// the last value. Eight values take exactly W bytes, so within a group of
+// eight all offsets and shifts are constants.
+template <size_t W, typename T>
+void unpackWidth(const uint8_t* data, size_t n, T* out) {
+  const uint64_t mask = (uint64_t(1) << W) - 1;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8, data += W) {
+    for (size_t j = 0; j < 8; j++) {
+      uint64_t word;
+      std::memcpy(&word, data + j * W / 8, sizeof(word));
+      out[i + j] = (word >> (j * W % 8)) & mask;
+    }
+  }
+  for (size_t j = 0; i < n; i++, j++) {
+    uint64_t word;
+    std::memcpy(&word, data + j * W / 8, sizeof(word));
+    out[i] = (word >> (j * W % 8)) & mask;
+  }
+}
+
+// The table of unpackWidth() for the widths 0 to W.
+template <typename T>
+using Unpacker = void (*)(const uint8_t*, size_t, T*);
+template <size_t W, typename T>
+struct UnpackerTable : UnpackerTable<W - 1, T> {
+  UnpackerTable() { this->table[W] = &unpackWidth<W, T>; }
+};
+template <typename T>
+struct UnpackerTable<0, T> {
+  UnpackerTable() { table[0] = &unpackWidth<0, T>; }
+  Unpacker<T> table[33];
+};
+
+// Reads n values of the given width from the start of the data, see
+// unpackWidth().
+void unpack(const uint8_t* data, size_t width, size_t n, uint32_t* out) {
+  static const UnpackerTable<32, uint32_t> unpackers;
+  unpackers.table[width](data, n, out);
+}
+void unpack(const uint8_t* data, size_t width, size_t n, uint8_t* out) {
+  static const UnpackerTable<8, uint8_t> unpackers;
+  unpackers.table[width](data, n, out);
+}
+}  // namespace
+
+// _____________________________________________________________________________
+void ListCursor::reset(const InvertedList& list) {
+  _list = list;
+  loadBlock(0);
+}
+
+// _____________________________________________________________________________
+void ListCursor::loadBlock(size_t block) {
+  _block = block;
+  _i = 0;
+  if (block >= _list.numBlocks()) {
+    _n = 0;
+    return;
+  }
+  const uint8_t* data = _list.data + _list.blockOffsets[block];
+  size_t numStored = data[0] + 1;
+  size_t idBits = data[1];
+  size_t positionBits = data[2];
+  // A slice may start and end within a block.
+  if (block == 0) { _i = _list.offset; }
+  _n = std::min(numStored,
+      _list.offset + _list.size - block * LIST_BLOCK_SIZE);
+
+  // Only the last blocks of the store are too close to the end of the data
+  // for unpack(); decode those from a padded copy.
+  uint8_t padded[3 + LIST_BLOCK_SIZE * 5 + 8];
+  size_t numBytes = blockBytes(numStored, idBits, positionBits);
+  if (_list.dataEnd - data < static_cast<ptrdiff_t>(numBytes + 8)) {
+    std::memset(padded, 0, sizeof(padded));
+    std::memcpy(padded, data, numBytes);
+    data = padded;
+  }
+
+  _ids[0] = _list.blockIds[block];
+  unpack(data + 3, idBits, _n - 1, _ids + 1);
+  for (size_t i = 1; i < _n; i++) { _ids[i] += _ids[i - 1]; }
+  unpack(data + 3 + gapBytes(numStored, idBits), positionBits, _n,
+      _positions);
+}
+
+// _____________________________________________________________________________
+void ListCursor::skipTo(uint32_t id) {
+  if (done() || _ids[_i] >= id) { return; }
+  if (_ids[_n - 1] < id) {
+    // Find the first block b after the current one with a first id >= id,
+    // by galloping. The first element >= id is in block b - 1 (unless that
+    // is the current one) or the first one of block b.
+    const uint32_t* firstIds = _list.blockIds;
+    size_t numBlocks = _list.numBlocks();
+    size_t b = _block + 1;
+    if (b < numBlocks && firstIds[b] < id) {
+      size_t step = 1;
+      while (b + step < numBlocks && firstIds[b + step] < id) {
+        b += step;
+        step *= 2;
+      }
+      size_t end = std::min(b + step, numBlocks);
+      b = std::lower_bound(firstIds + b + 1, firstIds + end, id) - firstIds;
+    }
+    loadBlock(b - 1 > _block ? b - 1 : b);
+    if (done()) { return; }
+  }
+  _i = std::lower_bound(_ids + _i, _ids + _n, id) - _ids;
+  if (_i == _n) { loadBlock(_block + 1); }
+}
+
+// _____________________________________________________________________________
+InvertedList sliceList(const InvertedList& list, uint32_t beginId,
+    uint32_t endId) {
+  ListCursor cursor;
+  cursor.reset(list);
+  cursor.skipTo(beginId);
+  size_t begin = cursor.index();
+  cursor.skipTo(endId);
+  size_t end = cursor.index();
+
+  InvertedList slice = list;
+  size_t first = list.offset + begin;
+  slice.blockOffsets += first / LIST_BLOCK_SIZE;
+  slice.blockIds += first / LIST_BLOCK_SIZE;
+  slice.offset = first % LIST_BLOCK_SIZE;
+  slice.size = end - begin;
+  return slice;
+}
+
+// _____________________________________________________________________________
+void InvertedListStore::clear() {
+  _listOffsets.assign(std::vector<uint32_t>(1, 0));
+  _listBlocks.assign(std::vector<uint32_t>(1, 0));
+  _blockIds.clear();
+  _blockOffsets.clear();
+  _data.clear();
+}
+
+// _____________________________________________________________________________
+void InvertedListStore::add(const uint32_t* ids, const uint8_t* positions,
+    size_t size) {
+  std::vector<uint8_t> block;
+  for (size_t start = 0; start < size; start += LIST_BLOCK_SIZE) {
+    size_t n = std::min(LIST_BLOCK_SIZE, size - start);
+    const uint32_t* blockIds = ids + start;
+    uint32_t maxGap = 0;
+    uint8_t allPositions = 0;
+    for (size_t i = 0; i < n; i++) {
+      if (i > 0) { maxGap = std::max(maxGap, blockIds[i] - blockIds[i - 1]); }
+      if (positions) { allPositions |= positions[start + i]; }
+    }
+    size_t idBits = bitWidth(maxGap);
+    size_t positionBits = bitWidth(allPositions);
+
+    size_t numBytes = blockBytes(n, idBits, positionBits);
+    block.assign(numBytes + 8, 0);
+    block[0] = n - 1;
+    block[1] = idBits;
+    block[2] = positionBits;
+    size_t bit = 24;
+    for (size_t i = 1; i < n; i++, bit += idBits) {
+      pack(block.data(), bit, blockIds[i] - blockIds[i - 1]);
+    }
+    bit = 8 * (3 + gapBytes(n, idBits));
+    for (size_t i = 0; positions && i < n; i++, bit += positionBits) {
+      pack(block.data(), bit, positions[start + i]);
+    }
+    _blockIds.push_back(blockIds[0]);
+    _blockOffsets.push_back(_data.size());
+    _data.append(block.data(), numBytes);
+  }
+  _listOffsets.push_back(_listOffsets.back() + size);
+  _listBlocks.push_back(_blockIds.size());
+}
+
+// _____________________________________________________________________________
+void InvertedListStore::append(const InvertedListStore& other) {
+  uint32_t elementBase = _listOffsets.back();
+  uint32_t blockBase = _listBlocks.back();
+  uint64_t dataBase = _data.size();
+  for (size_t i = 1; i < other._listOffsets.size(); i++) {
+    _listOffsets.push_back(elementBase + other._listOffsets[i]);
+    _listBlocks.push_back(blockBase + other._listBlocks[i]);
+  }
+  _blockIds.append(other._blockIds.data(), other._blockIds.size());
+  for (uint64_t offset : other._blockOffsets) {
+    _blockOffsets.push_back(dataBase + offset);
+  }
+  _data.append(other._data.data(), other._data.size());
+}
+
+// _____________________________________________________________________________
+InvertedList InvertedListStore::list(size_t listId) const {
+  InvertedList list;
+  list.data = _data.data();
+  list.dataEnd = _data.data() + _data.size();
+  list.blockOffsets = _blockOffsets.data() + _listBlocks[listId];
+  list.blockIds = _blockIds.data() + _listBlocks[listId];
+  list.size = _listOffsets[listId + 1] - _listOffsets[listId];
+  return list;
+}
+
+// _____________________________________________________________________________
+size_t InvertedListStore::sizeInBytes() const {
+  return _listOffsets.sizeInBytes() + _listBlocks.sizeInBytes() +
+      _blockIds.sizeInBytes() + _blockOffsets.sizeInBytes() +
+      _data.sizeInBytes();
+}
+
+// _____________________________________________________________________________
+void InvertedListStore::write(std::ostream& out) const {
+  writeColumn(out, _listOffsets);
+  writeColumn(out, _listBlocks);
+  writeColumn(out, _blockIds);
+  writeColumn(out, _blockOffsets);
+  writeColumn(out, _data);
+}
+
+// _____________________________________________________________________________
+void InvertedListStore::read(const char*& pos, const char* end, bool map) {
+  readColumn(pos, end, map, _listOffsets);
+  readColumn(pos, end, map, _listBlocks);
+  readColumn(pos, end, map, _blockIds);
+  readColumn(pos, end, map, _blockOffsets);
+  readColumn(pos, end, map, _data);
+  if (_listOffsets.empty() || _listBlocks.size() != _listOffsets.size() ||
+      _listBlocks.back() != _blockIds.size() ||
+      _blockOffsets.size() != _blockIds.size()) {
+    throw std::runtime_error("inconsistent inverted lists");
+  }
+}
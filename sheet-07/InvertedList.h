@@ -0,0 +1,182 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#ifndef INVERTEDLIST_H_
+#define INVERTEDLIST_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ostream>
+#include <vector>
+#include "./Column.h"
+
+// The number of elements per block of a compressed inverted list.
+const size_t LIST_BLOCK_SIZE = 128;
+
+// A view on one compressed inverted list of an InvertedListStore: sorted,
+// 1-based string ids (see QGramIndex::stringId()), each with the position of
+// the q-gram in the name or synonym it comes from (capped at 255).
+//
+// The list is cut into blocks of LIST_BLOCK_SIZE elements (the last one may
+// be shorter). The first id of block b is blockIds[b], so that a search can
+// skip whole blocks. The block itself starts at data[blockOffsets[b]] with
+// three bytes, the number of elements minus 1 and the number of bits per id
+// gap and per position, followed by the gaps between consecutive ids of the
+// block and then, from the next full byte on, all its positions, bit-packed
+// with those widths.
+//
+// A view may also be a slice of a stored list (see sliceList()): it starts
+// with element 'offset' of its first block and has 'size' elements.
+struct InvertedList {
+  InvertedList() : data(nullptr), dataEnd(nullptr), blockOffsets(nullptr),
+      blockIds(nullptr), offset(0), size(0), minPosition(0),
+      maxPosition(UINT8_MAX) {}
+
+  // The number of blocks.
+  size_t numBlocks() const {
+    return size == 0 ? 0 :
+        (offset + size + LIST_BLOCK_SIZE - 1) / LIST_BLOCK_SIZE;
+  }
+
+  // Returns true if the given position is in the window.
+  bool inWindow(uint8_t position) const {
+    return static_cast<uint8_t>(position - minPosition) <=
+        maxPosition - minPosition;
+  }
+
+  // The data of all lists of the store, and the blocks of this one.
+  const uint8_t* data;
+  const uint8_t* dataEnd;
+  const uint64_t* blockOffsets;
+  const uint32_t* blockIds;
+
+  // The number of elements of the first block before the list, and the
+  // number of elements of the list.
+  size_t offset;
+  size_t size;
+
+  // The position window: CountFilter only counts the elements with a
+  // position from minPosition to maxPosition.
+  uint8_t minPosition;
+  uint8_t maxPosition;
+};
+
+// Reads an InvertedList from front to back, decoding one block at a time, and
+// skips blocks by their first ids. Keeps its memory across lists.
+class ListCursor {
+ public:
+  ListCursor() : _block(0), _i(0), _n(0) {}
+
+  // Moves to the first element of the given list.
+  void reset(const InvertedList& list);
+
+  // The list being read.
+  const InvertedList& list() const { return _list; }
+
+  // Returns true if the cursor is past the last element.
+  bool done() const { return _i >= _n; }
+
+  // The id and the position of the current element.
+  uint32_t id() const { return _ids[_i]; }
+  uint8_t position() const { return _positions[_i]; }
+
+  // Returns true if the position of the current element is in the window.
+  bool inWindow() const { return _list.inWindow(_positions[_i]); }
+
+  // Moves to the next element.
+  void next() {
+    if (++_i == _n) { loadBlock(_block + 1); }
+  }
+
+  // The decoded ids and positions of the current block, the index of the
+  // current element in them, and their number. For hot loops that read a
+  // block at a time and then seek() to the element they stopped at.
+  const uint32_t* blockIds() const { return _ids; }
+  const uint8_t* blockPositions() const { return _positions; }
+  size_t blockIndex() const { return _i; }
+  size_t blockSize() const { return _n; }
+
+  // Moves to element i <= blockSize() of the current block, where
+  // blockSize() is the first element of the next block.
+  void seek(size_t i) {
+    _i = i;
+    if (_i == _n) { loadBlock(_block + 1); }
+  }
+
+  // Moves to the first element >= id, from the current one on. Gallops over
+  // the first ids of the blocks and decodes only the block it stops in.
+  void skipTo(uint32_t id);
+
+  // Moves past the last element.
+  void finish() { loadBlock(_list.numBlocks()); }
+
+  // The number of elements before the current one (the size when done).
+  size_t index() const {
+    return done() ? _list.size : _block * LIST_BLOCK_SIZE + _i - _list.offset;
+  }
+
+ private:
+  // Decodes the given block, or moves past the end if there is none.
+  void loadBlock(size_t block);
+
+  InvertedList _list;
+  size_t _block;
+  size_t _i;
+  size_t _n;
+  uint32_t _ids[LIST_BLOCK_SIZE];
+  uint8_t _positions[LIST_BLOCK_SIZE];
+};
+
+// Returns the part of the given list with the ids from beginId to endId - 1,
+// with the same position window. Decodes at most two blocks.
+InvertedList sliceList(const InvertedList& list, uint32_t beginId,
+    uint32_t endId);
+
+// A sequence of compressed inverted lists (see InvertedList), with 0-based
+// list ids in the order of add(). Either owns its columns or maps them, like
+// EntityStore.
+class InvertedListStore {
+ public:
+  InvertedListStore() { clear(); }
+
+  // Removes all lists.
+  void clear();
+
+  // Appends a list with the given sorted ids and their positions (all 0 if
+  // positions is nullptr).
+  void add(const uint32_t* ids, const uint8_t* positions, size_t size);
+
+  // Appends the lists of the given store.
+  void append(const InvertedListStore& other);
+
+  // The number of lists.
+  size_t size() const { return _listOffsets.size() - 1; }
+
+  // The number of elements of all lists.
+  size_t numElements() const { return _listOffsets.back(); }
+
+  // Returns the list with the given id.
+  InvertedList list(size_t listId) const;
+
+  // The memory used by the columns in bytes (also when they are mapped).
+  size_t sizeInBytes() const;
+
+  // Writes the store to the given stream, or reads one written like that
+  // from the memory at 'pos' and moves pos past it. See readColumn() for
+  // 'end' and 'map'; the caller keeps mapped memory alive.
+  void write(std::ostream& out) const;
+  void read(const char*& pos, const char* end, bool map);
+
+ private:
+  // List i has the elements _listOffsets[i] to _listOffsets[i + 1] - 1 of all
+  // lists, and the blocks _listBlocks[i] to _listBlocks[i + 1] - 1.
+  Column<uint32_t> _listOffsets;
+  Column<uint32_t> _listBlocks;
+
+  // The first id and the offset in _data of each block.
+  Column<uint32_t> _blockIds;
+  Column<uint64_t> _blockOffsets;
+  Column<uint8_t> _data;
+};
+
+#endif  // INVERTEDLIST_H_
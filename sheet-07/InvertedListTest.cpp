@@ -0,0 +1,198 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "./InvertedList.h"
+
+// Random sorted ids with duplicates and gaps of very different sizes, and
+// random positions.
+void randomList(std::mt19937& gen, size_t length, std::vector<uint32_t>& ids,
+    std::vector<uint8_t>& positions) {
+  ids.clear();
+  positions.clear();
+  uint32_t id = 1 + gen() % 1000;
+  for (size_t i = 0; i < length; i++) {
+    ids.push_back(id);
+    positions.push_back(gen() % 3 == 0 ? gen() % 256 : gen() % 8);
+    // Gaps of up to an eighth of the ids left (up to 29 bits), 0 or 1, or
+    // up to 300, but never past the largest id.
+    size_t kind = gen() % 10;
+    uint32_t gap = kind == 0 ? gen() % ((UINT32_MAX - id) / 8 + 1) :
+        kind < 4 ? gen() % 2 : gen() % 300;
+    id += std::min(gap, UINT32_MAX - id);
+  }
+}
+
+// Checks that the given list has the given ids and positions, reading it
+// element by element.
+void checkList(const InvertedList& list, const std::vector<uint32_t>& ids,
+    const std::vector<uint8_t>& positions) {
+  ASSERT_EQ(ids.size(), list.size);
+  ListCursor cursor;
+  cursor.reset(list);
+  for (size_t i = 0; i < ids.size(); i++, cursor.next()) {
+    ASSERT_FALSE(cursor.done());
+    ASSERT_EQ(i, cursor.index());
+    ASSERT_EQ(ids[i], cursor.id());
+    ASSERT_EQ(positions[i], cursor.position());
+  }
+  ASSERT_TRUE(cursor.done());
+  ASSERT_EQ(ids.size(), cursor.index());
+}
+
+// _____________________________________________________________________________
+TEST(InvertedListTest, add) {
+  std::mt19937 gen(7);
+  InvertedListStore store;
+  std::vector<std::vector<uint32_t> > ids(30);
+  std::vector<std::vector<uint8_t> > positions(30);
+  for (size_t i = 0; i < ids.size(); i++) {
+    size_t length = i < 3 ? i : gen() % (5 * LIST_BLOCK_SIZE);
+    if (i == 3) length = LIST_BLOCK_SIZE;
+    randomList(gen, length, ids[i], positions[i]);
+    store.add(ids[i].data(), positions[i].data(), length);
+  }
+  ASSERT_EQ(ids.size(), store.size());
+  size_t numElements = 0;
+  for (size_t i = 0; i < ids.size(); i++) {
+    checkList(store.list(i), ids[i], positions[i]);
+    numElements += ids[i].size();
+  }
+  ASSERT_EQ(numElements, store.numElements());
+
+  // Without positions, all of them are 0.
+  store.clear();
+  store.add(ids[10].data(), nullptr, ids[10].size());
+  checkList(store.list(0), ids[10],
+      std::vector<uint8_t>(ids[10].size(), 0));
+}
+
+// _____________________________________________________________________________
+TEST(InvertedListTest, skipTo) {
+  std::mt19937 gen(11);
+  std::vector<uint32_t> ids;
+  std::vector<uint8_t> positions;
+  for (size_t round = 0; round < 50; round++) {
+    randomList(gen, gen() % (20 * LIST_BLOCK_SIZE), ids, positions);
+    InvertedListStore store;
+    store.add(ids.data(), positions.data(), ids.size());
+    ListCursor cursor;
+    cursor.reset(store.list(0));
+    uint32_t target = 0;
+    while (!cursor.done()) {
+      // Skip to an id in the list, between two, or far ahead.
+      size_t i = cursor.index();
+      target = gen() % 4 == 0 ? cursor.id() + gen() % 1000 :
+          ids[std::min(ids.size() - 1, i + gen() % (3 * LIST_BLOCK_SIZE))];
+      cursor.skipTo(target);
+      size_t expected = std::max<size_t>(i,
+          std::lower_bound(ids.begin(), ids.end(), target) - ids.begin());
+      ASSERT_EQ(expected, cursor.index());
+      if (expected < ids.size()) {
+        ASSERT_EQ(ids[expected], cursor.id());
+        ASSERT_EQ(positions[expected], cursor.position());
+        if (gen() % 2 == 0) cursor.next();
+      }
+    }
+    cursor.finish();
+    ASSERT_TRUE(cursor.done());
+  }
+}
+
+// _____________________________________________________________________________
+TEST(InvertedListTest, sliceList) {
+  std::mt19937 gen(17);
+  std::vector<uint32_t> ids;
+  std::vector<uint8_t> positions;
+  for (size_t round = 0; round < 50; round++) {
+    randomList(gen, gen() % (6 * LIST_BLOCK_SIZE), ids, positions);
+    InvertedListStore store;
+    store.add(ids.data(), positions.data(), ids.size());
+    InvertedList list = store.list(0);
+    list.minPosition = 3;
+    for (size_t j = 0; j < 2; j++) {
+      // Slices between random ids of the list (or beyond it), and slices of
+      // those.
+      uint32_t beginId = ids.empty() || gen() % 5 == 0 ? 0 :
+          ids[gen() % ids.size()];
+      uint32_t endId = ids.empty() || gen() % 5 == 0 ? UINT32_MAX :
+          ids[gen() % ids.size()] + gen() % 2;
+      if (endId < beginId) std::swap(beginId, endId);
+      size_t begin = std::lower_bound(ids.begin(), ids.end(), beginId) -
+          ids.begin();
+      size_t end = std::max(begin, static_cast<size_t>(
+          std::lower_bound(ids.begin(), ids.end(), endId) - ids.begin()));
+      ids = std::vector<uint32_t>(ids.begin() + begin, ids.begin() + end);
+      positions = std::vector<uint8_t>(positions.begin() + begin,
+          positions.begin() + end);
+      list = sliceList(list, beginId, endId);
+      ASSERT_EQ(3, list.minPosition);
+      checkList(list, ids, positions);
+      if (!ids.empty()) {
+        ListCursor cursor;
+        cursor.reset(list);
+        cursor.skipTo(ids.back());
+        ASSERT_EQ(ids.back(), cursor.id());
+      }
+    }
+  }
+}
+
+// _____________________________________________________________________________
+TEST(InvertedListTest, inWindow) {
+  std::vector<uint32_t> ids = {1, 2, 3};
+  std::vector<uint8_t> positions = {0, 4, 9};
+  InvertedListStore store;
+  store.add(ids.data(), positions.data(), ids.size());
+  InvertedList list = store.list(0);
+  list.minPosition = 2;
+  list.maxPosition = 6;
+  ASSERT_FALSE(list.inWindow(1));
+  ASSERT_TRUE(list.inWindow(2));
+  ASSERT_TRUE(list.inWindow(6));
+  ASSERT_FALSE(list.inWindow(7));
+  ListCursor cursor;
+  cursor.reset(list);
+  ASSERT_FALSE(cursor.inWindow());
+  cursor.next();
+  ASSERT_TRUE(cursor.inWindow());
+  cursor.next();
+  ASSERT_FALSE(cursor.inWindow());
+}
+
+// _____________________________________________________________________________
+TEST(InvertedListTest, appendWriteAndRead) {
+  std::mt19937 gen(13);
+  std::vector<std::vector<uint32_t> > ids(6);
+  std::vector<std::vector<uint8_t> > positions(6);
+  InvertedListStore store, part;
+  for (size_t i = 0; i < ids.size(); i++) {
+    randomList(gen, gen() % (3 * LIST_BLOCK_SIZE), ids[i], positions[i]);
+    (i < 3 ? store : part).add(ids[i].data(), positions[i].data(),
+        ids[i].size());
+  }
+  store.append(part);
+  ASSERT_EQ(ids.size(), store.size());
+  for (size_t i = 0; i < ids.size(); i++) {
+    checkList(store.list(i), ids[i], positions[i]);
+  }
+
+  std::ostringstream out;
+  store.write(out);
+  std::string data = out.str();
+  for (bool map : {true, false}) {
+    InvertedListStore loaded;
+    const char* pos = data.data();
+    loaded.read(pos, data.data() + data.size(), map);
+    ASSERT_EQ(data.data() + data.size(), pos);
+    ASSERT_EQ(store.sizeInBytes(), loaded.sizeInBytes());
+    for (size_t i = 0; i < ids.size(); i++) {
+      checkList(loaded.list(i), ids[i], positions[i]);
+    }
+  }
+}
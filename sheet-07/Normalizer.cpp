@@ -0,0 +1,241 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#include "./Normalizer.h"
+#include <string.h>
+#include <array>
+#include <string>
+#include <vector>
+
+namespace {
+
+// The fold of a code point: a character of the normalized form (see
+// Normalizer.h), or one of these two.
+const uint8_t SEPARATOR = 0;
+const uint8_t IGNORED = 1;
+
+// The folds below are single expressions, so that they are constexpr in
+// C++11 and the table is generated at compile time.
+
+// Digits and letters; everything else in ASCII separates words.
+constexpr uint8_t foldAscii(uint32_t c) {
+  return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' :
+      (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ? c : SEPARATOR;
+}
+
+// À to ÿ (but × and ÷) as 0x80 + the offset of the lower case letter from à,
+// and ß in the place of ÷. The soft hyphen doesn't separate words.
+constexpr uint8_t foldLatin1(uint32_t c) {
+  return c == 0xDF ? 0x97 : c == 0xAD ? IGNORED :
+      c < 0xC0 || c == 0xD7 || c == 0xF7 ? SEPARATOR :
+      c < 0xDF ? 0x80 + c + 0x20 - 0xE0 : 0x80 + c - 0xE0;
+}
+
+// Latin Extended-A comes in (upper, lower) pairs, except in U+0139 to U+0148
+// and from U+0179 on, where the pairs start one later. Pair p is 0xA0 + p.
+// ı has a pair of its own, İ is i, and ĸ, ŉ, Ÿ and ſ are k, n, ÿ and s.
+constexpr uint8_t foldLatinExtendedA(uint32_t c) {
+  return c == 0x130 ? 'i' : c == 0x138 ? 'k' : c == 0x149 ? 'n' :
+      c == 0x178 ? 0x9F : c == 0x17F ? 's' :
+      (c >= 0x139 && c <= 0x148) || c >= 0x179 ? 0xA0 + (c - 0x101) / 2 :
+      0xA0 + (c - 0x100) / 2;
+}
+
+// А to я as 0xDF + the offset from а (so that 0xFF is never used, see
+// NO_QGRAM); ё and є are е, і and ї are i, ј is j and ў is у.
+constexpr uint8_t foldCyrillic(uint32_t c) {
+  return c >= 0x410 && c < 0x430 ? 0xDF + c - 0x410 :
+      c >= 0x430 && c < 0x450 ? 0xDF + c - 0x430 :
+      c == 0x401 || c == 0x451 || c == 0x404 || c == 0x454 ? 0xE4 :
+      c == 0x406 || c == 0x456 || c == 0x407 || c == 0x457 ? 'i' :
+      c == 0x408 || c == 0x458 ? 'j' :
+      c == 0x40E || c == 0x45E ? 0xF2 : IGNORED;
+}
+
+// The code points U+0000 to U+07FF, which take up to two bytes in UTF-8. The
+// Romanian ș and ț are ş and ţ. Letters that have no byte, and combining
+// marks, are dropped without separating words.
+constexpr uint8_t foldCodePoint(uint32_t c) {
+  return c < 0x80 ? foldAscii(c) : c < 0x100 ? foldLatin1(c) :
+      c < 0x180 ? foldLatinExtendedA(c) :
+      c == 0x218 || c == 0x219 ? foldLatinExtendedA(0x15F) :
+      c == 0x21A || c == 0x21B ? foldLatinExtendedA(0x163) :
+      c >= 0x400 && c < 0x460 ? foldCyrillic(c) : IGNORED;
+}
+
+// The longer code points are letters of other scripts (dropped), except for
+// punctuation and spaces.
+uint8_t foldWideCodePoint(uint32_t c) {
+  return (c >= 0x2000 && c < 0x2070) || (c >= 0x3000 && c < 0x3040) ||
+      (c >= 0xFF00 && c < 0xFF10) ? SEPARATOR : IGNORED;
+}
+
+// A list of indices 0, ..., N - 1 at compile time, in O(log N) template
+// recursion depth (C++11 lacks std::make_index_sequence).
+template <size_t... I> struct Indices { typedef Indices type; };
+
+template <typename A, typename B> struct ConcatIndices;
+template <size_t... I, size_t... J>
+struct ConcatIndices<Indices<I...>, Indices<J...> >
+    : Indices<I..., sizeof...(I) + J...> {};
+
+template <size_t N> struct MakeIndices
+    : ConcatIndices<typename MakeIndices<N / 2>::type,
+                    typename MakeIndices<N - N / 2>::type> {};
+template <> struct MakeIndices<0> : Indices<> {};
+template <> struct MakeIndices<1> : Indices<0> {};
+
+const size_t NUM_TABLE_CODE_POINTS = 0x800;
+
+template <size_t... I>
+constexpr std::array<uint8_t, sizeof...(I)> makeFoldTable(Indices<I...>) {
+  return {{foldCodePoint(I)...}};
+}
+
+// The fold of every code point below 0x800, 2 KB.
+constexpr std::array<uint8_t, NUM_TABLE_CODE_POINTS> FOLDS =
+    makeFoldTable(MakeIndices<NUM_TABLE_CODE_POINTS>::type());
+
+static_assert(FOLDS['B'] == 'b' && FOLDS[0xF6] == 0x96 &&
+    FOLDS[0xD6] == 0x96 && FOLDS[0x141] == FOLDS[0x142] &&
+    FOLDS[0x42F] == 0xFE && FOLDS[0x435] == 0xE4 &&
+    FOLDS[0x443] == 0xF2, "wrong fold table");
+
+// Decodes the character at text[i], advances i past it and returns its fold.
+inline uint8_t nextFold(const unsigned char* text, size_t size, size_t& i) {
+  unsigned char c = text[i];
+  if (c < 0x80) {
+    i++;
+    return FOLDS[c];
+  }
+  if (c >= 0xC2 && c < 0xE0 && i + 1 < size && (text[i + 1] & 0xC0) == 0x80) {
+    uint32_t codePoint = ((c & 0x1F) << 6) | (text[i + 1] & 0x3F);
+    i += 2;
+    return FOLDS[codePoint];
+  }
+  size_t length = c >= 0xE0 && c < 0xF0 ? 3 : c >= 0xF0 && c < 0xF5 ? 4 : 0;
+  if (length == 0 || i + length > size) {
+    i++;
+    return SEPARATOR;
+  }
+  uint32_t codePoint = c & (length == 3 ? 0x0F : 0x07);
+  for (size_t j = 1; j < length; j++) {
+    if ((text[i + j] & 0xC0) != 0x80) {
+      i++;
+      return SEPARATOR;
+    }
+    codePoint = (codePoint << 6) | (text[i + j] & 0x3F);
+  }
+  i += length;
+  return codePoint < NUM_TABLE_CODE_POINTS ? SEPARATOR :
+      foldWideCodePoint(codePoint);
+}
+
+typedef uint8_t Bytes16 __attribute__((vector_size(16)));
+
+// Returns true if the 16 bytes at the given position are all ASCII.
+inline bool isAscii16(const unsigned char* text) {
+  uint64_t words[2];
+  memcpy(words, text, 16);
+  return ((words[0] | words[1]) & 0x8080808080808080ull) == 0;
+}
+
+// Normalizes 16 bytes of ASCII to 'out' (which needs room for 16) and
+// returns the number of bytes written: lower cases all 16 at once, then
+// writes them all if they are letters and digits, and otherwise only those.
+inline size_t normalizeAscii16(const unsigned char* text, char* out) {
+  Bytes16 v;
+  memcpy(&v, text, 16);
+  Bytes16 isUpper = (Bytes16)(v - 'A' < 26);
+  Bytes16 lower = v | (isUpper & 0x20);
+  Bytes16 keep = (Bytes16)(lower - 'a' < 26) | (Bytes16)(v - '0' < 10);
+  uint64_t words[2];
+  memcpy(words, &keep, 16);
+  if ((words[0] & words[1]) == ~0ull) {
+    memcpy(out, &lower, 16);
+    return 16;
+  }
+  unsigned char bytes[16], keeps[16];
+  memcpy(bytes, &lower, 16);
+  memcpy(keeps, &keep, 16);
+  size_t n = 0;
+  for (size_t i = 0; i < 16; i++) {
+    out[n] = bytes[i];
+    n += keeps[i] & 1;
+  }
+  return n;
+}
+}  // namespace
+
+// _____________________________________________________________________________
+void appendNormalized(const char* text, size_t size, std::string& out) {
+  const unsigned char* s = reinterpret_cast<const unsigned char*>(text);
+  // The normalized form is at most as long as the text, the 16 are the room
+  // for normalizeAscii16.
+  size_t n = out.size();
+  out.resize(n + size + 16);
+  char* o = &out[0];
+  size_t i = 0;
+  while (i < size) {
+    if (i + 16 <= size && isAscii16(s + i)) {
+      n += normalizeAscii16(s + i, o + n);
+      i += 16;
+      continue;
+    }
+    uint8_t fold = nextFold(s, size, i);
+    o[n] = fold;
+    n += fold > IGNORED;
+  }
+  out.resize(n);
+}
+
+// _____________________________________________________________________________
+std::string normalizeUtf8(const std::string& text) {
+  std::string normalized;
+  appendNormalized(text.data(), text.size(), normalized);
+  return normalized;
+}
+
+// _____________________________________________________________________________
+void tokenizeUtf8(const char* text, size_t size,
+    std::vector<std::string>& words) {
+  const unsigned char* s = reinterpret_cast<const unsigned char*>(text);
+  std::string word;
+  size_t i = 0;
+  while (i < size) {
+    uint8_t fold = nextFold(s, size, i);
+    if (fold > IGNORED) {
+      word += fold;
+    } else if (fold == SEPARATOR && !word.empty()) {
+      words.push_back(word);
+      word.clear();
+    }
+  }
+  if (!word.empty()) { words.push_back(word); }
+}
+
+// _____________________________________________________________________________
+uint32_t normalizedCodePoint(unsigned char c) {
+  if (c < 0x80) { return c; }
+  if (c < 0xA0) { return c == 0x97 ? 0xDF : 0xE0 + c - 0x80; }
+  if (c >= 0xDF) { return 0x430 + c - 0xDF; }
+  // The lower case letter of pair p of Latin Extended-A, see above.
+  uint32_t p = c - 0xA0;
+  bool isLater = (p >= 0x1C && p < 0x24) || p >= 0x3C;
+  return 0x101 + 2 * p + isLater;
+}
+
+// _____________________________________________________________________________
+std::string normalizedToUtf8(const std::string& normalized) {
+  std::string text;
+  for (unsigned char c : normalized) {
+    uint32_t codePoint = normalizedCodePoint(c);
+    if (codePoint < 0x80) {
+      text += static_cast<char>(codePoint);
+    } else {
+      text += static_cast<char>(0xC0 | (codePoint >> 6));
+      text += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+  }
+  return text;
+}
@@ -0,0 +1,40 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#ifndef NORMALIZER_H_
+#define NORMALIZER_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// The normalized form of a UTF-8 text is its letters and digits, case
+// folded, one byte per character: ASCII digits and letters as themselves, and
+// the other letters of Latin-1, Latin Extended-A and basic Cyrillic as the
+// bytes 0x80 to 0xFE (see normalizedCodePoint). So every character of the
+// normalized form is one code point, and edit distances and q-grams on its
+// bytes are on code points. Other letters (Greek, CJK, ...) and combining
+// marks are dropped; everything else separates words. Bytes that aren't
+// valid UTF-8 are separators.
+
+// Appends the normalized form of the given UTF-8 text to 'out'. Runs of
+// ASCII take a vectorized path.
+void appendNormalized(const char* text, size_t size, std::string& out);
+
+// Returns the normalized form of the given UTF-8 text.
+std::string normalizeUtf8(const std::string& text);
+
+// Appends the normalized form of each word of the given UTF-8 text to
+// 'words'. A word is a maximal run of characters that aren't separators, so
+// "Björn-Ole's" is "björn", "ole" and "s". Words without letters or digits are
+// skipped.
+void tokenizeUtf8(const char* text, size_t size,
+    std::vector<std::string>& words);
+
+// Returns the code point of the given character of a normalized form.
+uint32_t normalizedCodePoint(unsigned char c);
+
+// Returns the given normalized form as UTF-8, e.g. for output.
+std::string normalizedToUtf8(const std::string& normalized);
+
+#endif  // NORMALIZER_H_
@@ -0,0 +1,96 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+#include "./Normalizer.h"
+
+// Returns the UTF-8 encoding of the given code point (< 0x10000).
+std::string encode(uint32_t codePoint) {
+  std::string text;
+  if (codePoint < 0x80) {
+    text += static_cast<char>(codePoint);
+  } else if (codePoint < 0x800) {
+    text += static_cast<char>(0xC0 | (codePoint >> 6));
+    text += static_cast<char>(0x80 | (codePoint & 0x3F));
+  } else {
+    text += static_cast<char>(0xE0 | (codePoint >> 12));
+    text += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+    text += static_cast<char>(0x80 | (codePoint & 0x3F));
+  }
+  return text;
+}
+
+// _____________________________________________________________________________
+TEST(NormalizerTest, normalizeUtf8) {
+  ASSERT_EQ("freiburg", normalizeUtf8("Frei, burg !!"));
+  ASSERT_EQ("", normalizeUtf8(""));
+  ASSERT_EQ("björn", normalizedToUtf8(normalizeUtf8("BJÖRN")));
+  ASSERT_EQ("łódźstraße", normalizedToUtf8(normalizeUtf8("Łódź-Straße")));
+  ASSERT_EQ("şţ", normalizedToUtf8(normalizeUtf8("Șț")));
+  ASSERT_EQ("москва", normalizedToUtf8(normalizeUtf8("Москва")));
+  ASSERT_EQ("елка", normalizedToUtf8(normalizeUtf8("Ёлка")));
+  // Greek is dropped, so are combining marks and invalid bytes.
+  ASSERT_EQ("ab", normalizeUtf8("a\xce\xb1\xcc\x88 \xff\xc3(b"));
+  // A sequence cut off at the end.
+  ASSERT_EQ("a", normalizeUtf8("a\xe2\x82"));
+}
+
+// _____________________________________________________________________________
+TEST(NormalizerTest, asciiFastPath) {
+  // Long enough for the vectorized path, with and without non-ASCII parts,
+  // and the same as one character at a time.
+  std::mt19937 gen(3);
+  const std::string alphabet = "aZ09 -.\x7f\xc3\xb6\xc3\x96\xd0\x96";
+  for (size_t i = 0; i < 1000; i++) {
+    std::string text, expected;
+    size_t length = gen() % 80;
+    for (size_t j = 0; j < length; j++) {
+      text += alphabet[gen() % alphabet.size()];
+    }
+    for (size_t j = 0; j < text.size(); j++) {
+      expected += normalizeUtf8(text.substr(j, 1));
+    }
+    // Only the multi-byte characters get lost one byte at a time.
+    std::string valid;
+    for (char c : normalizeUtf8(text)) {
+      if (static_cast<unsigned char>(c) < 0x80) { valid += c; }
+    }
+    ASSERT_EQ(expected, valid) << text;
+  }
+  ASSERT_EQ("abcdefghijklmnopqrstuvwxyz0123456789",
+      normalizeUtf8("ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"));
+}
+
+// _____________________________________________________________________________
+TEST(NormalizerTest, tokenizeUtf8) {
+  std::vector<std::string> words;
+  std::string text = "Björn-Ole's  Ма\xcc\x81ша,\xe2\x80\x94x!";
+  tokenizeUtf8(text.data(), text.size(), words);
+  ASSERT_EQ(5, words.size());
+  ASSERT_EQ("björn", normalizedToUtf8(words[0]));
+  ASSERT_EQ("ole", words[1]);
+  ASSERT_EQ("s", words[2]);
+  ASSERT_EQ("маша", normalizedToUtf8(words[3]));
+  ASSERT_EQ("x", words[4]);
+}
+
+// _____________________________________________________________________________
+TEST(NormalizerTest, normalizedCodePoint) {
+  // Every character of a normalized form stands for the code point it came
+  // from (lower case), and none is 0xFF.
+  for (uint32_t codePoint = 1; codePoint < 0x800; codePoint++) {
+    std::string normalized = normalizeUtf8(encode(codePoint));
+    if (normalized.empty()) { continue; }
+    ASSERT_EQ(1, normalized.size());
+    unsigned char c = normalized[0];
+    ASSERT_NE(0xFF, c);
+    ASSERT_EQ(normalized, normalizeUtf8(encode(normalizedCodePoint(c))))
+        << codePoint;
+  }
+  ASSERT_EQ(0xDF, normalizedCodePoint(normalizeUtf8("ß")[0]));
+  ASSERT_EQ(0x17E, normalizedCodePoint(normalizeUtf8("Ž")[0]));
+  ASSERT_EQ(0x44F, normalizedCodePoint(normalizeUtf8("Я")[0]));
+}
@@ -0,0 +1,114 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#include "./ParallelSearch.h"
+#include <string>
+#include <vector>
+
+// _____________________________________________________________________________
+void ParallelSearch::resize() {
+  size_t numShards = _index->numShards();
+  _buffers.resize(numShards);
+  _matches.resize(numShards);
+  _numPedComputations.assign(numShards, 0);
+  _numFound.assign(numShards, 0);
+  _isExact.assign(numShards, 1);
+  for (MatchBuffers& buffers : _buffers) { buffers.stats = FilterStats(); }
+}
+
+// _____________________________________________________________________________
+size_t ParallelSearch::findMatches(const std::string& prefix,
+    std::vector<Match>& matches) {
+  resize();
+  size_t numComputations = _index->matchWords(prefix, _words);
+  if (_words.words.size() > 1) {
+    size_t numFound;
+    findWordMatches(SIZE_MAX, matches, numFound);
+    return numComputations;
+  }
+  _pool->run(_matches.size(), [&](size_t shard) {
+    _numPedComputations[shard] = _index->findShardMatches(prefix, shard,
+        _buffers[shard], _matches[shard]);
+  });
+  QGramIndex::mergeRankedMatches(_matches, SIZE_MAX, matches);
+  size_t numPedComputations = 0;
+  for (size_t n : _numPedComputations) { numPedComputations += n; }
+  return numPedComputations;
+}
+
+// _____________________________________________________________________________
+size_t ParallelSearch::findTopMatches(const std::string& prefix, size_t k,
+    bool exactCount, std::vector<Match>& matches, size_t& numFound,
+    bool& isExact) {
+  resize();
+  isExact = true;
+  if (!QGramIndex::hasSeveralWords(prefix) &&
+      _index->findCompletions(QGramIndex::normalize(prefix), k, matches,
+      numFound)) {
+    return 0;
+  }
+  size_t numComputations = _index->matchWords(prefix, _words);
+  if (_words.words.size() > 1) {
+    findWordMatches(k, matches, numFound);
+    return numComputations;
+  }
+
+  // Each shard stops on its own once it has its top k, and the top k of all
+  // shards are among those.
+  _pool->run(_matches.size(), [&](size_t shard) {
+    bool isShardExact;
+    _numPedComputations[shard] = _index->findTopShardMatches(prefix, shard,
+        k, exactCount, _buffers[shard], _matches[shard], _numFound[shard],
+        isShardExact);
+    _isExact[shard] = isShardExact;
+  });
+  QGramIndex::mergeRankedMatches(_matches, k, matches);
+  size_t numPedComputations = 0;
+  numFound = 0;
+  for (size_t shard = 0; shard < _matches.size(); shard++) {
+    numPedComputations += _numPedComputations[shard];
+    numFound += _numFound[shard];
+    isExact = isExact && _isExact[shard];
+  }
+  return numPedComputations;
+}
+
+// _____________________________________________________________________________
+void ParallelSearch::findWordMatches(size_t k, std::vector<Match>& matches,
+    size_t& numFound) {
+  _pool->run(_matches.size(), [&](size_t shard) {
+    _index->findShardWordMatches(_words, shard, k, _buffers[shard],
+        _matches[shard], _numFound[shard]);
+  });
+  QGramIndex::mergeRankedMatches(_matches, k, matches);
+  numFound = 0;
+  for (size_t n : _numFound) { numFound += n; }
+}
+
+// _____________________________________________________________________________
+FilterStats ParallelSearch::stats() const {
+  FilterStats stats;
+  for (const MatchBuffers& buffers : _buffers) {
+    stats.numPosition += buffers.stats.numPosition;
+    stats.numLength += buffers.stats.numLength;
+    stats.numSignature += buffers.stats.numSignature;
+  }
+  return stats;
+}
+
+// _____________________________________________________________________________
+size_t findTopMatches(ParallelSearch& search, const PrefixTrie& trie,
+    const std::string& prefix, size_t k, bool exactCount,
+    MatchBuffers& buffers, std::vector<Match>& matches, size_t& numFound,
+    bool& isExact) {
+  size_t length = QGramIndex::normalize(prefix).size();
+  size_t numPedComputations = 0;
+  if (!exactCount && length > COMPLETION_MAX_LENGTH &&
+      length <= TRIE_MAX_PREFIX_LENGTH &&
+      !QGramIndex::hasSeveralWords(prefix) && trie.findTopMatches(prefix, k,
+      buffers, matches, numFound, isExact, numPedComputations)) {
+    return numPedComputations;
+  }
+  return numPedComputations + search.findTopMatches(prefix, k, exactCount,
+      matches, numFound, isExact);
+}
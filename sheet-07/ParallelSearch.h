@@ -0,0 +1,70 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#ifndef PARALLELSEARCH_H_
+#define PARALLELSEARCH_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "./PrefixTrie.h"
+#include "./QGramIndex.h"
+#include "./ThreadPool.h"
+
+// Answers one query with all shards of a q-gram index (see
+// QGramIndex::setNumShards()) at once: one task per shard on a thread pool,
+// each with its own count filter and verification, and then a k-way merge of
+// the ranked matches of the shards. A query of several words has its words
+// matched in the vocabulary once, and each shard only intersects their
+// strings. Keeps the scratch memory of every shard across queries; use one
+// ParallelSearch per thread.
+class ParallelSearch {
+ public:
+  // Searches the given index (which must outlive this) on the given pool.
+  ParallelSearch(const QGramIndex& index, ThreadPool& pool) : _index(&index),
+      _pool(&pool) {}
+
+  // Same as QGramIndex::findMatches(prefix, buffers, matches).
+  size_t findMatches(const std::string& prefix, std::vector<Match>& matches);
+
+  // Same as QGramIndex::findTopMatches(). numFound is the sum of the counts
+  // of the shards, and isExact is true if they are all exact.
+  size_t findTopMatches(const std::string& prefix, size_t k, bool exactCount,
+      std::vector<Match>& matches, size_t& numFound, bool& isExact);
+
+  // The stats of the filters in the last query, summed over the shards.
+  FilterStats stats() const;
+
+ private:
+  // Makes room for the shards of the index.
+  void resize();
+
+  // Writes the k best matches of a query of several words, with its words
+  // matched in _words, to 'matches' and sets numFound.
+  void findWordMatches(size_t k, std::vector<Match>& matches,
+      size_t& numFound);
+
+  const QGramIndex* _index;
+  ThreadPool* _pool;
+
+  // Per shard: the scratch memory, the ranked matches, the number of PED
+  // computations, the number of matches and whether it is exact.
+  std::vector<MatchBuffers> _buffers;
+  std::vector<std::vector<Match> > _matches;
+  std::vector<size_t> _numPedComputations;
+  std::vector<size_t> _numFound;
+  std::vector<uint8_t> _isExact;
+
+  // The words of the query and their matches in the vocabulary, for all
+  // shards.
+  MatchBuffers _words;
+};
+
+// Same as findTopMatches(index, trie, ...) in PrefixTrie.h, but with the
+// q-gram index searched by the given ParallelSearch.
+size_t findTopMatches(ParallelSearch& search, const PrefixTrie& trie,
+    const std::string& prefix, size_t k, bool exactCount,
+    MatchBuffers& buffers, std::vector<Match>& matches, size_t& numFound,
+    bool& isExact);
+
+#endif  // PARALLELSEARCH_H_
@@ -0,0 +1,118 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+#include "./ParallelSearch.h"
+#include "./QGramIndex.h"
+#include "./TestHelpers.h"
+#include "./ThreadPool.h"
+
+// _____________________________________________________________________________
+TEST(ParallelSearchTest, example) {
+  // More shards than entities: the extra shards are empty.
+  QGramIndex index(3, true);
+  index.setNumShards(5);
+  index.buildFromFile("example.tsv");
+  ASSERT_EQ(5, index.numShards());
+  ThreadPool pool(2);
+  ParallelSearch search(index, pool);
+  std::vector<Match> matches;
+  search.findMatches("Frei", matches);
+  ASSERT_EQ(2, matches.size());
+  ASSERT_EQ(1, matches[0].entityId);
+  ASSERT_EQ(2, matches[1].entityId);
+  ASSERT_EQ(1, matches[1].ped);
+}
+
+// _____________________________________________________________________________
+TEST(ParallelSearchTest, sameAsOneShard) {
+  // Random names and synonyms over a small alphabet, so that short prefixes
+  // match many entities in every shard.
+  writeRandomEntities("ParallelSearchTest.TMP.tsv", 5, 2000, 4, 12);
+  std::mt19937 gen(5);
+  QGramIndex index(3, true);
+  index.buildFromFile("ParallelSearchTest.TMP.tsv");
+  QGramIndex sharded = index;
+  ThreadPool pool(3);
+  ParallelSearch search(sharded, pool);
+  MatchBuffers buffers;
+  std::vector<Match> expected, actual;
+  for (size_t numShards : {1, 2, 3, 8}) {
+    sharded.setNumShards(numShards);
+    for (size_t i = 0; i < 40; i++) {
+      std::string query;
+      size_t length = 2 + gen() % 11;
+      for (size_t j = 0; j < length; j++) query += 'a' + gen() % 4;
+      index.findMatches(query, buffers, expected);
+      search.findMatches(query, actual);
+      EXPECT_EQ(expected, actual) << query;
+
+      // The top k are the same, and so is the exact count.
+      for (bool exactCount : {false, true}) {
+        size_t expectedFound, actualFound;
+        bool expectedExact, actualExact;
+        index.findTopMatches(query, 5, exactCount, buffers, expected,
+            expectedFound, expectedExact);
+        search.findTopMatches(query, 5, exactCount, actual, actualFound,
+            actualExact);
+        EXPECT_EQ(expected, actual) << query;
+        if (exactCount) {
+          ASSERT_TRUE(actualExact);
+          ASSERT_EQ(expectedFound, actualFound) << query;
+        }
+      }
+    }
+  }
+}
+
+// _____________________________________________________________________________
+TEST(ParallelSearchTest, severalWords) {
+  // Names and synonyms of up to three random words, and queries of two.
+  writeRandomEntities("ParallelSearchTest.TMP.tsv", 7, 1000, 4, 6, 3);
+  std::mt19937 gen(7);
+  QGramIndex index(3, true);
+  index.buildFromFile("ParallelSearchTest.TMP.tsv");
+  QGramIndex sharded = index;
+  ThreadPool pool(2);
+  ParallelSearch search(sharded, pool);
+  MatchBuffers buffers;
+  std::vector<Match> expected, actual;
+  for (size_t numShards : {1, 3}) {
+    sharded.setNumShards(numShards);
+    for (size_t i = 0; i < 40; i++) {
+      std::string query = randomWords(gen, 2, 4, 6);
+      index.findMatches(query, buffers, expected);
+      search.findMatches(query, actual);
+      EXPECT_EQ(expected, actual) << query;
+
+      size_t expectedFound, actualFound;
+      bool expectedExact, actualExact;
+      index.findTopMatches(query, 5, false, buffers, expected, expectedFound,
+          expectedExact);
+      search.findTopMatches(query, 5, false, actual, actualFound,
+          actualExact);
+      EXPECT_EQ(expected, actual) << query;
+      ASSERT_EQ(expectedFound, actualFound) << query;
+      ASSERT_TRUE(actualExact);
+    }
+  }
+}
+
+// _____________________________________________________________________________
+TEST(ParallelSearchTest, mergeRankedMatches) {
+  std::vector<std::vector<Match> > parts = {
+    {Match(1, 0, NO_SYNONYM), Match(4, 1, NO_SYNONYM)},
+    {},
+    {Match(7, 0, 0), Match(2, 2, NO_SYNONYM)},
+  };
+  std::vector<Match> matches;
+  QGramIndex::mergeRankedMatches(parts, 3, matches);
+  EXPECT_EQ(std::vector<Match>({Match(1, 0, NO_SYNONYM), Match(7, 0, 0),
+      Match(4, 1, NO_SYNONYM)}), matches);
+  QGramIndex::mergeRankedMatches(parts, SIZE_MAX, matches);
+  ASSERT_EQ(4, matches.size());
+  ASSERT_EQ(2, matches[3].entityId);
+}
@@ -0,0 +1,153 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#include "./PerfCounters.h"
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+#include <iomanip>
+#include <map>
+#include <string>
+
+namespace {
+
+// The (type, config) pairs of the events in the order of PerfEvent.
+const uint32_t EVENT_TYPES[PERF_NUM_EVENTS] = {
+  PERF_TYPE_HARDWARE,
+  PERF_TYPE_HARDWARE,
+  PERF_TYPE_HW_CACHE,
+  PERF_TYPE_HARDWARE,
+  PERF_TYPE_HARDWARE
+};
+
+const uint64_t EVENT_CONFIGS[PERF_NUM_EVENTS] = {
+  PERF_COUNT_HW_CPU_CYCLES,
+  PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+  PERF_COUNT_HW_CACHE_MISSES,
+  PERF_COUNT_HW_BRANCH_MISSES
+};
+
+// glibc has no wrapper for perf_event_open.
+int perfEventOpen(struct perf_event_attr* attr) {
+  return syscall(__NR_perf_event_open, attr, 0, -1, -1, 0);
+}
+
+// Returns the time since some fixed point in seconds.
+double now() {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}  // namespace
+
+// _____________________________________________________________________________
+PerfSample::PerfSample() : seconds(0) {
+  for (size_t i = 0; i < PERF_NUM_EVENTS; i++) values[i] = 0;
+}
+
+// _____________________________________________________________________________
+PerfSample PerfSample::operator-(const PerfSample& other) const {
+  PerfSample res;
+  for (size_t i = 0; i < PERF_NUM_EVENTS; i++) {
+    res.values[i] = values[i] - other.values[i];
+  }
+  res.seconds = seconds - other.seconds;
+  return res;
+}
+
+// _____________________________________________________________________________
+PerfSample& PerfSample::operator+=(const PerfSample& other) {
+  for (size_t i = 0; i < PERF_NUM_EVENTS; i++) values[i] += other.values[i];
+  seconds += other.seconds;
+  return *this;
+}
+
+// _____________________________________________________________________________
+PerfCounters::PerfCounters() {
+  for (size_t i = 0; i < PERF_NUM_EVENTS; i++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = EVENT_TYPES[i];
+    attr.config = EVENT_CONFIGS[i];
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // Also count the threads started later, e.g. by a parallel build.
+    attr.inherit = 1;
+    // Needed to scale the values if the counters get multiplexed.
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+        PERF_FORMAT_TOTAL_TIME_RUNNING;
+    _fds[i] = perfEventOpen(&attr);
+  }
+}
+
+// _____________________________________________________________________________
+PerfCounters::~PerfCounters() {
+  for (size_t i = 0; i < PERF_NUM_EVENTS; i++) {
+    if (_fds[i] >= 0) close(_fds[i]);
+  }
+}
+
+// _____________________________________________________________________________
+PerfSample PerfCounters::read() const {
+  PerfSample sample;
+  for (size_t i = 0; i < PERF_NUM_EVENTS; i++) {
+    // Layout given by read_format: value, time enabled, time running.
+    uint64_t buf[3];
+    if (_fds[i] < 0 || ::read(_fds[i], buf, sizeof(buf)) != sizeof(buf)) {
+      continue;
+    }
+    sample.values[i] = buf[2] == 0 ? 0 : 1.0 * buf[0] * buf[1] / buf[2];
+  }
+  sample.seconds = now();
+  return sample;
+}
+
+// _____________________________________________________________________________
+void PerfRegions::add(const std::string& name, const PerfSample& sample) {
+  Stats& stats = _regions[name];
+  stats.calls++;
+  stats.total += sample;
+}
+
+// _____________________________________________________________________________
+PerfRegions::Stats PerfRegions::get(const std::string& name) const {
+  auto it = _regions.find(name);
+  return it == _regions.end() ? Stats() : it->second;
+}
+
+// _____________________________________________________________________________
+void PerfRegions::report(std::ostream& os) const {
+  for (auto it = _regions.begin(); it != _regions.end(); ++it) {
+    report(os, it->first, it->second);
+  }
+}
+
+// _____________________________________________________________________________
+void PerfRegions::report(std::ostream& os, const std::string& name,
+    const Stats& stats) const {
+  size_t calls = stats.calls > 0 ? stats.calls : 1;
+  const double* v = stats.total.values;
+
+  os << "[perf] " << std::left << std::setw(18) << name << std::right
+     << " calls: " << stats.calls
+     << "\ttime/call: " << std::fixed << std::setprecision(1)
+     << 1e6 * stats.total.seconds / calls << "µs";
+  for (size_t i = 0; i < PERF_NUM_EVENTS; i++) {
+    os << "\t" << PERF_EVENT_NAMES[i] << "/call: ";
+    if (_counters.available(static_cast<PerfEvent>(i))) {
+      os << std::setprecision(0) << v[i] / calls;
+    } else {
+      os << "n/a";
+    }
+  }
+  if (_counters.available(PERF_CYCLES) && v[PERF_CYCLES] > 0 &&
+      _counters.available(PERF_INSTRUCTIONS)) {
+    os << "\tIPC: " << std::setprecision(2)
+       << v[PERF_INSTRUCTIONS] / v[PERF_CYCLES];
+  }
+  os.unsetf(std::ios_base::floatfield);
+  os << std::setprecision(6) << std::endl;
+}
@@ -0,0 +1,133 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#ifndef PERFCOUNTERS_H_
+#define PERFCOUNTERS_H_
+
+#include <stdint.h>
+#include <chrono>
+#include <map>
+#include <ostream>
+#include <string>
+
+// The hardware events we count for every region.
+enum PerfEvent {
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_L1D_MISSES,
+  PERF_LLC_MISSES,
+  PERF_BRANCH_MISSES,
+  PERF_NUM_EVENTS
+};
+
+// Human readable names of the events above.
+const char* const PERF_EVENT_NAMES[PERF_NUM_EVENTS] = {
+  "cycles", "instructions", "L1d-misses", "LLC-misses", "branch-misses"
+};
+
+// A snapshot (or a difference of two snapshots) of all counters.
+struct PerfSample {
+  PerfSample();
+
+  // The counter values, scaled if the kernel had to multiplex the counters.
+  double values[PERF_NUM_EVENTS];
+
+  // Wall clock time in seconds.
+  double seconds;
+
+  PerfSample operator-(const PerfSample& other) const;
+  PerfSample& operator+=(const PerfSample& other);
+};
+
+// A set of hardware performance counters of the calling thread and of the
+// threads it starts later (their counts are added once they exit, so a region
+// that joins its threads counts all of them), read via the
+// perf_event_open(2) syscall. No external tools (perf, PAPI) are needed. If
+// the kernel refuses an event (no PMU in a VM, perf_event_paranoid too high),
+// that event is simply reported as unavailable.
+class PerfCounters {
+ public:
+  // Opens and enables all counters.
+  PerfCounters();
+
+  // Closes all counters.
+  ~PerfCounters();
+
+  // Reads the current value of all counters.
+  PerfSample read() const;
+
+  // Returns true if the given event could be opened.
+  bool available(PerfEvent event) const { return _fds[event] >= 0; }
+
+ private:
+  PerfCounters(const PerfCounters&);
+  PerfCounters& operator=(const PerfCounters&);
+
+  // The file descriptors of the counters, -1 if not available.
+  int _fds[PERF_NUM_EVENTS];
+};
+
+// Counters aggregated per named region, e.g. "readFromFile" or "intersect".
+class PerfRegions {
+ public:
+  // The aggregated counters of one region.
+  struct Stats {
+    Stats() : calls(0) {}
+    size_t calls;
+    PerfSample total;
+
+    // The measurements added since the given earlier state of the region.
+    Stats operator-(const Stats& before) const {
+      Stats res;
+      res.calls = calls - before.calls;
+      res.total = total - before.total;
+      return res;
+    }
+  };
+
+  // Adds the given measurement to the region with the given name.
+  void add(const std::string& name, const PerfSample& sample);
+
+  // Returns the stats of the region with the given name (empty if unknown).
+  Stats get(const std::string& name) const;
+
+  // Writes one line per region to the given stream.
+  void report(std::ostream& os) const;
+
+  // Writes a single line for the given stats.
+  void report(std::ostream& os, const std::string& name, const Stats& stats)
+      const;
+
+  // Forgets all measurements.
+  void clear() { _regions.clear(); }
+
+  // The counters used to measure all regions.
+  const PerfCounters& counters() const { return _counters; }
+
+ private:
+  PerfCounters _counters;
+  std::map<std::string, Stats> _regions;
+};
+
+// Measures the enclosing scope and adds the result to the given regions, e.g.
+//
+//   {
+//     PerfRegion region(regions, "intersect");
+//     PostingList::intersect(A, B);
+//   }
+class PerfRegion {
+ public:
+  PerfRegion(PerfRegions& regions, const std::string& name)
+      : _regions(regions), _name(name), _start(regions.counters().read()) {}
+
+  ~PerfRegion() {
+    _regions.add(_name, _regions.counters().read() - _start);
+  }
+
+ private:
+  PerfRegions& _regions;
+  std::string _name;
+  PerfSample _start;
+};
+
+#endif  // PERFCOUNTERS_H_
@@ -0,0 +1,337 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#include "./PrefixEditDistance.h"
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define PED_X86_TARGETS
+#endif
+
+namespace {
+
+// Runs PedPattern::computeSingleBlock for up to BYTES / sizeof(Lane)
+// candidates at a time, one per lane, using GCC vector extensions. The match
+// masks of the candidates' characters are looked up while transposing the
+// candidates into columns, so the vector loop only does the bit operations.
+// Lanes that are already done just don't update their best value anymore; the
+// loop stops once all lanes are done. The value range of Lane must hold |x|
+// bits and scores up to 2 * |x| + delta + 1.
+//
+// Always inlined, so that the code is generated for the instruction set of the
+// calling (target specific) function.
+template <typename Lane, size_t BYTES>
+inline __attribute__((always_inline)) void computeLanes(
+    const PedPattern& pattern, const boost::string_ref* ys, size_t numYs,
+    size_t delta, size_t* peds) {
+  typedef Lane V __attribute__((vector_size(BYTES)));
+  const size_t NUM_LANES = BYTES / sizeof(Lane);
+  const size_t NUM_WORDS = BYTES / sizeof(uint64_t);
+  const size_t m = pattern.length();
+  const Lane lastBit = Lane(1) << (m - 1);
+  const V zero = {};
+
+  // The match masks of all characters, narrowed to the lane width.
+  Lane peq[256];
+  for (size_t c = 0; c < 256; c++) peq[c] = pattern.peq(c);
+
+  // The match masks of the characters of the current candidates, transposed:
+  // entry j * NUM_LANES + k belongs to the j-th character of the k-th one.
+  Lane column[MAX_BATCH_COLUMNS * NUM_LANES];
+
+  for (size_t start = 0; start < numYs; start += NUM_LANES) {
+    size_t n = std::min(NUM_LANES, numYs - start);
+    Lane limits[NUM_LANES];
+    size_t maxCols = 1;
+    for (size_t k = 0; k < NUM_LANES; k++) {
+      size_t cols = k < n ? std::min(m + delta + 1, ys[start + k].size() + 1)
+          : 0;
+      limits[k] = cols;
+      maxCols = std::max(maxCols, cols);
+    }
+    for (size_t k = 0; k < n; k++) {
+      const unsigned char* y =
+          reinterpret_cast<const unsigned char*>(ys[start + k].data());
+      size_t cols = limits[k];
+      for (size_t j = 0; j + 1 < cols; j++) {
+        column[j * NUM_LANES + k] = peq[y[j]];
+      }
+    }
+
+    V limit;
+    memcpy(&limit, limits, BYTES);
+    V vp = ~zero;
+    V vn = zero;
+    V score = zero + Lane(m);
+    V best = zero + Lane(std::min(m, delta + 1));
+    for (size_t j = 1; j < maxCols; j++) {
+      V eq;
+      memcpy(&eq, column + (j - 1) * NUM_LANES, BYTES);
+      // See computeSingleBlock.
+      V xv = eq | vn;
+      V xh = (((eq & vp) + vp) ^ vp) | eq;
+      V hp = vn | ~(xh | vp);
+      V hn = vp & xh;
+      score -= (V)((hp & lastBit) != 0);
+      score += (V)((hn & lastBit) != 0);
+      hp = (hp << 1) | 1;
+      hn = hn << 1;
+      vp = hn | ~(xv | hp);
+      vn = hp & xv;
+
+      V active = (V)(Lane(j) < limit);
+      V better = (V)(score < best) & active;
+      best = (score & better) | (best & ~better);
+
+      // A lane is done if it can't improve in its remaining columns.
+      V running = active & (V)(best != 0) &
+          (V)(score < best + (limit - Lane(j + 1)));
+      uint64_t words[NUM_WORDS];
+      memcpy(words, &running, BYTES);
+      uint64_t any = 0;
+      for (size_t w = 0; w < NUM_WORDS; w++) any |= words[w];
+      if (!any) break;
+    }
+
+    Lane result[NUM_LANES];
+    memcpy(result, &best, BYTES);
+    for (size_t k = 0; k < n; k++) peds[start + k] = result[k];
+  }
+}
+
+// Picks the narrowest lanes for the given pattern, |x| <= 64.
+template <size_t BYTES>
+inline __attribute__((always_inline)) void computeVectors(
+    const PedPattern& pattern, const boost::string_ref* ys, size_t numYs,
+    size_t delta, size_t* peds) {
+  size_t m = pattern.length();
+  uint64_t maxScore = 2 * m + delta + 1;
+  if (m <= 8 && maxScore < (uint64_t(1) << 8)) {
+    computeLanes<uint8_t, BYTES>(pattern, ys, numYs, delta, peds);
+  } else if (m <= 16 && maxScore < (uint64_t(1) << 16)) {
+    computeLanes<uint16_t, BYTES>(pattern, ys, numYs, delta, peds);
+  } else if (m <= 32 && maxScore < (uint64_t(1) << 32)) {
+    computeLanes<uint32_t, BYTES>(pattern, ys, numYs, delta, peds);
+  } else {
+    computeLanes<uint64_t, BYTES>(pattern, ys, numYs, delta, peds);
+  }
+}
+
+#ifdef PED_X86_TARGETS
+__attribute__((target("avx2"))) void computeAvx2(const PedPattern& pattern,
+    const boost::string_ref* ys, size_t numYs, size_t delta, size_t* peds) {
+  computeVectors<32>(pattern, ys, numYs, delta, peds);
+}
+
+__attribute__((target("avx512f,avx512bw"))) void computeAvx512(
+    const PedPattern& pattern, const boost::string_ref* ys, size_t numYs,
+    size_t delta, size_t* peds) {
+  computeVectors<64>(pattern, ys, numYs, delta, peds);
+}
+#endif
+}  // namespace
+
+// _____________________________________________________________________________
+void PedPattern::assign(const std::string& x) {
+  _length = x.size();
+  _numBlocks = (x.size() + 63) / 64;
+  _peq.assign(256 * _numBlocks, 0);
+  for (size_t i = 0; i < x.size(); i++) {
+    unsigned char c = x[i];
+    _peq[c * _numBlocks + i / 64] |= uint64_t(1) << (i % 64);
+  }
+}
+
+// _____________________________________________________________________________
+size_t PedPattern::compute(boost::string_ref y, size_t delta) const {
+  // The first row of the last column is PED("", y) = 0.
+  if (_length == 0) return 0;
+  // Note that it is enough to compute the first |x| + δ + 1 columns.
+  size_t numCols = std::min(_length + delta + 1, y.size() + 1);
+  if (_numBlocks == 1) return computeSingleBlock(y, numCols, delta);
+  return computeMultiBlock(y, numCols, delta);
+}
+
+// _____________________________________________________________________________
+size_t PedPattern::computeEditDistance(boost::string_ref y,
+    size_t delta) const {
+  // The lengths alone differ by more than delta.
+  if (_length > y.size() + delta || y.size() > _length + delta) {
+    return delta + 1;
+  }
+  if (_length == 0) return y.size();
+  if (_numBlocks > 1) {
+    // Words this long are rare: the textbook DP, one row at a time.
+    std::vector<size_t> row(y.size() + 1);
+    for (size_t j = 0; j <= y.size(); j++) row[j] = j;
+    for (size_t i = 1; i <= _length; i++) {
+      size_t diagonal = row[0];
+      row[0] = i;
+      for (size_t j = 1; j <= y.size(); j++) {
+        bool isSet = (_peq[static_cast<unsigned char>(y[j - 1]) * _numBlocks +
+            (i - 1) / 64] >> ((i - 1) % 64)) & 1;
+        size_t value = std::min(diagonal + !isSet,
+            std::min(row[j], row[j - 1]) + 1);
+        diagonal = row[j];
+        row[j] = value;
+      }
+    }
+    return std::min(row[y.size()], delta + 1);
+  }
+
+  // See computeSingleBlock.
+  const uint64_t lastBit = uint64_t(1) << (_length - 1);
+  uint64_t vp = ~uint64_t(0);
+  uint64_t vn = 0;
+  size_t score = _length;
+  for (size_t j = 1; j <= y.size(); j++) {
+    uint64_t eq = _peq[static_cast<unsigned char>(y[j - 1])];
+    uint64_t xv = eq | vn;
+    uint64_t xh = (((eq & vp) + vp) ^ vp) | eq;
+    uint64_t hp = vn | ~(xh | vp);
+    uint64_t hn = vp & xh;
+    if (hp & lastBit) score++;
+    if (hn & lastBit) score--;
+    hp = (hp << 1) | 1;
+    hn = hn << 1;
+    vp = hn | ~(xv | hp);
+    vn = hp & xv;
+    if (score > delta + (y.size() - j)) return delta + 1;
+  }
+  return std::min(score, delta + 1);
+}
+
+// _____________________________________________________________________________
+size_t PedPattern::computeSingleBlock(boost::string_ref y, size_t numCols,
+    size_t delta) const {
+  const uint64_t lastBit = uint64_t(1) << (_length - 1);
+  // Column 0 is 0, 1, ..., |x|: all vertical differences are +1. Bits above
+  // row |x| hold garbage, but carries only move upwards, so it never reaches
+  // the bits we look at.
+  uint64_t vp = ~uint64_t(0);
+  uint64_t vn = 0;
+  // The value in the last row of the current column.
+  size_t score = _length;
+  size_t best = std::min(score, delta + 1);
+
+  for (size_t j = 1; j < numCols; j++) {
+    uint64_t eq = _peq[static_cast<unsigned char>(y[j - 1])];
+    uint64_t xv = eq | vn;
+    uint64_t xh = (((eq & vp) + vp) ^ vp) | eq;
+    uint64_t hp = vn | ~(xh | vp);
+    uint64_t hn = vp & xh;
+    if (hp & lastBit) score++;
+    if (hn & lastBit) score--;
+    // The first row is 0, 1, ..., |y|, so it always grows by one.
+    hp = (hp << 1) | 1;
+    hn = hn << 1;
+    vp = hn | ~(xv | hp);
+    vn = hp & xv;
+
+    if (score < best) best = score;
+    // The last row can shrink by at most one per column, so stop as soon as
+    // the remaining columns can't beat the best value anymore.
+    if (best == 0 || score >= best + (numCols - 1 - j)) break;
+  }
+  return best;
+}
+
+// _____________________________________________________________________________
+size_t PedPattern::computeMultiBlock(boost::string_ref y, size_t numCols,
+    size_t delta) const {
+  const uint64_t highBit = uint64_t(1) << 63;
+  const uint64_t lastBit = uint64_t(1) << ((_length - 1) % 64);
+  // The vertical differences, on the stack for |x| <= 256.
+  uint64_t buffer[2 * 4];
+  std::vector<uint64_t> heapBuffer;
+  uint64_t* vp = buffer;
+  if (_numBlocks > 4) {
+    heapBuffer.resize(2 * _numBlocks);
+    vp = heapBuffer.data();
+  }
+  uint64_t* vn = vp + _numBlocks;
+  std::fill(vp, vp + _numBlocks, ~uint64_t(0));
+  std::fill(vn, vn + _numBlocks, 0);
+  size_t score = _length;
+  size_t best = std::min(score, delta + 1);
+
+  for (size_t j = 1; j < numCols; j++) {
+    const uint64_t* peq = &_peq[static_cast<unsigned char>(y[j - 1]) *
+        _numBlocks];
+    // The horizontal difference entering the current block from above: +1
+    // for the first row, then whatever the previous block hands down.
+    int carry = 1;
+    for (size_t b = 0; b < _numBlocks; b++) {
+      uint64_t eq = peq[b];
+      uint64_t xv = eq | vn[b];
+      if (carry < 0) eq |= 1;
+      uint64_t xh = (((eq & vp[b]) + vp[b]) ^ vp[b]) | eq;
+      uint64_t hp = vn[b] | ~(xh | vp[b]);
+      uint64_t hn = vp[b] & xh;
+      uint64_t top = b + 1 < _numBlocks ? highBit : lastBit;
+      int out = (hp & top) ? 1 : ((hn & top) ? -1 : 0);
+      hp <<= 1;
+      hn <<= 1;
+      if (carry < 0) {
+        hn |= 1;
+      } else if (carry > 0) {
+        hp |= 1;
+      }
+      vp[b] = hn | ~(xv | hp);
+      vn[b] = hp & xv;
+      carry = out;
+    }
+    score += carry;
+
+    if (score < best) best = score;
+    if (best == 0 || score >= best + (numCols - 1 - j)) break;
+  }
+  return best;
+}
+
+// _____________________________________________________________________________
+bool PedPattern::supports(PedBatchMode mode) {
+  switch (mode) {
+#ifdef PED_X86_TARGETS
+    case PED_BATCH_AVX2:
+      return __builtin_cpu_supports("avx2");
+    case PED_BATCH_AVX512:
+      return __builtin_cpu_supports("avx512f") &&
+          __builtin_cpu_supports("avx512bw");
+#else
+    case PED_BATCH_AVX2:
+    case PED_BATCH_AVX512:
+      return false;
+#endif
+    default:
+      return true;
+  }
+}
+
+// _____________________________________________________________________________
+void PedPattern::computeBatch(const boost::string_ref* ys, size_t numYs,
+    size_t delta, size_t* peds, PedBatchMode mode) const {
+  if (mode == PED_BATCH_AUTO) {
+    mode = supports(PED_BATCH_AVX512) ? PED_BATCH_AVX512 :
+        supports(PED_BATCH_AVX2) ? PED_BATCH_AVX2 : PED_BATCH_SCALAR;
+  }
+  if (_numBlocks != 1 || _length + delta + 1 > MAX_BATCH_COLUMNS ||
+      !supports(mode)) {
+    mode = PED_BATCH_SCALAR;
+  }
+
+#ifdef PED_X86_TARGETS
+  if (mode == PED_BATCH_AVX512) {
+    computeAvx512(*this, ys, numYs, delta, peds);
+    return;
+  }
+  if (mode == PED_BATCH_AVX2) {
+    computeAvx2(*this, ys, numYs, delta, peds);
+    return;
+  }
+#endif
+  for (size_t i = 0; i < numYs; i++) peds[i] = compute(ys[i], delta);
+}
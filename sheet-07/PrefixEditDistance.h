@@ -0,0 +1,92 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#ifndef PREFIXEDITDISTANCE_H_
+#define PREFIXEDITDISTANCE_H_
+
+#include <boost/utility/string_ref.hpp>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// The prefix x of prefix edit distance computations PED(x, y), preprocessed
+// for the bit-parallel algorithm of Myers (1999) in the formulation of Hyyrö
+// (2001): a column of the DP matrix (one row per character of x) is encoded
+// in two bit vectors of vertical +1/-1 differences, so a whole column costs a
+// handful of word operations. Prefixes longer than 64 characters use several
+// 64-bit blocks per column.
+//
+// The maximal number of DP columns computeBatch() handles in SIMD lanes.
+const size_t MAX_BATCH_COLUMNS = 128;
+
+// How computeBatch() verifies candidates.
+enum PedBatchMode {
+  // The widest of the modes below supported by the CPU.
+  PED_BATCH_AUTO,
+  // One compute() call per candidate.
+  PED_BATCH_SCALAR,
+  // One candidate per lane of a 256-bit / 512-bit vector.
+  PED_BATCH_AVX2,
+  PED_BATCH_AVX512
+};
+
+// Build one pattern per query and reuse it for all candidates.
+class PedPattern {
+ public:
+  // Creates the pattern of the empty prefix.
+  PedPattern() : _length(0), _numBlocks(0) {}
+
+  explicit PedPattern(const std::string& x) { assign(x); }
+
+  // Replaces x, reusing the memory of the previous pattern.
+  void assign(const std::string& x);
+
+  // Returns PED(x, y) if it is smaller or equal to delta, delta + 1 otherwise.
+  // Exactly the same value as the textbook DP over the first |x| + delta + 1
+  // columns, but stops as soon as no remaining column can reach a value
+  // <= delta (or improve the best value found so far).
+  size_t compute(boost::string_ref y, size_t delta) const;
+
+  // Returns the edit distance ED(x, y) if it is smaller or equal to delta,
+  // delta + 1 otherwise: the last row of the last column instead of the best
+  // one. Stops as soon as the remaining columns can't bring it down to delta.
+  size_t computeEditDistance(boost::string_ref y, size_t delta) const;
+
+  // Computes peds[i] = compute(ys[i], delta) for all i < numYs. In the SIMD
+  // modes, each lane runs the single block algorithm for another candidate,
+  // with lanes as narrow as |x| allows: for |x| <= 8, a 256-bit vector checks
+  // 32 candidates at once, for |x| <= 16 and |x| <= 32 it checks 16 and 8.
+  // Prefixes longer than 64 characters (or |x| + delta >= MAX_BATCH_COLUMNS)
+  // are always verified one by one. Doesn't allocate.
+  void computeBatch(const boost::string_ref* ys, size_t numYs, size_t delta,
+      size_t* peds, PedBatchMode mode = PED_BATCH_AUTO) const;
+
+  // Returns true if the CPU supports the given mode.
+  static bool supports(PedBatchMode mode);
+
+  // Returns the length of x.
+  size_t length() const { return _length; }
+
+  // Returns the match mask (bit i set iff x[i] == c) of a character, |x| <= 64.
+  uint64_t peq(unsigned char c) const { return _peq[c]; }
+
+ private:
+  // compute() for |x| <= 64.
+  size_t computeSingleBlock(boost::string_ref y, size_t numCols,
+      size_t delta) const;
+
+  // compute() for |x| > 64.
+  size_t computeMultiBlock(boost::string_ref y, size_t numCols,
+      size_t delta) const;
+
+  // The length of x.
+  size_t _length;
+
+  // The number of 64-bit blocks per column.
+  size_t _numBlocks;
+
+  // _peq[c * _numBlocks + b] has bit i set iff x[64 * b + i] == c.
+  std::vector<uint64_t> _peq;
+};
+
+#endif  // PREFIXEDITDISTANCE_H_
@@ -0,0 +1,287 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#include "./PrefixTrie.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// The first bytes of a file written by PrefixTrie::save, and its version.
+const char TRIE_MAGIC[8] = {'P', 'R', 'E', 'F', 'T', 'R', 'I', 'E'};
+const uint64_t TRIE_VERSION = 1;
+}  // namespace
+
+// _____________________________________________________________________________
+PrefixTrie::PrefixTrie(const QGramIndex& index) : _index(&index) {
+  std::vector<String> strings(index._stringEntities.size());
+  for (size_t i = 0; i < strings.size(); i++) {
+    strings[i].stringId = i + 1;
+    strings[i].entityId = index.stringEntity(i + 1);
+  }
+  std::sort(strings.begin(), strings.end(),
+      [&index](const String& a, const String& b) {
+    int cmp = index.normalizedString(a.stringId).compare(
+        index.normalizedString(b.stringId));
+    return cmp != 0 ? cmp < 0 : a.entityId < b.entityId;
+  });
+  _strings.assign(std::move(strings));
+
+  std::vector<Node> nodes;
+  std::vector<uint32_t> topIds;
+  Node root = {0, static_cast<uint32_t>(_strings.size()), 0, 0, 0, 0};
+  nodes.push_back(root);
+  build(0, nodes, topIds);
+  topIds.resize(nodes.size() * TRIE_TOP_K);
+  _nodes.assign(std::move(nodes));
+  _topIds.assign(std::move(topIds));
+}
+
+// _____________________________________________________________________________
+PrefixTrie::PrefixTrie(const QGramIndex& index, const std::string& fileName,
+    bool map) : _index(&index) {
+  std::shared_ptr<const MappedFile> file(new MappedFile(fileName));
+  const char* pos = file->data();
+  const char* end = pos + file->size();
+  uint64_t version;
+  if (file->size() < sizeof(TRIE_MAGIC) + sizeof(version) ||
+      std::memcmp(pos, TRIE_MAGIC, sizeof(TRIE_MAGIC)) != 0) {
+    throw std::runtime_error("'" + fileName + "' is no prefix trie");
+  }
+  pos += sizeof(TRIE_MAGIC);
+  std::memcpy(&version, pos, sizeof(version));
+  pos += sizeof(version);
+  if (version != TRIE_VERSION) {
+    throw std::runtime_error("'" + fileName + "' has an unknown version");
+  }
+  readColumn(pos, end, map, _strings);
+  readColumn(pos, end, map, _nodes);
+  readColumn(pos, end, map, _topIds);
+  if (_strings.size() != index._stringEntities.size() || _nodes.empty() ||
+      _topIds.size() != _nodes.size() * TRIE_TOP_K) {
+    throw std::runtime_error("'" + fileName + "' doesn't fit the index");
+  }
+  if (map) { _file = file; }
+}
+
+// _____________________________________________________________________________
+void PrefixTrie::save(const std::string& fileName) const {
+  std::ofstream out(fileName.c_str(), std::ios_base::binary);
+  out.write(TRIE_MAGIC, sizeof(TRIE_MAGIC));
+  out.write(reinterpret_cast<const char*>(&TRIE_VERSION),
+      sizeof(TRIE_VERSION));
+  writeColumn(out, _strings);
+  writeColumn(out, _nodes);
+  writeColumn(out, _topIds);
+  if (!out) {
+    throw std::runtime_error("could not write '" + fileName + "'");
+  }
+}
+
+// _____________________________________________________________________________
+void PrefixTrie::build(uint32_t nodeId, std::vector<Node>& nodes,
+    std::vector<uint32_t>& topIds) const {
+  const Node node = nodes[nodeId];
+  std::vector<uint32_t> ids;
+
+  // The strings that end at the node.
+  uint32_t i = node.lo;
+  while (i < node.hi && str(i).size() == node.depth) {
+    ids.push_back(_strings[i].entityId);
+    i++;
+  }
+
+  // One child per next character. A child goes down to the longest common
+  // prefix of its strings, which is that of its first and last one.
+  uint32_t firstChild = nodes.size();
+  while (i < node.hi) {
+    char c = str(i)[node.depth];
+    uint32_t j = i + 1;
+    while (j < node.hi && str(j)[node.depth] == c) { j++; }
+    boost::string_ref first = str(i);
+    boost::string_ref last = str(j - 1);
+    uint32_t depth = node.depth + 1;
+    while (depth < first.size() && depth < last.size() &&
+        first[depth] == last[depth]) {
+      depth++;
+    }
+    Node child = {i, j, depth, 0, 0, 0};
+    nodes.push_back(child);
+    i = j;
+  }
+  uint32_t numChildren = nodes.size() - firstChild;
+  nodes[nodeId].firstChild = firstChild;
+  nodes[nodeId].numChildren = numChildren;
+
+  // The best ids of the subtree are among those of the children.
+  for (uint32_t child = firstChild; child < firstChild + numChildren;
+      child++) {
+    build(child, nodes, topIds);
+    const uint32_t* top = &topIds[child * TRIE_TOP_K];
+    ids.insert(ids.end(), top, top + nodes[child].numTop);
+  }
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+  ids.resize(std::min(ids.size(), TRIE_TOP_K));
+
+  if (topIds.size() < (nodeId + 1) * TRIE_TOP_K) {
+    topIds.resize(std::max(2 * topIds.size(), (nodeId + 1) * TRIE_TOP_K));
+  }
+  std::copy(ids.begin(), ids.end(), &topIds[nodeId * TRIE_TOP_K]);
+  nodes[nodeId].numTop = ids.size();
+}
+
+// _____________________________________________________________________________
+size_t PrefixTrie::sizeInBytes() const {
+  return _strings.sizeInBytes() + _nodes.sizeInBytes() +
+      _topIds.sizeInBytes();
+}
+
+// _____________________________________________________________________________
+void PrefixTrie::search(uint32_t nodeId, uint32_t parentDepth, size_t best,
+    const std::string& x, size_t delta, MatchBuffers& buffers) const {
+  const Node& node = _nodes[nodeId];
+  boost::string_ref label = str(node.lo);
+  const size_t m = x.size();
+  const size_t cap = delta + 1;
+
+  // One column D[0..m][d + 1] of the PED matrix per label character, where
+  // the path so far is y[0..d]. Values are capped at delta + 1.
+  for (size_t d = parentDepth; d < node.depth; d++) {
+    const uint8_t* prev = &buffers.columns[d * (m + 1)];
+    uint8_t* col = &buffers.columns[(d + 1) * (m + 1)];
+    char c = label[d];
+    col[0] = std::min(d + 1, cap);
+    size_t colMin = col[0];
+    for (size_t i = 1; i <= m; i++) {
+      size_t value = std::min<size_t>(prev[i - 1] + (x[i - 1] == c ? 0 : 1),
+          std::min(prev[i], col[i - 1]) + 1);
+      col[i] = std::min(value, cap);
+      colMin = std::min(colMin, value);
+    }
+    best = std::min<size_t>(best, col[m]);
+
+    // The minimum of a column never decreases along the path, and the last
+    // row can't go below it. So if it is >= best already, every string below
+    // has PED best.
+    if (colMin >= best) {
+      if (best <= delta) {
+        buffers.nodes.push_back(std::make_pair(nodeId,
+            static_cast<uint32_t>(best)));
+      }
+      return;
+    }
+    // Nothing below can get <= delta.
+    if (colMin > delta) { return; }
+  }
+
+  // The strings that end here, one entity each.
+  if (best <= delta) {
+    for (uint32_t i = node.lo; i < node.hi &&
+        str(i).size() == node.depth; i++) {
+      buffers.candidates.push_back(_strings[i].entityId);
+    }
+  }
+  for (uint32_t child = node.firstChild;
+      child < node.firstChild + node.numChildren; child++) {
+    search(child, node.depth, best, x, delta, buffers);
+  }
+}
+
+// _____________________________________________________________________________
+bool PrefixTrie::findTopMatches(const std::string& prefix, size_t k,
+    MatchBuffers& buffers, std::vector<Match>& matches, size_t& numFound,
+    bool& isExact, size_t& numPedComputations) const {
+  matches.clear();
+  numPedComputations = 0;
+  buffers.prefix = QGramIndex::normalize(prefix);
+  const std::string& x = buffers.prefix;
+  const size_t m = x.size();
+  // The q-gram index finds nothing for the empty prefix.
+  if (k > TRIE_TOP_K || m == 0) { return false; }
+  const size_t delta = m / 4;
+
+  // Column 0 of the PED matrix is 0, 1, ..., m. Below depth m + delta + 1,
+  // all column values are > delta.
+  buffers.columns.resize((m + delta + 2) * (m + 1));
+  for (size_t i = 0; i <= m; i++) {
+    buffers.columns[i] = std::min(i, delta + 1);
+  }
+  buffers.nodes.clear();
+  buffers.candidates.clear();
+  search(0, 0, std::min(m, delta + 1), x, delta, buffers);
+
+  // The candidates are the best entities of each answering node. An entity
+  // that isn't among them is in some node with more entities than it keeps,
+  // and ranks behind that node's (PED, last kept id).
+  numFound = buffers.candidates.size();
+  isExact = true;
+  Match bound(0xFFFFFFFF, 0xFFFFFFFF, NO_SYNONYM);
+  for (const std::pair<uint32_t, uint32_t>& answer : buffers.nodes) {
+    const Node& node = _nodes[answer.first];
+    const uint32_t* top = &_topIds[answer.first * TRIE_TOP_K];
+    buffers.candidates.insert(buffers.candidates.end(), top,
+        top + node.numTop);
+    numFound += node.hi - node.lo;
+    if (node.numTop == TRIE_TOP_K) {
+      isExact = false;
+      Match last(top[TRIE_TOP_K - 1], answer.second, NO_SYNONYM);
+      if (_matchComparator(last, bound)) { bound = last; }
+    }
+  }
+  std::vector<uint32_t>& candidates = buffers.candidates;
+  std::sort(candidates.begin(), candidates.end());
+  candidates.erase(std::unique(candidates.begin(), candidates.end()),
+      candidates.end());
+
+  // Verify them just like QGramIndex::findMatches.
+  buffers.pattern.assign(x);
+  buffers.signature = QGramIndex::computeSignature(x);
+  buffers.stats = FilterStats();
+  for (uint32_t id : candidates) {
+    size_t ped = delta + 1;
+    uint32_t name = _index->stringId(id, NO_SYNONYM);
+    boost::string_ref y = _index->normalizedString(name);
+    if (QGramIndex::passesStringFilters(buffers, delta, y,
+        _index->_stringSignatures[name - 1], &buffers.stats)) {
+      ped = buffers.pattern.compute(y, delta);
+      numPedComputations++;
+    }
+    Match match(id, ped, NO_SYNONYM);
+    if (ped <= delta || _index->matchSynonyms(buffers, delta, id, match,
+        numPedComputations)) {
+      matches.push_back(match);
+    }
+  }
+  if (isExact) { numFound = matches.size(); }
+
+  size_t numTop = std::min(k, matches.size());
+  std::partial_sort(matches.begin(), matches.begin() + numTop, matches.end(),
+      _matchComparator);
+  matches.resize(numTop);
+  if (isExact) { return true; }
+  return numTop == k && !_matchComparator(bound, matches.back());
+}
+
+// _____________________________________________________________________________
+size_t findTopMatches(const QGramIndex& index, const PrefixTrie& trie,
+    const std::string& prefix, size_t k, bool exactCount,
+    MatchBuffers& buffers, std::vector<Match>& matches, size_t& numFound,
+    bool& isExact) {
+  // The index answers the shortest prefixes from its completion table, and
+  // the queries of several words from its vocabulary.
+  size_t length = QGramIndex::normalize(prefix).size();
+  size_t numPedComputations = 0;
+  if (!exactCount && length > COMPLETION_MAX_LENGTH &&
+      length <= TRIE_MAX_PREFIX_LENGTH &&
+      !QGramIndex::hasSeveralWords(prefix) && trie.findTopMatches(prefix, k,
+      buffers, matches, numFound, isExact, numPedComputations)) {
+    return numPedComputations;
+  }
+  return numPedComputations + index.findTopMatches(prefix, k, exactCount,
+      buffers, matches, numFound, isExact);
+}
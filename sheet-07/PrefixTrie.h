@@ -0,0 +1,130 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#ifndef PREFIXTRIE_H_
+#define PREFIXTRIE_H_
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "./QGramIndex.h"
+
+// The number of best entities each trie node keeps.
+const size_t TRIE_TOP_K = 10;
+
+// The maximal (normalized) prefix length for which findTopMatches() below
+// uses the trie rather than the q-gram index (delta <= 4).
+const size_t TRIE_MAX_PREFIX_LENGTH = 19;
+
+// A second fuzzy prefix search engine over the entities of a q-gram index:
+// a compacted trie over all normalized names and synonyms. A query walks the
+// trie depth first with one column of the PED matrix per character on the
+// path, pruning as soon as no column cell is <= delta. Once the last row of
+// the path has its final value (it can't improve below the current node),
+// every string in the subtree has that PED, so the node answers the whole
+// subtree with its precomputed best entities, without visiting it.
+//
+// That is fast for short prefixes, where the q-gram index has long lists with
+// many candidates but the trie has few nodes within delta. The number of such
+// nodes grows quickly with delta though, so for long prefixes the q-gram
+// index is faster (see findTopMatches()).
+class PrefixTrie {
+ public:
+  // Builds the trie over the normalized strings of the given index, which
+  // must outlive the trie.
+  explicit PrefixTrie(const QGramIndex& index);
+
+  // Loads the trie over the given index from a file written by save() for an
+  // index with the same strings, mapped or copied into memory (see
+  // QGramIndex::load). Throws std::runtime_error if the file can't be read or
+  // doesn't fit the index.
+  PrefixTrie(const QGramIndex& index, const std::string& fileName, bool map);
+
+  // Writes the trie to the given file. Throws std::runtime_error if that
+  // fails.
+  void save(const std::string& fileName) const;
+
+  // Finds the k best matches of the given prefix, ranked exactly like
+  // QGramIndex::findTopMatches, and sets numFound to the number of all
+  // matches (exact if isExact, otherwise an upper bound that counts names and
+  // synonyms). Verifies only the best entities of the answering nodes, with
+  // the same name-before-synonym rule as the q-gram index. Returns false if
+  // those don't decide the k best for sure (k > TRIE_TOP_K, or rare cases of
+  // entities whose name matches worse than a synonym); then the caller has to
+  // ask the q-gram index.
+  bool findTopMatches(const std::string& prefix, size_t k,
+      MatchBuffers& buffers, std::vector<Match>& matches, size_t& numFound,
+      bool& isExact, size_t& numPedComputations) const;
+
+  // Returns the number of nodes.
+  size_t numNodes() const { return _nodes.size(); }
+
+  // Returns the (approximate) memory used by the trie in bytes.
+  size_t sizeInBytes() const;
+
+ private:
+  // A node covers the strings _strings[lo] to _strings[hi - 1], which share
+  // their first 'depth' characters. The label of the edge from the parent
+  // are the characters since the depth of the parent. The children are
+  // _nodes[firstChild] to _nodes[firstChild + numChildren - 1], ordered by
+  // their first label character; the strings that end at the node come
+  // first in its range.
+  struct Node {
+    uint32_t lo;
+    uint32_t hi;
+    uint32_t depth;
+    uint32_t firstChild;
+    uint32_t numChildren;
+    // The number of best entity ids of the subtree, <= TRIE_TOP_K.
+    uint32_t numTop;
+  };
+
+  // One normalized name or synonym, and its entity.
+  struct String {
+    uint32_t stringId;
+    uint32_t entityId;
+  };
+
+  // Returns the normalized string _strings[i].
+  boost::string_ref str(uint32_t i) const {
+    return _index->normalizedString(_strings[i].stringId);
+  }
+
+  // Creates the children of the given node (in 'nodes') and their subtrees,
+  // and sets the best entity ids of the node (in 'topIds').
+  void build(uint32_t nodeId, std::vector<Node>& nodes,
+      std::vector<uint32_t>& topIds) const;
+
+  // Walks the given node (whose parent has the given depth) and its subtree.
+  // Appends the (node, PED) pairs that answer whole subtrees to buffers.nodes
+  // and the entities of matching strings that end at a visited node to
+  // buffers.candidates. The PED column of the path to the parent is in
+  // buffers.columns at the given depth; 'best' is the lowest value of the
+  // last row on that path, capped at delta + 1.
+  void search(uint32_t nodeId, uint32_t parentDepth, size_t best,
+      const std::string& x, size_t delta, MatchBuffers& buffers) const;
+
+  const QGramIndex* _index;
+  Column<String> _strings;
+  Column<Node> _nodes;
+
+  // The best (smallest) entity ids in the subtree of node i, ascending, are
+  // _topIds[i * TRIE_TOP_K] to _topIds[i * TRIE_TOP_K + numTop - 1].
+  Column<uint32_t> _topIds;
+
+  // The file the columns are mapped from, if any.
+  std::shared_ptr<const MappedFile> _file;
+};
+
+// Finds the k best matches of the given prefix with the trie if the prefix
+// is short, and with the q-gram index otherwise (or if the trie can't decide).
+// Prefixes of up to COMPLETION_MAX_LENGTH characters go to the completion
+// table of the q-gram index.
+// Same result and return value as QGramIndex::findTopMatches.
+size_t findTopMatches(const QGramIndex& index, const PrefixTrie& trie,
+    const std::string& prefix, size_t k, bool exactCount,
+    MatchBuffers& buffers, std::vector<Match>& matches, size_t& numFound,
+    bool& isExact);
+
+#endif  // PREFIXTRIE_H_
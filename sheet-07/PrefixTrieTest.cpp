@@ -0,0 +1,122 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+#include "./PrefixTrie.h"
+#include "./QGramIndex.h"
+#include "./TestHelpers.h"
+
+// _____________________________________________________________________________
+TEST(PrefixTrieTest, findTopMatches) {
+  QGramIndex index(3, true);
+  index.buildFromFile("example.tsv");
+  PrefixTrie trie(index);
+  // Root, "brei", "frei" (with "freiheit" below), "liberty" and the empty
+  // synonym of "brei" ends at the root.
+  ASSERT_EQ(5, trie.numNodes());
+
+  MatchBuffers buffers;
+  std::vector<Match> matches;
+  size_t numFound, numPed;
+  bool isExact;
+  ASSERT_TRUE(trie.findTopMatches("fr", 5, buffers, matches, numFound,
+      isExact, numPed));
+  ASSERT_EQ(1, matches.size());
+  ASSERT_EQ(1, matches[0].entityId);
+  ASSERT_EQ(NO_SYNONYM, matches[0].synonym);
+  ASSERT_TRUE(isExact);
+  ASSERT_EQ(1, numFound);
+
+  ASSERT_TRUE(trie.findTopMatches("Frei", 5, buffers, matches, numFound,
+      isExact, numPed));
+  ASSERT_EQ(2, matches.size());
+  ASSERT_EQ(2, matches[1].entityId);
+  ASSERT_EQ(1, matches[1].ped);
+
+  ASSERT_TRUE(trie.findTopMatches("libe", 5, buffers, matches, numFound,
+      isExact, numPed));
+  ASSERT_EQ(1, matches.size());
+  ASSERT_EQ(0, matches[0].ped);
+  ASSERT_EQ(1, matches[0].synonym);
+
+  ASSERT_FALSE(trie.findTopMatches("", 5, buffers, matches, numFound,
+      isExact, numPed));
+  ASSERT_FALSE(trie.findTopMatches("fr", TRIE_TOP_K + 1, buffers, matches,
+      numFound, isExact, numPed));
+}
+
+// _____________________________________________________________________________
+TEST(PrefixTrieTest, findTopMatchesRandom) {
+  // Random names and synonyms over a small alphabet, so that short prefixes
+  // have many matches, compared to the exact search of the q-gram index.
+  writeRandomEntities("PrefixTrieTest.TMP.tsv", 7, 3000, 5, 10);
+  std::mt19937 gen(7);
+  QGramIndex index(3, true);
+  index.buildFromFile("PrefixTrieTest.TMP.tsv");
+  PrefixTrie trie(index);
+  MatchBuffers buffers;
+  std::vector<Match> expected, actual;
+  size_t numFound, numFoundTrie, numPed;
+  bool isExact, isExactTrie;
+  size_t numAnswered = 0;
+  for (size_t k = 0; k < 300; k++) {
+    std::string query;
+    size_t length = 1 + gen() % 8;
+    for (size_t i = 0; i < length; i++) query += 'a' + gen() % 5;
+    index.findTopMatches(query, 5, true, buffers, expected, numFound,
+        isExact);
+    if (trie.findTopMatches(query, 5, buffers, actual, numFoundTrie,
+        isExactTrie, numPed)) {
+      numAnswered++;
+      EXPECT_EQ(expected, actual) << query;
+      if (isExactTrie) {
+        ASSERT_EQ(numFound, numFoundTrie) << query;
+      } else {
+        ASSERT_GE(numFoundTrie, numFound) << query;
+      }
+    }
+    findTopMatches(index, trie, query, 5, false, buffers, actual, numFound,
+        isExact);
+    EXPECT_EQ(expected, actual) << query;
+  }
+  ASSERT_GT(numAnswered, 250);
+}
+
+// _____________________________________________________________________________
+TEST(PrefixTrieTest, saveAndLoad) {
+  QGramIndex built(3, true);
+  built.buildFromFile("example.tsv");
+  PrefixTrie builtTrie(built);
+  built.save("PrefixTrieTest.TMP.bin");
+  builtTrie.save("PrefixTrieTest.TMP.trie");
+
+  QGramIndex index(3, true);
+  index.load("PrefixTrieTest.TMP.bin", true);
+  for (bool map : {true, false}) {
+    PrefixTrie trie(index, "PrefixTrieTest.TMP.trie", map);
+    ASSERT_EQ(builtTrie.numNodes(), trie.numNodes());
+    ASSERT_EQ(builtTrie.sizeInBytes(), trie.sizeInBytes());
+    MatchBuffers buffers;
+    std::vector<Match> expected, actual;
+    size_t numFound, numPed;
+    bool isExact;
+    for (const char* prefix : {"fr", "Frei", "libe", "freih"}) {
+      ASSERT_TRUE(builtTrie.findTopMatches(prefix, 5, buffers, expected,
+          numFound, isExact, numPed));
+      ASSERT_TRUE(trie.findTopMatches(prefix, 5, buffers, actual, numFound,
+          isExact, numPed));
+      EXPECT_EQ(expected, actual) << prefix;
+    }
+  }
+
+  // Without synonyms, the index has fewer strings than the trie.
+  QGramIndex other(3, false);
+  other.buildFromFile("example.tsv");
+  ASSERT_THROW(PrefixTrie(other, "PrefixTrieTest.TMP.trie", true),
+               std::runtime_error);
+  ASSERT_THROW(PrefixTrie(index, "PrefixTrieTest.TMP.bin", true),
+               std::runtime_error);
+}
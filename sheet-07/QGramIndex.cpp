@@ -6,238 +6,1392 @@
 
 #include <string>
 #include <vector>
+#include <cctype>
+#include <cstring>
 #include <fstream>
 #include <iostream>
-#include <queue>
+#include <functional>
 #include <algorithm>
-#include <limits>
+#include <chrono>
+#include <memory>
+#include <thread>
 
 #include "./QGramIndex.h"
+#include "./Normalizer.h"
+#include "./PrefixEditDistance.h"
 
-// _____________________________________________________________________________
-void QGramIndex::buildFromFile(const std::string& fileName) {
-  std::ifstream in(fileName.c_str(), std::ios_base::in);
+namespace {
 
-  // Ignore the first line (which includes the column headers).
-  std::string line;
-  std::getline(in, line);
+// The first bytes of a snapshot written by QGramIndex::save, and its version.
+const char SNAPSHOT_MAGIC[8] = {'Q', 'G', 'R', 'A', 'M', 'I', 'D', 'X'};
+const uint64_t SNAPSHOT_VERSION = 5;
 
-  // Iterate through the remaining lines.
-  while (std::getline(in, line)) {
-    // Split the line and fetch the several fields.
-    std::vector<std::string> parts = split(line, '\t');
+// Packs the first n <= MAX_Q characters of the given string into a QGram,
+// left aligned, so that integer order is string order for any length.
+QGram packPrefix(boost::string_ref str, size_t n) {
+  QGram packed = 0;
+  for (size_t i = 0; i < MAX_Q; ++i) {
+    unsigned char c = i < n ? str[i] : 0;
+    packed = (packed << 8) | c;
+  }
+  return packed;
+}
 
-    std::string name;
-    if (parts.size() > 0) { name = parts[0]; }
+// Like atoi, but for a string that doesn't need to be null-terminated.
+int parseInt(boost::string_ref str) {
+  size_t i = 0;
+  while (i < str.size() && std::isspace(str[i])) { i++; }
+  bool negative = i < str.size() && str[i] == '-';
+  if (i < str.size() && (str[i] == '-' || str[i] == '+')) { i++; }
+  unsigned int value = 0;
+  while (i < str.size() && std::isdigit(str[i])) {
+    value = 10 * value + (str[i++] - '0');
+  }
+  return negative ? -value : value;
+}
 
-    size_t score = 0;
-    if (parts.size() > 1) { score = atoi(parts[1].c_str()); }
+// Returns the given number of threads, or the number of hardware threads if
+// it is 0.
+size_t resolveNumThreads(size_t numThreads) {
+  if (numThreads > 0) { return numThreads; }
+  return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+}
 
-    std::string description;
-    if (parts.size() > 2) { description = parts[2]; }
+// Runs f(t) for t = 0 to numThreads - 1, each on its own thread (t = 0 on the
+// calling one), and waits for all of them.
+void runInParallel(size_t numThreads, const std::function<void(size_t)>& f) {
+  std::vector<std::thread> threads;
+  for (size_t t = 1; t < numThreads; t++) { threads.emplace_back(f, t); }
+  f(0);
+  for (std::thread& thread : threads) { thread.join(); }
+}
 
-    std::string wikipediaUrl;
-    if (parts.size() > 3) { wikipediaUrl = parts[3]; }
+// Returns the first of n items in part t of numThreads parts of about the
+// same size.
+size_t partBegin(size_t n, size_t t, size_t numThreads) {
+  return n * t / numThreads;
+}
 
-    std::string wikidataId;
-    if (parts.size() > 4) { wikidataId = parts[4]; }
+// Sorts the given vector stably: numThreads parts in parallel, then merges
+// the sorted parts pairwise, in parallel per round.
+template <typename T, typename Compare>
+void parallelStableSort(std::vector<T>& values, size_t numThreads,
+    Compare compare) {
+  std::vector<typename std::vector<T>::iterator> bounds;
+  for (size_t t = 0; t <= numThreads; t++) {
+    bounds.push_back(values.begin() + partBegin(values.size(), t, numThreads));
+  }
+  runInParallel(numThreads, [&](size_t t) {
+    std::stable_sort(bounds[t], bounds[t + 1], compare);
+  });
+  for (size_t width = 1; width < numThreads; width *= 2) {
+    runInParallel((numThreads + 2 * width - 1) / (2 * width), [&](size_t m) {
+      size_t first = 2 * width * m;
+      size_t middle = std::min(first + width, numThreads);
+      size_t last = std::min(first + 2 * width, numThreads);
+      std::inplace_merge(bounds[first], bounds[middle], bounds[last],
+          compare);
+    });
+  }
+}
 
-    std::vector<std::string> synonyms;
-    if (parts.size() > 5) { synonyms = split(parts[5], ';'); }
+// A score and the line of an entity in the input file.
+typedef std::pair<uint32_t, boost::string_ref> ScoredLine;
 
-    std::string imageUrl;
-    if (parts.size() > 6) { imageUrl = parts[6]; }
+// Per thread counts of the q-grams in a part of the strings: an open
+// addressing hash table like the dictionary of QGramIndex.
+struct QGramCounts {
+  QGramCounts() : slots(16, NO_QGRAM), counts(16, 0), numQGrams(0) {}
 
-    if (name.size() > 0) {
-      // Compute the q-grams of the entity name and add them to the index.
-      for (const std::string& qGram : computeQGrams(name)) {
-        _invertedLists[qGram].push_back(_entities.size() + 1);
+  // Adds one occurrence of the given q-gram.
+  void add(QGram qGram) {
+    size_t slot = find(qGram);
+    if (slots[slot] == NO_QGRAM) {
+      if (2 * (numQGrams + 1) > slots.size()) {
+        grow();
+        slot = find(qGram);
       }
+      slots[slot] = qGram;
+      numQGrams++;
+    }
+    counts[slot]++;
+  }
 
-      if (_withSynonyms) {
-        // Compute the q-grams of the synonyms and add them to the index.
-        for (const std::string& synonym : synonyms) {
-          for (const std::string& qGram : computeQGrams(synonym)) {
-            _invertedLists[qGram].push_back(_entities.size() + 1);
-          }
-        }
+  size_t find(QGram qGram) const {
+    size_t mask = slots.size() - 1;
+    size_t slot = QGramIndex::hashQGram(qGram) & mask;
+    while (slots[slot] != NO_QGRAM && slots[slot] != qGram) {
+      slot = (slot + 1) & mask;
+    }
+    return slot;
+  }
+
+  void grow() {
+    std::vector<QGram> oldSlots(2 * slots.size(), NO_QGRAM);
+    std::vector<uint32_t> oldCounts(2 * slots.size(), 0);
+    oldSlots.swap(slots);
+    oldCounts.swap(counts);
+    for (size_t i = 0; i < oldSlots.size(); ++i) {
+      if (oldSlots[i] == NO_QGRAM) { continue; }
+      size_t slot = find(oldSlots[i]);
+      slots[slot] = oldSlots[i];
+      counts[slot] = oldCounts[i];
+    }
+  }
+
+  std::vector<QGram> slots;
+  std::vector<uint32_t> counts;
+  size_t numQGrams;
+};
+
+// The hash of a word for the vocabulary: FNV-1a.
+inline size_t hashWord(boost::string_ref word) {
+  uint64_t hash = 0xCBF29CE484222325ull;
+  for (char c : word) {
+    hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001B3ull;
+  }
+  return hash ^ (hash >> 32);
+}
+
+// Charges the time between its laps to the stages of a query, if the given
+// times are enabled.
+class StageTimer {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  explicit StageTimer(StageTimes& times) : _times(times) {
+    if (_times.enabled) { _last = Clock::now(); }
+  }
+
+  // Adds the time since the previous lap (or the construction) to the stage.
+  void lap(QueryStage stage) {
+    if (!_times.enabled) { return; }
+    Clock::time_point now = Clock::now();
+    _times.seconds[stage] += std::chrono::duration<double>(now - _last).count();
+    _last = now;
+  }
+
+ private:
+  StageTimes& _times;
+  Clock::time_point _last;
+};
+}  // namespace
+
+// _____________________________________________________________________________
+void QGramIndex::buildFromFile(const std::string& fileName,
+    size_t numThreads) {
+  numThreads = resolveNumThreads(numThreads);
+  readEntities(fileName, numThreads);
+  buildInvertedLists(numThreads);
+  computeShards();
+}
+
+// _____________________________________________________________________________
+void QGramIndex::save(const std::string& fileName) const {
+  std::ofstream out(fileName.c_str(), std::ios_base::binary);
+  out.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+  uint64_t header[] = {SNAPSHOT_VERSION, _q, _withSynonyms, _numQGrams};
+  out.write(reinterpret_cast<const char*>(header), sizeof(header));
+  writeColumn(out, _qGramSlots);
+  _invertedLists.write(out);
+  writeColumn(out, _normalizedStrings);
+  writeColumn(out, _normalizedOffsets);
+  writeColumn(out, _synonymOffsets);
+  writeColumn(out, _stringEntities);
+  writeColumn(out, _stringSignatures);
+  writeColumn(out, _completionPrefixes);
+  writeColumn(out, _completionOffsets);
+  writeColumn(out, _completionIds);
+  writeColumn(out, _completionCounts);
+  writeColumn(out, _words);
+  writeColumn(out, _wordOffsets);
+  writeColumn(out, _wordQGrams);
+  _wordQGramLists.write(out);
+  _wordStrings.write(out);
+  writeColumn(out, _stringWords);
+  writeColumn(out, _stringWordOffsets);
+  _entities.write(out);
+  if (!out) {
+    throw std::runtime_error("could not write '" + fileName + "'");
+  }
+}
+
+// _____________________________________________________________________________
+void QGramIndex::load(const std::string& fileName, bool map) {
+  std::shared_ptr<const MappedFile> file(new MappedFile(fileName));
+  const char* pos = file->data();
+  const char* end = pos + file->size();
+  uint64_t header[4];
+  if (file->size() < sizeof(SNAPSHOT_MAGIC) + sizeof(header) ||
+      std::memcmp(pos, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+    throw std::runtime_error("'" + fileName + "' is no q-gram index");
+  }
+  pos += sizeof(SNAPSHOT_MAGIC);
+  std::memcpy(header, pos, sizeof(header));
+  pos += sizeof(header);
+  if (header[0] != SNAPSHOT_VERSION) {
+    throw std::runtime_error("'" + fileName + "' has an unknown version");
+  }
+  if (header[1] < 1 || header[1] > MAX_Q) {
+    throw std::runtime_error("inconsistent q-gram index");
+  }
+  _q = header[1];
+  _padding = std::string(_q - 1, '$');
+  _withSynonyms = header[2] != 0;
+  _numQGrams = header[3];
+
+  readColumn(pos, end, map, _qGramSlots);
+  _invertedLists.read(pos, end, map);
+  readColumn(pos, end, map, _normalizedStrings);
+  readColumn(pos, end, map, _normalizedOffsets);
+  readColumn(pos, end, map, _synonymOffsets);
+  readColumn(pos, end, map, _stringEntities);
+  readColumn(pos, end, map, _stringSignatures);
+  readColumn(pos, end, map, _completionPrefixes);
+  readColumn(pos, end, map, _completionOffsets);
+  readColumn(pos, end, map, _completionIds);
+  readColumn(pos, end, map, _completionCounts);
+  readColumn(pos, end, map, _words);
+  readColumn(pos, end, map, _wordOffsets);
+  readColumn(pos, end, map, _wordQGrams);
+  _wordQGramLists.read(pos, end, map);
+  _wordStrings.read(pos, end, map);
+  readColumn(pos, end, map, _stringWords);
+  readColumn(pos, end, map, _stringWordOffsets);
+  _entities.read(pos, end, map, file);
+  size_t numSlots = _qGramSlots.size();
+  if (numSlots == 0 || (numSlots & (numSlots - 1)) != 0 ||
+      _invertedLists.size() != numSlots ||
+      _normalizedOffsets.size() != _stringEntities.size() + 1 ||
+      _normalizedOffsets.back() != _normalizedStrings.size() ||
+      _stringSignatures.size() != _stringEntities.size() ||
+      _synonymOffsets.size() != _entities.size() + 1 ||
+      _completionOffsets.size() != _completionPrefixes.size() + 1 ||
+      _completionOffsets.back() != _completionIds.size() ||
+      _completionCounts.size() != _completionPrefixes.size() ||
+      _wordOffsets.size() != _wordStrings.size() + 1 ||
+      _wordOffsets.back() != _words.size() ||
+      _wordQGramLists.size() != _wordQGrams.size() ||
+      _stringWordOffsets.size() != _stringEntities.size() + 1 ||
+      _stringWordOffsets.back() != _stringWords.size()) {
+    throw std::runtime_error("inconsistent q-gram index");
+  }
+  _file = map ? file : nullptr;
+  computeShards();
+}
+
+// _____________________________________________________________________________
+void QGramIndex::readEntities(const std::string& fileName,
+    size_t numThreads) {
+  _entities.clear();
+
+  // Map the file. The fields are views on it until they are in the entity
+  // store. Like std::ifstream, take a file that can't be read as empty.
+  std::unique_ptr<MappedFile> file;
+  try {
+    file.reset(new MappedFile(fileName));
+  } catch (const std::runtime_error&) {
+    return;
+  }
+  boost::string_ref text(file->data(), file->size());
+
+  // Ignore the first line (which includes the column headers), and split the
+  // rest into one part per thread, at line starts.
+  const char* data = text.data();
+  const char* headerEnd = static_cast<const char*>(memchr(data, '\n',
+      text.size()));
+  if (!headerEnd) { return; }
+  std::vector<size_t> bounds(numThreads + 1, text.size());
+  bounds[0] = headerEnd + 1 - data;
+  for (size_t t = 1; t < numThreads; t++) {
+    size_t pos = std::max(bounds[0], partBegin(text.size(), t, numThreads));
+    const char* lineEnd = static_cast<const char*>(memchr(data + pos - 1, '\n',
+        text.size() - pos + 1));
+    bounds[t] = lineEnd ? lineEnd + 1 - data : text.size();
+  }
+
+  // Each thread remembers the lines with a name in its part, and their
+  // scores.
+  std::vector<std::vector<ScoredLine> > partLines(numThreads);
+  runInParallel(numThreads, [&](size_t t) {
+    std::vector<boost::string_ref> lineTexts, parts;
+    split(text.substr(bounds[t], bounds[t + 1] - bounds[t]), '\n',
+        lineTexts);
+    for (boost::string_ref line : lineTexts) {
+      split(line, '\t', parts);
+      if (parts[0].size() > 0) {
+        uint32_t score = parts.size() > 1 ? parseInt(parts[1]) : 0;
+        partLines[t].push_back(ScoredLine(score, line));
       }
+    }
+  });
+  std::vector<ScoredLine> lines;
+  for (std::vector<ScoredLine>& part : partLines) {
+    lines.insert(lines.end(), part.begin(), part.end());
+    std::vector<ScoredLine>().swap(part);
+  }
+
+  // Number the entities by popularity.
+  parallelStableSort(lines, numThreads,
+      [](const ScoredLine& first, const ScoredLine& second) {
+    return first.first > second.first;
+  });
 
-      // Cache the entity.
-      _entities.push_back(Entity(name, score, description, wikipediaUrl,
-          wikidataId, synonyms, imageUrl));
+  // Fetch the several fields and cache the entities: each thread fills a
+  // store with a range of the ids, of whole description blocks, and then the
+  // stores are concatenated.
+  std::vector<EntityStore> stores(numThreads);
+  size_t numBlocks = (lines.size() + DESCRIPTION_BLOCK_SIZE - 1) /
+      DESCRIPTION_BLOCK_SIZE;
+  runInParallel(numThreads, [&](size_t t) {
+    size_t begin = partBegin(numBlocks, t, numThreads) *
+        DESCRIPTION_BLOCK_SIZE;
+    size_t end = std::min(lines.size(),
+        partBegin(numBlocks, t + 1, numThreads) * DESCRIPTION_BLOCK_SIZE);
+    std::vector<boost::string_ref> parts, synonyms;
+    for (size_t i = begin; i < end; i++) {
+      split(lines[i].second, '\t', parts);
+      parts.resize(std::max<size_t>(parts.size(), 7));
+      // Like split(), an empty synonyms field gives one empty synonym, and no
+      // field gives none.
+      synonyms.clear();
+      if (parts[5].data()) { split(parts[5], ';', synonyms); }
+      stores[t].add(parts[0], lines[i].first, parts[2], parts[3], parts[4],
+          synonyms, parts[6]);
     }
+    stores[t].finish();
+  });
+  for (EntityStore& store : stores) {
+    _entities.append(store);
+    store.clear();
   }
 }
 
 // _____________________________________________________________________________
-std::vector<std::pair<size_t, size_t> > QGramIndex::mergeLists(
-      const std::vector<const std::vector<size_t>* >& lists) {
-  std::vector<std::pair<size_t, size_t>> res;
+void QGramIndex::buildInvertedLists(size_t numThreads) {
+  normalizeEntities(numThreads);
+  buildCompletionTable(numThreads);
+  buildWordIndex(numThreads);
 
-  // The current positions in each list while merging the lists.
-  // The element currentPositions[i] denotes the current position in list i.
-  std::vector<size_t> currentPositions;
-  currentPositions.resize(lists.size(), 0);
+  // First pass: each thread counts the q-grams of a range of the strings.
+  size_t numStrings = _stringEntities.size();
+  std::vector<QGramCounts> partCounts(numThreads);
+  runInParallel(numThreads, [&](size_t t) {
+    std::vector<QGram> qGrams;
+    for (uint32_t id = partBegin(numStrings, t, numThreads) + 1;
+         id <= partBegin(numStrings, t + 1, numThreads); ++id) {
+      qGrams.clear();
+      appendQGrams(normalizedString(id), qGrams);
+      for (QGram qGram : qGrams) { partCounts[t].add(qGram); }
+    }
+  });
 
-  // Introduce a priority queue with elements (element, listId), where
-  // 'element' is an element in one of the lists and 'listId' is the index of
-  // the corresponding list in 'lists'.
-  std::priority_queue<std::pair<size_t, size_t>,
-      std::vector<std::pair<size_t, size_t> >,
-      std::greater<std::pair<size_t, size_t> > > pq;
+  // Fill the dictionary with all q-grams that occur.
+  std::vector<QGram> slots(16, NO_QGRAM);
+  _numQGrams = 0;
+  for (const QGramCounts& counts : partCounts) {
+    for (QGram qGram : counts.slots) {
+      if (qGram == NO_QGRAM) { continue; }
+      size_t slot = findSlot(slots.data(), slots.size(), qGram);
+      if (slots[slot] != NO_QGRAM) { continue; }
+      // Keep the load factor below 1/2.
+      if (2 * (_numQGrams + 1) > slots.size()) {
+        growDictionary(slots);
+        slot = findSlot(slots.data(), slots.size(), qGram);
+      }
+      slots[slot] = qGram;
+      _numQGrams++;
+    }
+  }
+  _qGramSlots.assign(std::move(slots));
 
-  // Initially, put all first elements of each list into the queue.
-  for (size_t i = 0; i < lists.size(); ++i) {
-    if (lists[i]->size() > 0) {
-      pq.push(std::pair<size_t, size_t>((*lists[i])[0], i));
-      currentPositions[i]++;
+  // Turn the counts into offsets: the part of list i that thread t writes
+  // starts at next[t][i].
+  std::vector<std::vector<uint32_t> > next(numThreads,
+      std::vector<uint32_t>(_qGramSlots.size(), 0));
+  for (size_t t = 0; t < numThreads; t++) {
+    const QGramCounts& counts = partCounts[t];
+    for (size_t i = 0; i < counts.slots.size(); i++) {
+      if (counts.slots[i] == NO_QGRAM) { continue; }
+      next[t][findSlot(counts.slots[i])] = counts.counts[i];
+    }
+  }
+  std::vector<QGramCounts>().swap(partCounts);
+  std::vector<uint32_t> listOffsets(_qGramSlots.size() + 1, 0);
+  for (size_t i = 0; i < _qGramSlots.size(); ++i) {
+    uint32_t offset = listOffsets[i];
+    for (size_t t = 0; t < numThreads; t++) {
+      std::swap(offset, next[t][i]);
+      offset += next[t][i];
     }
+    listOffsets[i + 1] = offset;
   }
 
-  size_t curWordId = 0;
-  size_t matchesForWordId = 0;
+  // Second pass: write the string ids and the q-gram positions. Each thread
+  // goes through its strings in id order, and the parts of a list are in
+  // thread order, so every inverted list comes out sorted.
+  std::vector<uint32_t> listIds(listOffsets.back());
+  std::vector<uint8_t> listPositions(listOffsets.back());
+  runInParallel(numThreads, [&](size_t t) {
+    std::vector<QGram> qGrams;
+    for (uint32_t id = partBegin(numStrings, t, numThreads) + 1;
+         id <= partBegin(numStrings, t + 1, numThreads); ++id) {
+      qGrams.clear();
+      appendQGrams(normalizedString(id), qGrams);
+      for (size_t pos = 0; pos < qGrams.size(); ++pos) {
+        uint32_t element = next[t][findSlot(qGrams[pos])]++;
+        listIds[element] = id;
+        listPositions[element] = std::min<size_t>(pos, UINT8_MAX);
+      }
+    }
+  });
+
+  // Compress the lists, each thread a range of the slots.
+  std::vector<InvertedListStore> parts(numThreads);
+  runInParallel(numThreads, [&](size_t t) {
+    for (size_t i = partBegin(_qGramSlots.size(), t, numThreads);
+         i < partBegin(_qGramSlots.size(), t + 1, numThreads); i++) {
+      parts[t].add(listIds.data() + listOffsets[i],
+          listPositions.data() + listOffsets[i],
+          listOffsets[i + 1] - listOffsets[i]);
+    }
+  });
+  _invertedLists.clear();
+  for (const InvertedListStore& part : parts) { _invertedLists.append(part); }
+}
 
-  // Process the priority queue element-wise.
-  while (!pq.empty()) {
-    // Check if the id of the top element was already seen.
-    if (pq.top().first != curWordId) {
-      // The id wasn't seen already, add the pending pair to the result.
-      if (matchesForWordId > 0) {
-        res.push_back(std::pair<size_t, size_t>(curWordId, matchesForWordId));
+// _____________________________________________________________________________
+void QGramIndex::buildWordIndex(size_t numThreads) {
+  // Each thread splits a range of the strings into words. Since separators
+  // are all that normalizing drops between words, the words of a string are
+  // consecutive parts of its normalized form, so only their lengths are kept.
+  size_t numStrings = _stringEntities.size();
+  struct Part {
+    std::vector<uint32_t> wordLengths;
+    std::vector<uint32_t> numWords;
+  };
+  std::vector<Part> parts(numThreads);
+  runInParallel(numThreads, [&](size_t t) {
+    std::vector<std::string> words;
+    for (uint32_t id = partBegin(numStrings, t, numThreads) + 1;
+         id <= partBegin(numStrings, t + 1, numThreads); ++id) {
+      uint32_t entityId = stringEntity(id);
+      uint32_t synonym = stringSynonym(id);
+      boost::string_ref str = synonym == NO_SYNONYM ?
+          _entities.name(entityId) : _entities.synonym(entityId, synonym);
+      words.clear();
+      tokenizeUtf8(str.data(), str.size(), words);
+      for (const std::string& word : words) {
+        parts[t].wordLengths.push_back(word.size());
       }
-      curWordId = pq.top().first;
-      matchesForWordId = 0;
+      parts[t].numWords.push_back(words.size());
     }
+  });
+
+  // All occurrences of words, in string order.
+  std::vector<boost::string_ref> occurrences;
+  std::vector<uint32_t> stringWordOffsets(1, 0);
+  uint32_t id = 1;
+  for (Part& part : parts) {
+    size_t i = 0;
+    for (uint32_t numWords : part.numWords) {
+      boost::string_ref str = normalizedString(id++);
+      for (size_t j = 0; j < numWords; j++) {
+        occurrences.push_back(str.substr(0, part.wordLengths[i]));
+        str.remove_prefix(part.wordLengths[i++]);
+      }
+      stringWordOffsets.push_back(occurrences.size());
+    }
+    part = Part();
+  }
 
-    matchesForWordId++;
-    size_t listId = pq.top().second;
-    pq.pop();
+  // Number the distinct words in the order they first occur, with an open
+  // addressing hash table of these numbers, then renumber them in sorted
+  // order (sorting all occurrences takes much longer). The first 8
+  // characters, packed like a QGram, decide most comparisons.
+  struct NumberedWord {
+    NumberedWord(boost::string_ref word, uint32_t number) : word(word),
+        number(number), key(0) {
+      for (size_t i = 0; i < 8; i++) {
+        key = (key << 8) | (i < word.size() ?
+            static_cast<unsigned char>(word[i]) : 0);
+      }
+    }
+    boost::string_ref word;
+    uint32_t number;
+    uint64_t key;
+  };
+  std::vector<NumberedWord> distinct;
+  std::vector<uint32_t> stringWords(occurrences.size());
+  {
+    size_t mask = 15;
+    while (mask + 1 < 2 * occurrences.size()) { mask = 2 * mask + 1; }
+    std::vector<uint32_t> slots(mask + 1, UINT32_MAX);
+    for (size_t i = 0; i < occurrences.size(); i++) {
+      size_t slot = hashWord(occurrences[i]) & mask;
+      while (slots[slot] != UINT32_MAX &&
+          distinct[slots[slot]].word != occurrences[i]) {
+        slot = (slot + 1) & mask;
+      }
+      if (slots[slot] == UINT32_MAX) {
+        slots[slot] = distinct.size();
+        distinct.push_back(NumberedWord(occurrences[i], distinct.size()));
+      }
+      stringWords[i] = slots[slot];
+    }
+  }
+  std::vector<boost::string_ref>().swap(occurrences);
+  size_t numWords = distinct.size();
+  parallelStableSort(distinct, numThreads,
+      [](const NumberedWord& a, const NumberedWord& b) {
+    return a.key != b.key ? a.key < b.key : a.word < b.word;
+  });
+  std::vector<char> words;
+  std::vector<uint32_t> wordOffsets(1, 0);
+  std::vector<uint32_t> wordIds(numWords);
+  for (size_t i = 0; i < numWords; i++) {
+    words.insert(words.end(), distinct[i].word.begin(),
+        distinct[i].word.end());
+    wordOffsets.push_back(words.size());
+    wordIds[distinct[i].number] = i + 1;
+  }
+  for (uint32_t& wordId : stringWords) { wordId = wordIds[wordId]; }
+  std::vector<uint32_t>().swap(wordIds);
+  std::vector<NumberedWord>().swap(distinct);
 
-    // Add the next element of the corresponding list to the queue.
-    if (currentPositions[listId] < (*lists[listId]).size()) {
-      pq.push(std::pair<size_t, size_t>(
-          (*lists[listId])[currentPositions[listId]], listId));
-      currentPositions[listId]++;
+  // The strings of each word, with a counting sort over the words of the
+  // strings in id order (a word that occurs twice in a string counts once).
+  auto isRepeated = [&](uint32_t s, size_t i) {
+    for (size_t j = stringWordOffsets[s - 1]; j < i; j++) {
+      if (stringWords[j] == stringWords[i]) { return true; }
+    }
+    return false;
+  };
+  std::vector<uint32_t> listOffsets(numWords + 2, 0);
+  for (uint32_t s = 1; s <= numStrings; s++) {
+    for (size_t i = stringWordOffsets[s - 1]; i < stringWordOffsets[s]; i++) {
+      if (!isRepeated(s, i)) { listOffsets[stringWords[i] + 1]++; }
+    }
+  }
+  for (size_t w = 1; w < listOffsets.size(); w++) {
+    listOffsets[w] += listOffsets[w - 1];
+  }
+  std::vector<uint32_t> listIds(listOffsets.back());
+  std::vector<uint32_t> next(listOffsets.begin(), listOffsets.end() - 1);
+  for (uint32_t s = 1; s <= numStrings; s++) {
+    for (size_t i = stringWordOffsets[s - 1]; i < stringWordOffsets[s]; i++) {
+      if (!isRepeated(s, i)) { listIds[next[stringWords[i]]++] = s; }
     }
   }
+  _wordStrings.clear();
+  for (size_t w = 1; w <= numWords; w++) {
+    _wordStrings.add(listIds.data() + listOffsets[w],
+        nullptr, listOffsets[w + 1] - listOffsets[w]);
+  }
+  std::vector<uint32_t>().swap(listIds);
 
-  // Don't forget the last wordId:
-  if (matchesForWordId > 0) {
-    res.push_back(std::pair<size_t, size_t>(curWordId, matchesForWordId));
+  // The inverted lists of the q-grams of the words, with a counting sort
+  // over the q-grams of the words in id order, like buildInvertedLists().
+  auto forEachQGram = [&](const std::function<void(uint32_t, size_t,
+      QGram)>& f) {
+    std::vector<QGram> qGrams;
+    for (uint32_t w = 1; w <= numWords; w++) {
+      qGrams.clear();
+      appendQGrams(boost::string_ref(words.data() + wordOffsets[w - 1],
+          wordOffsets[w] - wordOffsets[w - 1]), qGrams);
+      for (size_t pos = 0; pos < qGrams.size(); pos++) {
+        f(w, pos, qGrams[pos]);
+      }
+    }
+  };
+  QGramCounts counts;
+  forEachQGram([&](uint32_t, size_t, QGram qGram) { counts.add(qGram); });
+  std::vector<QGram> wordQGrams;
+  for (QGram qGram : counts.slots) {
+    if (qGram != NO_QGRAM) { wordQGrams.push_back(qGram); }
+  }
+  std::sort(wordQGrams.begin(), wordQGrams.end());
+  std::vector<uint32_t> qGramOffsets(wordQGrams.size() + 1, 0);
+  std::vector<uint32_t> nextElement(counts.slots.size());
+  for (size_t i = 0; i < wordQGrams.size(); i++) {
+    size_t slot = counts.find(wordQGrams[i]);
+    qGramOffsets[i + 1] = qGramOffsets[i] + counts.counts[slot];
+    nextElement[slot] = qGramOffsets[i];
+  }
+  std::vector<uint32_t> ids(qGramOffsets.back());
+  std::vector<uint8_t> positions(qGramOffsets.back());
+  forEachQGram([&](uint32_t w, size_t pos, QGram qGram) {
+    uint32_t element = nextElement[counts.find(qGram)]++;
+    ids[element] = w;
+    positions[element] = std::min<size_t>(pos, UINT8_MAX);
+  });
+  _wordQGramLists.clear();
+  for (size_t i = 0; i < wordQGrams.size(); i++) {
+    _wordQGramLists.add(ids.data() + qGramOffsets[i],
+        positions.data() + qGramOffsets[i],
+        qGramOffsets[i + 1] - qGramOffsets[i]);
   }
 
-  return res;
+  _words.assign(std::move(words));
+  _wordOffsets.assign(std::move(wordOffsets));
+  _wordQGrams.assign(std::move(wordQGrams));
+  _stringWords.assign(std::move(stringWords));
+  _stringWordOffsets.assign(std::move(stringWordOffsets));
 }
 
 // _____________________________________________________________________________
-size_t QGramIndex::prefixEditDistance(const std::string& x,
-    const std::string& y, size_t delta) {
-  // Compute the dimensions of the matrix.
-  size_t n = x.size() + 1;
-  // Note that it is enough to compute the first |x| + δ + 1 columns.
-  size_t m = std::min(x.size() + delta + 1, y.size() + 1);
+void QGramIndex::setNumShards(size_t numShards) {
+  if (numShards < 1) {
+    throw std::invalid_argument("the number of shards must be at least 1");
+  }
+  _numShards = numShards;
+  computeShards();
+}
 
-  size_t matrix[n][m];
+// _____________________________________________________________________________
+void QGramIndex::computeShards() {
+  // Cut at the name of the entity of the first string of each part.
+  size_t numStrings = _stringEntities.size();
+  _shardStrings.assign(_numShards + 1, numStrings + 1);
+  for (size_t i = 0; i < _numShards; i++) {
+    size_t first = partBegin(numStrings, i, _numShards) + 1;
+    if (first <= numStrings) {
+      _shardStrings[i] = stringId(stringEntity(first), NO_SYNONYM);
+    }
+  }
+}
 
-  // Initialize the first column.
-  for (size_t i = 0; i < n; ++i) { matrix[i][0] = i; }
-  // Initialize the first row.
-  for (size_t i = 0; i < m; ++i) { matrix[0][i] = i; }
+// _____________________________________________________________________________
+void QGramIndex::growDictionary(std::vector<QGram>& slots) {
+  std::vector<QGram> oldSlots(2 * slots.size(), NO_QGRAM);
+  oldSlots.swap(slots);
+  for (size_t i = 0; i < oldSlots.size(); ++i) {
+    if (oldSlots[i] == NO_QGRAM) { continue; }
+    slots[findSlot(slots.data(), slots.size(), oldSlots[i])] = oldSlots[i];
+  }
+}
 
-  // Compute the rest of the matrix.
-  for (size_t i = 1; i < n; ++i) {
-    for (size_t j = 1; j < m; ++j) {
-      size_t s = (x[i - 1] == y[j - 1]) ? 0 : 1;
-      size_t replaceCosts = matrix[i - 1][j - 1] + s;
-      size_t addCosts = matrix[i][j - 1] + 1;
-      size_t deleteCosts = matrix[i - 1][j] + 1;
+// _____________________________________________________________________________
+void QGramIndex::normalizeEntities(size_t numThreads) {
+  // Each thread normalizes a range of the entities into per-thread columns
+  // (with offsets relative to its part), which are concatenated afterwards.
+  struct Part {
+    std::string strings;
+    std::vector<uint64_t> stringEnds;
+    std::vector<uint32_t> synonymOffsets;
+    std::vector<uint32_t> stringEntities;
+    std::vector<uint64_t> stringSignatures;
+  };
+  std::vector<Part> parts(numThreads);
+  runInParallel(numThreads, [&](size_t t) {
+    Part& part = parts[t];
+    uint32_t numSynonyms = 0;
+    for (size_t i = partBegin(_entities.size(), t, numThreads);
+         i < partBegin(_entities.size(), t + 1, numThreads); ++i) {
+      size_t numStrings = _withSynonyms ? 1 + _entities.numSynonyms(i + 1) : 1;
+      for (size_t j = 0; j < numStrings; j++) {
+        boost::string_ref str = j == 0 ? _entities.name(i + 1) :
+            _entities.synonym(i + 1, j - 1);
+        size_t begin = part.strings.size();
+        appendNormalized(str.data(), str.size(), part.strings);
+        boost::string_ref normalized(part.strings.data() + begin,
+            part.strings.size() - begin);
+        part.stringEnds.push_back(part.strings.size());
+        part.stringEntities.push_back(i + 1);
+        part.stringSignatures.push_back(computeSignature(normalized));
+      }
+      numSynonyms += numStrings - 1;
+      part.synonymOffsets.push_back(numSynonyms);
+    }
+  });
 
-      matrix[i][j] = std::min(std::min(replaceCosts, addCosts), deleteCosts);
+  std::vector<char> strings;
+  std::vector<uint64_t> offsets(1, 0);
+  std::vector<uint32_t> synonymOffsets(1, 0);
+  std::vector<uint32_t> stringEntities;
+  std::vector<uint64_t> stringSignatures;
+  for (Part& part : parts) {
+    uint64_t stringBase = strings.size();
+    uint32_t synonymBase = synonymOffsets.back();
+    strings.insert(strings.end(), part.strings.begin(), part.strings.end());
+    for (uint64_t end : part.stringEnds) {
+      offsets.push_back(stringBase + end);
+    }
+    for (uint32_t offset : part.synonymOffsets) {
+      synonymOffsets.push_back(synonymBase + offset);
     }
+    stringEntities.insert(stringEntities.end(), part.stringEntities.begin(),
+        part.stringEntities.end());
+    stringSignatures.insert(stringSignatures.end(),
+        part.stringSignatures.begin(), part.stringSignatures.end());
+    part = Part();
   }
+  _normalizedStrings.assign(std::move(strings));
+  _normalizedOffsets.assign(std::move(offsets));
+  _synonymOffsets.assign(std::move(synonymOffsets));
+  _stringEntities.assign(std::move(stringEntities));
+  _stringSignatures.assign(std::move(stringSignatures));
+}
 
-  // Search the last row for the minimum value.
-  size_t minDelta = delta + 1;
-  for (size_t i = 0; i < m; ++i) {
-    if (matrix[n - 1][i] < minDelta) {
-      minDelta = matrix[n - 1][i];
+// _____________________________________________________________________________
+uint64_t QGramIndex::computeSignature(boost::string_ref normalized) {
+  // Bits 0 to 25 for a to z, 26 to 35 for 0 to 9, 36 to 61 for a second a to
+  // z, and 62 and 63 for other characters.
+  uint64_t signature = 0;
+  for (char c : normalized) {
+    uint64_t once, twice;
+    if (c >= 'a' && c <= 'z') {
+      once = static_cast<uint64_t>(1) << (c - 'a');
+      twice = once << 36;
+    } else if (c >= '0' && c <= '9') {
+      once = static_cast<uint64_t>(1) << (26 + c - '0');
+      twice = once;
+    } else {
+      once = static_cast<uint64_t>(1) << 62;
+      twice = static_cast<uint64_t>(1) << 63;
     }
+    signature |= (signature & once) ? twice : once;
+  }
+  return signature;
+}
+
+// _____________________________________________________________________________
+size_t QGramIndex::findSlot(QGram qGram) const {
+  return findSlot(_qGramSlots.data(), _qGramSlots.size(), qGram);
+}
+
+// _____________________________________________________________________________
+size_t QGramIndex::findSlot(const QGram* slots, size_t numSlots,
+    QGram qGram) {
+  // Linear probing.
+  size_t mask = numSlots - 1;
+  size_t slot = hashQGram(qGram) & mask;
+  while (slots[slot] != NO_QGRAM && slots[slot] != qGram) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+// _____________________________________________________________________________
+InvertedList QGramIndex::getInvertedList(QGram qGram) const {
+  if (_qGramSlots.empty()) { return InvertedList(); }
+  size_t slot = findSlot(qGram);
+  if (_qGramSlots[slot] == NO_QGRAM) { return InvertedList(); }
+  return _invertedLists.list(slot);
+}
+
+// _____________________________________________________________________________
+size_t QGramIndex::sizeInBytes() const {
+  return _qGramSlots.sizeInBytes() + _invertedLists.sizeInBytes()
+      + _stringEntities.sizeInBytes() + _completionPrefixes.sizeInBytes()
+      + _completionOffsets.sizeInBytes() + _completionIds.sizeInBytes()
+      + _completionCounts.sizeInBytes() + _words.sizeInBytes()
+      + _wordOffsets.sizeInBytes() + _wordQGrams.sizeInBytes()
+      + _wordQGramLists.sizeInBytes() + _wordStrings.sizeInBytes()
+      + _stringWords.sizeInBytes() + _stringWordOffsets.sizeInBytes();
+}
+
+// _____________________________________________________________________________
+std::vector<std::pair<size_t, size_t> > QGramIndex::mergeLists(
+      const std::vector<InvertedList>& lists) {
+  std::vector<std::pair<size_t, size_t>> res;
+  ListMerger merger;
+  merger.reset(lists);
+  size_t id, count;
+  while (merger.next(id, count)) {
+    res.push_back(std::pair<size_t, size_t>(id, count));
   }
+  return res;
+}
 
-  return minDelta;
+// _____________________________________________________________________________
+size_t QGramIndex::prefixEditDistance(const std::string& x,
+    const std::string& y, size_t delta) {
+  return PedPattern(x).compute(y, delta);
 }
 
 // _____________________________________________________________________________
 std::pair<std::vector<Entity>, size_t> QGramIndex::findMatches(
     const std::string& prefix) const {
+  MatchBuffers buffers;
+  std::vector<Match> records;
+  size_t numPedComputations = findMatches(prefix, buffers, records);
+
   std::vector<Entity> matches;
+  matches.reserve(records.size());
+  for (const Match& match : records) {
+    matches.push_back(materialize(match));
+  }
+  return std::pair<std::vector<Entity>, size_t>(matches, numPedComputations);
+}
+
+// _____________________________________________________________________________
+size_t QGramIndex::findMatches(const std::string& prefix,
+    MatchBuffers& buffers, std::vector<Match>& matches) const {
+  return findRangeMatches(prefix, 1, _stringEntities.size() + 1, buffers,
+      matches);
+}
+
+// _____________________________________________________________________________
+size_t QGramIndex::findShardMatches(const std::string& prefix, size_t shard,
+    MatchBuffers& buffers, std::vector<Match>& matches) const {
+  return findRangeMatches(prefix, _shardStrings[shard],
+      _shardStrings[shard + 1], buffers, matches);
+}
+
+// _____________________________________________________________________________
+size_t QGramIndex::findRangeMatches(const std::string& prefix,
+    uint32_t beginString, uint32_t endString, MatchBuffers& buffers,
+    std::vector<Match>& matches) const {
+  matches.clear();
+  size_t numPedComputations = matchWords(prefix, buffers);
+  if (buffers.words.size() > 1) {
+    intersectWordMatches(buffers, beginString, endString, buffers, matches);
+  } else {
+    size_t delta = startQuery(prefix, beginString, endString, buffers);
+    while (verifyNextCandidates(buffers, delta, VERIFY_BATCH_SIZE, matches,
+        numPedComputations)) {}
+  }
+
+  // Rank the matches.
+  StageTimer timer(buffers.times);
+  rankMatches(matches);
+  timer.lap(STAGE_RANK);
+  return numPedComputations;
+}
+
+// _____________________________________________________________________________
+size_t QGramIndex::findTopMatches(const std::string& prefix, size_t k,
+    bool exactCount, MatchBuffers& buffers, std::vector<Match>& matches,
+    size_t& numFound, bool& isExact) const {
+  buffers.stats = FilterStats();
+  if (!hasSeveralWords(prefix) &&
+      findCompletions(normalize(prefix), k, matches, numFound)) {
+    isExact = true;
+    return 0;
+  }
+  return findTopRangeMatches(prefix, 1, _stringEntities.size() + 1, k,
+      exactCount, buffers, matches, numFound, isExact);
+}
+
+// _____________________________________________________________________________
+size_t QGramIndex::findTopShardMatches(const std::string& prefix,
+    size_t shard, size_t k, bool exactCount, MatchBuffers& buffers,
+    std::vector<Match>& matches, size_t& numFound, bool& isExact) const {
+  return findTopRangeMatches(prefix, _shardStrings[shard],
+      _shardStrings[shard + 1], k, exactCount, buffers, matches, numFound,
+      isExact);
+}
+
+// _____________________________________________________________________________
+size_t QGramIndex::findTopRangeMatches(const std::string& prefix,
+    uint32_t beginString, uint32_t endString, size_t k, bool exactCount,
+    MatchBuffers& buffers, std::vector<Match>& matches, size_t& numFound,
+    bool& isExact) const {
+  matches.clear();
+  isExact = true;
+  size_t numPedComputations = matchWords(prefix, buffers);
+  if (buffers.words.size() > 1) {
+    // The word matches don't come in score order, so there is no early stop.
+    intersectWordMatches(buffers, beginString, endString, buffers, matches);
+    numFound = matches.size();
+  } else {
+    numPedComputations = verifyTopCandidates(prefix, beginString, endString,
+        k, exactCount, buffers, matches, numFound, isExact);
+  }
+  rankTopMatches(k, buffers, matches);
+  return numPedComputations;
+}
+
+// _____________________________________________________________________________
+void QGramIndex::findShardWordMatches(const MatchBuffers& words, size_t shard,
+    size_t k, MatchBuffers& buffers, std::vector<Match>& matches,
+    size_t& numFound) const {
+  intersectWordMatches(words, _shardStrings[shard], _shardStrings[shard + 1],
+      buffers, matches);
+  numFound = matches.size();
+  rankTopMatches(k, buffers, matches);
+}
+
+// _____________________________________________________________________________
+void QGramIndex::rankTopMatches(size_t k, MatchBuffers& buffers,
+    std::vector<Match>& matches) const {
+  StageTimer timer(buffers.times);
+  size_t numTop = std::min(k, matches.size());
+  std::partial_sort(matches.begin(), matches.begin() + numTop, matches.end(),
+      _matchComparator);
+  matches.resize(numTop);
+  timer.lap(STAGE_RANK);
+}
+
+// _____________________________________________________________________________
+size_t QGramIndex::verifyTopCandidates(const std::string& prefix,
+    uint32_t beginString, uint32_t endString, size_t k, bool exactCount,
+    MatchBuffers& buffers, std::vector<Match>& matches, size_t& numFound,
+    bool& isExact) const {
   size_t numPedComputations = 0;
+  size_t numPerfectMatches = 0;
+  size_t delta = startQuery(prefix, beginString, endString, buffers);
+  while (true) {
+    size_t numOldMatches = matches.size();
+    if (!verifyNextCandidates(buffers, delta, VERIFY_BATCH_SIZE, matches,
+        numPedComputations)) {
+      break;
+    }
+    if (exactCount) { continue; }
+
+    // All later candidates have a larger id, that is, a smaller or equal
+    // score. So once there are k matches with PED 0, they are the top k.
+    for (size_t i = numOldMatches; i < matches.size(); i++) {
+      if (matches[i].ped == 0) { numPerfectMatches++; }
+    }
+    if (numPerfectMatches >= k) {
+      const CountFilter& filter = buffers.countFilter;
+      isExact = filter.numConsumed() == filter.numTotal() &&
+          filter.numFound() == filter.numReturned();
+      break;
+    }
+  }
+
+  numFound = matches.size();
+  if (!isExact) {
+    // Assume that the rest of the lists yields candidates at the same rate,
+    // and that the remaining candidates match at the same rate.
+    const CountFilter& filter = buffers.countFilter;
+    double numCandidates = 1.0 * filter.numFound() * filter.numTotal() /
+        filter.numConsumed();
+    numFound = static_cast<size_t>(matches.size() * numCandidates /
+        filter.numReturned() + 0.5);
+  }
+  return numPedComputations;
+}
+
+// _____________________________________________________________________________
+bool QGramIndex::hasSeveralWords(boost::string_ref prefix) {
+  std::vector<std::string> words;
+  tokenizeUtf8(prefix.data(), prefix.size(), words);
+  return words.size() > 1;
+}
+
+// _____________________________________________________________________________
+size_t QGramIndex::matchWord(const std::string& word, bool isPrefix,
+    MatchBuffers& buffers,
+    std::vector<std::pair<uint32_t, uint32_t> >& matches) const {
+  matches.clear();
+  size_t delta = word.size() / 4;
+  if (delta == 0) {
+    // Only the word itself, or the words that start with it: a range of the
+    // sorted vocabulary.
+    boost::string_ref x(word);
+    uint32_t first = 1, last = numWords() + 1;
+    while (first < last) {
+      uint32_t middle = first + (last - first) / 2;
+      if (this->word(middle) < x) {
+        first = middle + 1;
+      } else {
+        last = middle;
+      }
+    }
+    for (uint32_t id = first; id <= numWords(); id++) {
+      boost::string_ref y = this->word(id);
+      if (isPrefix ? !y.starts_with(x) : y != x) { break; }
+      matches.push_back(std::make_pair(id, 0));
+    }
+    return 0;
+  }
+
+  // The count filter on the q-grams of the words, like in startQuery(), and
+  // the (prefix) edit distance of the candidates.
+  buffers.lists.clear();
+  buffers.qGrams.clear();
+  appendQGrams(word, buffers.qGrams);
+  for (size_t i = 0; i < buffers.qGrams.size(); ++i) {
+    auto it = std::lower_bound(_wordQGrams.begin(), _wordQGrams.end(),
+        buffers.qGrams[i]);
+    if (it == _wordQGrams.end() || *it != buffers.qGrams[i]) { continue; }
+    InvertedList list = _wordQGramLists.list(it - _wordQGrams.begin());
+    list.minPosition = std::min<size_t>(i - std::min(i, delta), UINT8_MAX);
+    list.maxPosition = std::min<size_t>(i + delta, UINT8_MAX);
+    buffers.lists.push_back(list);
+  }
+  int threshold = word.size() - _q * delta;
+  buffers.countFilter.reset(buffers.lists, std::max(threshold, 1));
+  buffers.candidates.clear();
+  while (buffers.countFilter.next(VERIFY_BATCH_SIZE, buffers.candidates)) {}
+  buffers.pattern.assign(word);
+  size_t numComputations = 0;
+  for (uint32_t id : buffers.candidates) {
+    // The length filter: a word within delta is at most delta shorter (and,
+    // for the edit distance, longer).
+    boost::string_ref y = this->word(id);
+    if (y.size() + delta < word.size() ||
+        (!isPrefix && y.size() > word.size() + delta)) {
+      continue;
+    }
+    size_t distance = isPrefix ? buffers.pattern.compute(y, delta) :
+        buffers.pattern.computeEditDistance(y, delta);
+    numComputations++;
+    if (distance <= delta) { matches.push_back(std::make_pair(id, distance)); }
+  }
+  return numComputations;
+}
+
+// _____________________________________________________________________________
+size_t QGramIndex::matchWords(const std::string& prefix,
+    MatchBuffers& buffers) const {
+  buffers.words.clear();
+  tokenizeUtf8(prefix.data(), prefix.size(), buffers.words);
+  const std::vector<std::string>& words = buffers.words;
+  if (words.size() < 2) { return 0; }
+  StageTimer timer(buffers.times);
+  std::vector<std::vector<std::pair<uint32_t, uint32_t> > >& wordMatches =
+      buffers.wordMatches;
+  if (wordMatches.size() < words.size()) { wordMatches.resize(words.size()); }
+  size_t numComputations = 0;
+  for (size_t i = 0; i < words.size(); i++) {
+    numComputations += matchWord(words[i], i + 1 == words.size(), buffers,
+        wordMatches[i]);
+  }
+  timer.lap(STAGE_LOOKUP);
+  return numComputations;
+}
+
+// _____________________________________________________________________________
+void QGramIndex::intersectWordMatches(const MatchBuffers& words,
+    uint32_t beginString, uint32_t endString, MatchBuffers& buffers,
+    std::vector<Match>& matches) const {
+  StageTimer timer(buffers.times);
+  buffers.stats = FilterStats();
+  size_t numQueryWords = words.words.size();
+  const std::vector<std::vector<std::pair<uint32_t, uint32_t> > >&
+      wordMatches = words.wordMatches;
+
+  // Start from the word whose matches occur in the fewest strings.
+  size_t first = 0;
+  size_t firstSize = SIZE_MAX;
+  for (size_t i = 0; i < numQueryWords; i++) {
+    size_t size = 0;
+    for (const std::pair<uint32_t, uint32_t>& match : wordMatches[i]) {
+      size += _wordStrings.list(match.first - 1).size;
+    }
+    if (size < firstSize) {
+      first = i;
+      firstSize = size;
+    }
+  }
+
+  // The strings in the range with a match of that word, and the distance of
+  // the best one.
+  std::vector<std::pair<uint32_t, uint32_t> >& strings = buffers.stringMatches;
+  strings.clear();
+  bool isSlice = beginString > 1 || endString <= _stringEntities.size();
+  ListCursor cursor;
+  for (const std::pair<uint32_t, uint32_t>& match : wordMatches[first]) {
+    InvertedList list = _wordStrings.list(match.first - 1);
+    if (isSlice) { list = sliceList(list, beginString, endString); }
+    for (cursor.reset(list); !cursor.done(); cursor.next()) {
+      strings.push_back(std::make_pair(cursor.id(), match.second));
+    }
+  }
+  std::sort(strings.begin(), strings.end());
+  strings.erase(std::unique(strings.begin(), strings.end(),
+      [](const std::pair<uint32_t, uint32_t>& a,
+         const std::pair<uint32_t, uint32_t>& b) {
+    return a.first == b.first;
+  }), strings.end());
+
+  // Keep the strings that also have a match of each other word, by the words
+  // of the strings, and add the distance of the best one.
+  std::vector<uint32_t>& distances = buffers.wordDistances;
+  distances.resize(numWords() + 1, 0);
+  for (size_t i = 0; i < numQueryWords && !strings.empty(); i++) {
+    if (i == first) { continue; }
+    for (const std::pair<uint32_t, uint32_t>& match : wordMatches[i]) {
+      distances[match.first] = match.second + 1;
+    }
+    size_t numKept = 0;
+    for (const std::pair<uint32_t, uint32_t>& string : strings) {
+      uint32_t best = 0;
+      for (size_t j = _stringWordOffsets[string.first - 1];
+           j < _stringWordOffsets[string.first]; j++) {
+        uint32_t distance = distances[_stringWords[j]];
+        if (distance > 0 && (best == 0 || distance < best)) { best = distance; }
+      }
+      if (best > 0) {
+        strings[numKept++] = std::make_pair(string.first,
+            string.second + best - 1);
+      }
+    }
+    strings.resize(numKept);
+    for (const std::pair<uint32_t, uint32_t>& match : wordMatches[i]) {
+      distances[match.first] = 0;
+    }
+  }
 
-  std::string nPrefix = normalize(prefix);
+  // One match per entity, as in verifyNextCandidates().
+  matches.clear();
+  for (const std::pair<uint32_t, uint32_t>& string : strings) {
+    Match match(stringEntity(string.first), string.second,
+        stringSynonym(string.first));
+    if (!matches.empty() && matches.back().entityId == match.entityId) {
+      Match& last = matches.back();
+      if (last.synonym != NO_SYNONYM && match.ped < last.ped) { last = match; }
+      continue;
+    }
+    matches.push_back(match);
+  }
+  timer.lap(STAGE_MERGE);
+}
+
+// _____________________________________________________________________________
+size_t QGramIndex::findCandidates(const std::string& prefix,
+    MatchBuffers& buffers, std::vector<uint32_t>& candidates) const {
+  candidates.clear();
+  size_t delta = startQuery(prefix, 1, _stringEntities.size() + 1, buffers);
+  while (buffers.countFilter.next(VERIFY_BATCH_SIZE, candidates)) {}
+  filterCandidates(buffers, delta, candidates);
+  return delta;
+}
+
+// _____________________________________________________________________________
+void QGramIndex::buildCompletionTable(size_t numThreads) {
+  // All (prefix, id) pairs, one per entity and distinct prefix of its name
+  // and synonyms, sorted. Each thread collects the pairs of a range of the
+  // entities.
+  std::vector<std::vector<uint64_t> > partPairs(numThreads);
+  size_t numEntities = _entities.size();
+  runInParallel(numThreads, [&](size_t t) {
+    std::vector<QGram> prefixes;
+    for (size_t i = partBegin(numEntities, t, numThreads);
+         i < partBegin(numEntities, t + 1, numThreads); ++i) {
+      prefixes.clear();
+      uint32_t name = stringId(i + 1, NO_SYNONYM);
+      for (uint32_t j = name; j <= name + numIndexedSynonyms(i + 1); ++j) {
+        boost::string_ref str = normalizedString(j);
+        size_t maxLength = std::min(str.size(), COMPLETION_MAX_LENGTH);
+        for (size_t n = 1; n <= maxLength; ++n) {
+          prefixes.push_back(packPrefix(str, n));
+        }
+      }
+      std::sort(prefixes.begin(), prefixes.end());
+      prefixes.erase(std::unique(prefixes.begin(), prefixes.end()),
+          prefixes.end());
+      for (QGram prefix : prefixes) {
+        partPairs[t].push_back((static_cast<uint64_t>(prefix) << 32) |
+            (i + 1));
+      }
+    }
+  });
+  std::vector<uint64_t> pairs;
+  for (std::vector<uint64_t>& part : partPairs) {
+    pairs.insert(pairs.end(), part.begin(), part.end());
+    std::vector<uint64_t>().swap(part);
+  }
+  parallelStableSort(pairs, numThreads, std::less<uint64_t>());
+
+  // One entry per prefix, with the smallest (best) ids.
+  std::vector<QGram> completionPrefixes;
+  std::vector<uint32_t> completionOffsets(1, 0);
+  std::vector<uint32_t> completionIds;
+  std::vector<uint32_t> completionCounts;
+  for (size_t i = 0; i < pairs.size(); ++i) {
+    QGram prefix = pairs[i] >> 32;
+    if (completionPrefixes.empty() || completionPrefixes.back() != prefix) {
+      completionPrefixes.push_back(prefix);
+      completionCounts.push_back(0);
+      completionOffsets.push_back(completionIds.size());
+    }
+    if (completionCounts.back()++ < COMPLETION_TOP_N) {
+      completionIds.push_back(static_cast<uint32_t>(pairs[i]));
+      completionOffsets.back()++;
+    }
+  }
+  _completionPrefixes.assign(std::move(completionPrefixes));
+  _completionOffsets.assign(std::move(completionOffsets));
+  _completionIds.assign(std::move(completionIds));
+  _completionCounts.assign(std::move(completionCounts));
+}
+
+// _____________________________________________________________________________
+size_t QGramIndex::startQuery(const std::string& prefix,
+    uint32_t beginString, uint32_t endString, MatchBuffers& buffers) const {
+  StageTimer timer(buffers.times);
+  buffers.prefix = normalize(prefix);
+  const std::string& nPrefix = buffers.prefix;
+  buffers.lists.clear();
+  buffers.stats = FilterStats();
+  buffers.signature = computeSignature(nPrefix);
+
+  // Entities y with PED(x, y) <= delta share at least |x| - q * delta
+  // q-grams with x. An optimal alignment of x with a prefix of y leaves these
+  // q-grams untouched, so their positions in x and y differ by <= delta.
   size_t delta = nPrefix.size() / 4;
-  int threshold = nPrefix.size() - (_q * delta);
+  int threshold = nPrefix.size() - _q * delta;
+  bool isSlice = beginString > 1 || endString <= _stringEntities.size();
 
   if (nPrefix.size() > 0) {
+    // Preprocess the prefix once, for all candidates.
+    buffers.pattern.assign(nPrefix);
+    timer.lap(STAGE_NORMALIZE);
+
     // Fetch all the inverted lists for each q-gram of the prefix.
-    std::vector<const std::vector<size_t>*> lists;
-    for (const std::string& qGram : computeQGrams(nPrefix)) {
-      auto it = _invertedLists.find(qGram);
-      if (it != _invertedLists.end()) {
-        lists.push_back(&it->second);
+    buffers.qGrams.clear();
+    appendQGrams(nPrefix, buffers.qGrams);
+    for (size_t i = 0; i < buffers.qGrams.size(); ++i) {
+      InvertedList list = getInvertedList(buffers.qGrams[i]);
+      if (isSlice) { list = sliceList(list, beginString, endString); }
+      if (list.size > 0) {
+        // The positions in the lists are capped at 255.
+        list.minPosition = std::min<size_t>(i - std::min(i, delta),
+            UINT8_MAX);
+        list.maxPosition = std::min<size_t>(i + delta, UINT8_MAX);
+        buffers.lists.push_back(list);
       }
     }
+  }
+  buffers.countFilter.reset(buffers.lists, std::max(threshold, 1));
+  timer.lap(STAGE_LOOKUP);
+  return delta;
+}
+
+// _____________________________________________________________________________
+bool QGramIndex::verifyNextCandidates(MatchBuffers& buffers, size_t delta,
+    size_t maxCandidates, std::vector<Match>& matches,
+    size_t& numPedComputations) const {
+  // Collect the next names and synonyms where comm(x,y) >= |x| - q * delta,
+  // filter them and verify the ones that pass in one batch.
+  std::vector<uint32_t>& candidates = buffers.candidates;
+  std::vector<boost::string_ref>& names = buffers.names;
+  candidates.clear();
+  names.clear();
+  StageTimer timer(buffers.times);
+  size_t numCandidates = buffers.countFilter.next(maxCandidates, candidates);
+  timer.lap(STAGE_MERGE);
+  if (numCandidates == 0) { return false; }
+  filterCandidates(buffers, delta, candidates);
+  timer.lap(STAGE_FILTER);
+  for (uint32_t id : candidates) {
+    names.push_back(normalizedString(id));
+  }
+  buffers.peds.resize(names.size());
+  buffers.pattern.computeBatch(names.data(), names.size(), delta,
+      buffers.peds.data());
+  numPedComputations += names.size();
+
+  // One match per entity: the name if it matches, otherwise the best matching
+  // synonym (lowest PED, the first one on ties). The strings of an entity
+  // are consecutive, name first, but may continue in the next batch.
+  for (size_t i = 0; i < candidates.size(); i++) {
+    if (buffers.peds[i] > delta) { continue; }
+    Match match(stringEntity(candidates[i]), buffers.peds[i],
+        stringSynonym(candidates[i]));
+    if (!matches.empty() && matches.back().entityId == match.entityId) {
+      Match& last = matches.back();
+      if (last.synonym != NO_SYNONYM && match.ped < last.ped) { last = match; }
+      continue;
+    }
+    matches.push_back(match);
+  }
+  timer.lap(STAGE_PED);
+  return true;
+}
 
-    for (const std::pair<size_t, size_t>& pair : mergeLists(lists)) {
-      size_t id = pair.first;
-      size_t freq = pair.second;
-      Entity entity = _entities[id - 1];  // ids are 1-based.
+// _____________________________________________________________________________
+void QGramIndex::filterCandidates(MatchBuffers& buffers, size_t delta,
+    std::vector<uint32_t>& candidates) const {
+  size_t numKept = 0;
+  for (uint32_t id : candidates) {
+    if (passesStringFilters(buffers, delta, normalizedString(id),
+        _stringSignatures[id - 1], &buffers.stats)) {
+      candidates[numKept++] = id;
+    }
+  }
+  candidates.resize(numKept);
+  buffers.stats.numPosition = buffers.countFilter.numPositionDropped();
+}
 
-      // Compute the PED for all entities where comm(x,y) >= |x| - q * delta.
-      if (static_cast<int>(freq) >= threshold) {
-        // Compute the PED to the name of the entity.
-        size_t ped = prefixEditDistance(nPrefix, normalize(entity.name), delta);
-        numPedComputations++;
+// _____________________________________________________________________________
+bool QGramIndex::findCompletions(const std::string& normalized, size_t k,
+    std::vector<Match>& matches, size_t& numFound) const {
+  size_t n = normalized.size();
+  if (n == 0 || n > COMPLETION_MAX_LENGTH || k > COMPLETION_TOP_N) {
+    return false;
+  }
 
-        if (ped <= delta) {
-          entity.ped = ped;
-          entity.matchedSynonym.clear();
-          matches.push_back(entity);
-          continue;
-        }
+  // A binary search in a table of at most a few 10000 prefixes, whatever the
+  // number of entities.
+  QGram packed = packPrefix(normalized, n);
+  auto it = std::lower_bound(_completionPrefixes.begin(),
+      _completionPrefixes.end(), packed);
+  matches.clear();
+  numFound = 0;
+  if (it == _completionPrefixes.end() || *it != packed) { return true; }
+  size_t i = it - _completionPrefixes.begin();
+  numFound = _completionCounts[i];
 
-        if (_withSynonyms) {
-          // Compute the best matching synonym (the synonym with lowest PED).
-          std::string bestMatchingSynonym;
-          size_t bestPed = std::numeric_limits<std::size_t>::max();
-
-          // Iterate through all synonyms and compute PED.
-          for (std::string syn : entity.synonyms) {
-            size_t synPed = prefixEditDistance(nPrefix, normalize(syn), delta);
-            numPedComputations++;
-
-            // Check if the synonym is the "best" matching synonym.
-            if (synPed <= delta && synPed < bestPed) {
-              bestPed = synPed;
-              bestMatchingSynonym = syn;
-            }
-          }
-
-          // Take the best matching synonym.
-          if (bestMatchingSynonym.size() != 0) {
-            entity.matchedSynonym = bestMatchingSynonym;
-            entity.ped = bestPed;
-            matches.push_back(entity);
-          }
-        }
+  // The matched string is the name if it matches, otherwise the first
+  // matching synonym, like in findMatches.
+  size_t end = std::min<size_t>(_completionOffsets[i + 1],
+      _completionOffsets[i] + k);
+  for (size_t j = _completionOffsets[i]; j < end; ++j) {
+    uint32_t id = _completionIds[j];
+    uint32_t synonym = NO_SYNONYM;
+    if (!normalizedString(stringId(id, NO_SYNONYM)).starts_with(normalized)) {
+      synonym = 0;
+      while (!normalizedString(stringId(id, synonym)).starts_with(
+          normalized)) {
+        synonym++;
       }
     }
+    matches.push_back(Match(id, 0, synonym));
+  }
+  return true;
+}
 
-    // Rank the matches.
-    matches = rankMatches(matches);
+// _____________________________________________________________________________
+bool QGramIndex::matchSynonyms(MatchBuffers& buffers, size_t delta,
+    uint32_t id, Match& match, size_t& numPedComputations) const {
+  uint32_t bestSynonym = NO_SYNONYM;
+  size_t bestPed = delta + 1;
+  for (uint32_t j = 0; j < numIndexedSynonyms(id); j++) {
+    uint32_t synonym = stringId(id, j);
+    if (!passesStringFilters(buffers, delta, normalizedString(synonym),
+        _stringSignatures[synonym - 1], &buffers.stats)) {
+      continue;
+    }
+    size_t synPed = buffers.pattern.compute(normalizedString(synonym), delta);
+    numPedComputations++;
+
+    // Check if the synonym is the "best" matching synonym.
+    if (synPed < bestPed) {
+      bestPed = synPed;
+      bestSynonym = j;
+    }
   }
 
-  return std::pair<std::vector<Entity>, size_t>(matches, numPedComputations);
+  // Take the best matching synonym.
+  if (bestSynonym == NO_SYNONYM) { return false; }
+  match = Match(id, bestPed, bestSynonym);
+  return true;
+}
+
+// _____________________________________________________________________________
+Entity QGramIndex::materialize(const Match& match) const {
+  uint32_t id = match.entityId;
+  std::vector<std::string> synonyms;
+  for (size_t i = 0; i < _entities.numSynonyms(id); i++) {
+    synonyms.push_back(_entities.synonym(id, i).to_string());
+  }
+  Entity entity(_entities.name(id).to_string(), _entities.score(id),
+      _entities.description(id),
+      _entities.field(id, ENTITY_WIKIPEDIA_URL).to_string(),
+      _entities.field(id, ENTITY_WIKIDATA_ID).to_string(), synonyms,
+      _entities.field(id, ENTITY_IMAGE_URL).to_string());
+  entity.ped = match.ped;
+  if (match.synonym != NO_SYNONYM) {
+    entity.matchedSynonym = synonyms[match.synonym];
+  }
+  return entity;
 }
 
 // _____________________________________________________________________________
@@ -248,27 +1402,82 @@ std::vector<Entity> QGramIndex::rankMatches(const std::vector<Entity>& list) {
 }
 
 // _____________________________________________________________________________
-std::vector<std::string> QGramIndex::computeQGrams(const std::string& word)
-    const {
-  std::vector<std::string> result;
-  std::string padded = _padding + normalize(word);
-  for (size_t i = 0; i < padded.size() - _q + 1; ++i) {
-    result.push_back(padded.substr(i, _q));
+void QGramIndex::rankMatches(std::vector<Match>& matches) {
+  std::sort(matches.begin(), matches.end(), _matchComparator);
+}
+
+// _____________________________________________________________________________
+void QGramIndex::mergeRankedMatches(
+    const std::vector<std::vector<Match> >& parts, size_t k,
+    std::vector<Match>& matches) {
+  // A heap of the (part, index) of the best match of each part not taken
+  // yet, the best one on top.
+  typedef std::pair<size_t, size_t> Head;
+  auto isWorse = [&parts](const Head& a, const Head& b) {
+    return _matchComparator(parts[b.first][b.second],
+        parts[a.first][a.second]);
+  };
+  std::vector<Head> heap;
+  for (size_t i = 0; i < parts.size(); i++) {
+    if (!parts[i].empty()) { heap.push_back(Head(i, 0)); }
+  }
+  std::make_heap(heap.begin(), heap.end(), isWorse);
+  matches.clear();
+  while (!heap.empty() && matches.size() < k) {
+    std::pop_heap(heap.begin(), heap.end(), isWorse);
+    Head& head = heap.back();
+    matches.push_back(parts[head.first][head.second]);
+    if (++head.second < parts[head.first].size()) {
+      std::push_heap(heap.begin(), heap.end(), isWorse);
+    } else {
+      heap.pop_back();
+    }
   }
+}
 
+// _____________________________________________________________________________
+std::vector<QGram> QGramIndex::computeQGrams(const std::string& word) const {
+  std::vector<QGram> result;
+  appendQGrams(normalize(word), result);
   return result;
 }
 
 // _____________________________________________________________________________
-std::string QGramIndex::normalize(const std::string& str) {
-  std::string s;
-  for (size_t i = 0; i < str.size(); ++i) {
-    if (!std::isalnum(str[i])) {
-      continue;
-    }
-    s += static_cast<char>(tolower(str[i]));
+void QGramIndex::appendQGrams(boost::string_ref normalized,
+    std::vector<QGram>& qGrams) const {
+  // Shift the characters into the q-gram one by one, starting with the
+  // padding. The mask drops the character that falls out on the left.
+  QGram mask = static_cast<QGram>((static_cast<uint64_t>(1) << (8 * _q)) - 1);
+  QGram qGram = packQGram(_padding);
+  for (size_t i = 0; i < normalized.size(); ++i) {
+    qGram = ((qGram << 8) | static_cast<unsigned char>(normalized[i])) & mask;
+    qGrams.push_back(qGram);
   }
+}
 
+// _____________________________________________________________________________
+QGram QGramIndex::packQGram(const std::string& qGram) {
+  QGram packed = 0;
+  for (size_t i = 0; i < qGram.size(); ++i) {
+    packed = (packed << 8) | static_cast<unsigned char>(qGram[i]);
+  }
+  return packed;
+}
+
+// _____________________________________________________________________________
+std::string QGramIndex::unpackQGram(QGram qGram) const {
+  std::string result(_q, ' ');
+  for (size_t i = 0; i < _q; ++i) {
+    result[_q - 1 - i] = static_cast<char>(qGram & 0xFF);
+    qGram >>= 8;
+  }
+  return result;
+}
+
+// _____________________________________________________________________________
+std::string QGramIndex::normalize(boost::string_ref str) {
+  std::string s;
+  appendNormalized(str.data(), str.size(), s);
   return s;
 }
 
@@ -285,3 +1494,18 @@ std::vector<std::string> QGramIndex::split(const std::string& text, char sep) {
   }
   return tokens;
 }
+
+// _____________________________________________________________________________
+void QGramIndex::split(boost::string_ref text, char sep,
+    std::vector<boost::string_ref>& tokens) {
+  tokens.clear();
+  const char* end = text.data() + text.size();
+  const char* start = text.data();
+  const char* found;
+  while (start < end &&
+      (found = static_cast<const char*>(memchr(start, sep, end - start)))) {
+    tokens.push_back(boost::string_ref(start, found - start));
+    start = found + 1;
+  }
+  tokens.push_back(boost::string_ref(start, end - start));
+}
@@ -8,9 +8,15 @@
 #ifndef QGRAMINDEX_H_
 #define QGRAMINDEX_H_
 
-#include <unordered_map>
+#include <stdint.h>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
+#include "./CountFilter.h"
+#include "./EntityStore.h"
+#include "./PrefixEditDistance.h"
 
 // An entity in the q-gram index.
 struct Entity {
@@ -54,60 +60,553 @@ inline bool _entityComparator(const Entity& first, const Entity& second) {
   return false;
 }
 
+// A q-gram packed into an integer, one (normalized) character per byte and the
+// first character in the highest byte, so that integer order is string order.
+typedef uint32_t QGram;
+
+// The maximal q for which a q-gram fits into a QGram.
+const size_t MAX_Q = sizeof(QGram);
+
+// Marks an empty slot in the q-gram dictionary. Can't be a real q-gram, since
+// normalized strings never contain the byte 0xFF (see Normalizer.h).
+const QGram NO_QGRAM = 0xFFFFFFFF;
+
+// Marks a match of the name of an entity (rather than one of its synonyms).
+const uint32_t NO_SYNONYM = 0xFFFFFFFF;
+
+// A match of a query, referring to the entity instead of copying it.
+struct Match {
+  Match() : entityId(0), ped(0), synonym(NO_SYNONYM) {}
+  Match(uint32_t entityId, uint32_t ped, uint32_t synonym) :
+      entityId(entityId), ped(ped), synonym(synonym) {}
+
+  // The 1-based id of the entity.
+  uint32_t entityId;
+  // The prefix edit distance to the name or the matched synonym.
+  uint32_t ped;
+  // The index of the matched synonym in Entity::synonyms, or NO_SYNONYM.
+  uint32_t synonym;
+};
+
+// Two matches are equal if they have the same entity, PED and synonym.
+inline bool operator==(const Match& first, const Match& second) {
+  return first.entityId == second.entityId && first.ped == second.ped &&
+      first.synonym == second.synonym;
+}
+
+// Orders matches by PED, then by id (which is the order of the scores).
+inline bool _matchComparator(const Match& first, const Match& second) {
+  if (first.ped != second.ped) return first.ped < second.ped;
+  return first.entityId < second.entityId;
+}
+
+// The maximal length of the (normalized) prefixes in the completion table.
+// Up to that length, delta is 0.
+const size_t COMPLETION_MAX_LENGTH = 3;
+
+// The number of best entities the completion table keeps per prefix.
+const size_t COMPLETION_TOP_N = 10;
+
+// The number of candidates findMatches verifies at a time.
+const size_t VERIFY_BATCH_SIZE = 256;
+
+// What the filters beyond the plain count filter saved in one query, in names
+// and synonyms. The filters run in this order, and each one only counts what
+// the ones before it let through, so these numbers plus the actual PED
+// computations are the PED computations without the filters.
+struct FilterStats {
+  // The strings that share T q-grams with x, but less than T within delta
+  // positions of where they are in x (the positional count filter).
+  size_t numPosition = 0;
+  // The strings y with |y| < |x| - delta, which can't have PED(x, y) <= delta.
+  size_t numLength = 0;
+  // The strings that lack more than delta of the characters of x (with
+  // multiplicity, see QGramIndex::computeSignature).
+  size_t numSignature = 0;
+};
+
+// The stages of a query in QGramIndex::findMatches and findTopMatches.
+enum QueryStage {
+  STAGE_NORMALIZE,  // Normalize x, preprocess it for PED, its signature.
+  STAGE_LOOKUP,     // Fetch (and slice) the lists of the q-grams of x, or
+                    // match the words of x in the vocabulary.
+  STAGE_MERGE,      // Merge the lists in the count filter, or intersect
+                    // the strings of the words of x.
+  STAGE_FILTER,     // The length and signature filters.
+  STAGE_PED,        // Compute the PEDs and collect the matches.
+  STAGE_RANK,       // Sort the matches.
+  NUM_QUERY_STAGES
+};
+
+// Human readable names of the stages above.
+const char* const QUERY_STAGE_NAMES[NUM_QUERY_STAGES] = {
+  "normalize", "lookup", "merge", "filter", "ped", "rank"
+};
+
+// The wall clock time of each query stage, summed over all queries with the
+// same MatchBuffers. Off by default: when on, every batch of candidates reads
+// the clock a few times more.
+struct StageTimes {
+  bool enabled = false;
+  double seconds[NUM_QUERY_STAGES] = {};
+};
+
+// The scratch memory of QGramIndex::findMatches. Keep one per thread and pass
+// it to every query; once the buffers have grown, queries don't allocate.
+struct MatchBuffers {
+  std::string prefix;
+  PedPattern pattern;
+  uint64_t signature;
+  std::vector<QGram> qGrams;
+  std::vector<InvertedList> lists;
+  CountFilter countFilter;
+  FilterStats stats;
+  StageTimes times;
+  std::vector<uint32_t> candidates;
+  std::vector<boost::string_ref> names;
+  std::vector<size_t> peds;
+  // Used by queries of several words only: the words, their matches in the
+  // vocabulary as (word id, distance), the matching strings as (string id,
+  // distance), and the distance + 1 of each matching word (0 otherwise).
+  std::vector<std::string> words;
+  std::vector<std::vector<std::pair<uint32_t, uint32_t> > > wordMatches;
+  std::vector<std::pair<uint32_t, uint32_t> > stringMatches;
+  std::vector<uint32_t> wordDistances;
+  // Used by PrefixTrie only.
+  std::vector<uint8_t> columns;
+  std::vector<std::pair<uint32_t, uint32_t> > nodes;
+};
+
 // A simple q-gram index as explained in lecture 5.
 class QGramIndex {
  public:
-  // Creates an empty q-gram index.
+  // Creates an empty q-gram index, for 1 <= q <= MAX_Q.
   explicit QGramIndex(size_t q, bool withSynonyms) : _q(q),
       _withSynonyms(withSynonyms) {
+    if (q < 1 || q > MAX_Q) {
+      throw std::invalid_argument("q must be between 1 and 4");
+    }
     for (size_t i = 0; i < q - 1; ++i) { _padding += '$'; }
+    computeShards();
   }
 
-  // Builds the index from the given file (one line per entity, see ES5).
-  void buildFromFile(const std::string& fileName);
+  // Builds the index from the given file (one line per entity, see ES5). The
+  // entity ids follow the scores in descending order (ties in file order), so
+  // every inverted list is also sorted by popularity. Parses the file and
+  // builds the index with the given number of threads (0 for one per hardware
+  // thread); the result doesn't depend on it.
+  void buildFromFile(const std::string& fileName, size_t numThreads = 0);
+
+  // Writes a snapshot of the built index to the given file: the q-gram
+  // dictionary, the inverted lists, the normalized strings, the completion
+  // table, the vocabulary and the entities, each as a Column (see Column.h).
+  void save(const std::string& fileName) const;
+
+  // Replaces the index by the snapshot in the given file, mapped (so that
+  // loading takes time independent of the number of entities, and the pages
+  // are read on first use) or copied into memory. Also replaces q and
+  // whether synonyms are used. Throws std::runtime_error if the file can't be
+  // read or isn't a snapshot of this version.
+  void load(const std::string& fileName, bool map);
+
+  // Returns the inverted list of the given q-gram (empty if there is none).
+  InvertedList getInvertedList(QGram qGram) const;
+
+  // Returns the number of distinct q-grams in the index.
+  size_t numQGrams() const { return _numQGrams; }
+
+  // Returns the (approximate) memory used by the q-gram dictionary, the
+  // inverted lists, the completion table and the vocabulary in bytes.
+  size_t sizeInBytes() const;
 
   // Merges the given inverted lists.
   static std::vector<std::pair<size_t, size_t> > mergeLists(
-      const std::vector<const std::vector<size_t>* >& lists);
+      const std::vector<InvertedList>& lists);
 
   // Computes the prefix edit distance PED(x,y) for the two given strings x and
   // y. Returns PED(x,y) if it is smaller or equal to the given delta; delta + 1
-  // otherwise.
+  // otherwise. Bit-parallel, see PedPattern; when computing many PEDs for the
+  // same x, build the PedPattern once instead.
   static size_t prefixEditDistance(const std::string& x, const std::string& y,
       size_t delta);
 
   // Finds all entities y with PED(x, y) <= delta for a given integer delta and
   // a given (normalized) prefix x.
+  //
+  // A query of several words (see hasSeveralWords()) is matched word by word
+  // instead: an entity matches if, for each word w of the query, its name or
+  // synonym has a word within delta = |w| / 4 of it, by edit distance for all
+  // but the last word and by prefix edit distance for the last one (which may
+  // still be typed). The PED of the match is the sum of these distances. The
+  // order of the words doesn't matter, and two of them may match the same
+  // word of the name.
   std::pair<std::vector<Entity>, size_t> findMatches(const std::string& prefix)
       const;
 
+  // Same as above, but writes the ranked matches as (entity id, PED, synonym)
+  // records to 'matches' and returns the number of PED computations. Works on
+  // the normalized names and synonyms computed at build time and on the given
+  // buffers only, so it doesn't copy entities or allocate per candidate.
+  size_t findMatches(const std::string& prefix, MatchBuffers& buffers,
+      std::vector<Match>& matches) const;
+
+  // Finds the k best of the matches above. Verifies the candidates in
+  // descending score order and stops as soon as it has k matches with PED 0,
+  // since no later candidate can beat those. Sets numFound to the number of
+  // all matches: exact if exactCount is true (which disables the early stop)
+  // or the search went through all candidates, otherwise extrapolated from
+  // the candidates verified and the part of the inverted lists seen so far.
+  // Returns the number of PED computations.
+  size_t findTopMatches(const std::string& prefix, size_t k, bool exactCount,
+      MatchBuffers& buffers, std::vector<Match>& matches, size_t& numFound,
+      bool& isExact) const;
+
+  // Returns true if the given query has more than one word (see
+  // tokenizeUtf8()), so that the search matches it word by word.
+  static bool hasSeveralWords(boost::string_ref prefix);
+
+  // Returns the number of distinct words of the names and synonyms.
+  size_t numWords() const { return _wordStrings.size(); }
+
+  // Returns the normalized word with the given (1-based) id. The vocabulary
+  // is sorted, so the ids follow the order of the words.
+  boost::string_ref word(uint32_t wordId) const {
+    return boost::string_ref(_words.data() + _wordOffsets[wordId - 1],
+        _wordOffsets[wordId] - _wordOffsets[wordId - 1]);
+  }
+
+  // Splits the entities into the given number (>= 1) of shards: ranges of
+  // entity ids with about the same number of names and synonyms each. Each
+  // shard can be searched on its own (see findShardMatches()), for example
+  // all of them in parallel by a ParallelSearch. The number of shards is kept
+  // across builds and loads; it is 1 by default.
+  void setNumShards(size_t numShards);
+
+  // Returns the number of shards.
+  size_t numShards() const { return _numShards; }
+
+  // Same as findMatches(prefix, buffers, matches) and findTopMatches(), but
+  // only for the entities of the given shard, and without the completion
+  // table.
+  size_t findShardMatches(const std::string& prefix, size_t shard,
+      MatchBuffers& buffers, std::vector<Match>& matches) const;
+  size_t findTopShardMatches(const std::string& prefix, size_t shard,
+      size_t k, bool exactCount, MatchBuffers& buffers,
+      std::vector<Match>& matches, size_t& numFound, bool& isExact) const;
+
+  // Splits the given query into its words, in buffers.words, and if there
+  // are several, matches each of them in the vocabulary, in
+  // buffers.wordMatches: the first step of findMatches() for such a query.
+  // Returns the number of distance computations. The word matches are the
+  // same for all shards, so a ParallelSearch computes them only once.
+  size_t matchWords(const std::string& prefix, MatchBuffers& buffers) const;
+
+  // The rest of findShardMatches() and findTopShardMatches() for a query of
+  // several words, with its words matched by matchWords() in 'words' (which
+  // is only read, so several shards can share it): writes the k best
+  // matches of the shard (all of them for k = SIZE_MAX), ranked, and sets
+  // numFound to the exact number of matches.
+  void findShardWordMatches(const MatchBuffers& words, size_t shard, size_t k,
+      MatchBuffers& buffers, std::vector<Match>& matches, size_t& numFound)
+      const;
+
+  // Merges the given ranked matches (of different shards) into the k best,
+  // ranked, with a k-way merge.
+  static void mergeRankedMatches(const std::vector<std::vector<Match> >& parts,
+      size_t k, std::vector<Match>& matches);
+
+  // Answers findTopMatches for a normalized prefix of length 1 to
+  // COMPLETION_MAX_LENGTH and k <= COMPLETION_TOP_N from the completion table.
+  // With delta = 0, the matches are the entities with a name or synonym that
+  // starts with the prefix, ranked by id. Sets numFound to their exact number.
+  // Returns false for other prefixes or k.
+  bool findCompletions(const std::string& normalized, size_t k,
+      std::vector<Match>& matches, size_t& numFound) const;
+
+  // Finds the best matching synonym (lowest PED, the first one on ties) of the
+  // entity with the given id, for an entity whose name doesn't match, and the
+  // prefix, pattern and signature in the given buffers. Returns true and sets
+  // 'match' if there is one with PED <= delta. Adds the number of PED
+  // computations to numPedComputations, and the synonyms it skips to the
+  // stats in the buffers.
+  bool matchSynonyms(MatchBuffers& buffers, size_t delta, uint32_t id,
+      Match& match, size_t& numPedComputations) const;
+
+  // Returns false if the normalized string y with the given signature can't
+  // have PED(x, y) <= delta for the prefix x in the given buffers, by its
+  // length or its signature. Then adds it to the respective count in 'stats'
+  // (unless that is nullptr).
+  static bool passesStringFilters(const MatchBuffers& buffers, size_t delta,
+      boost::string_ref y, uint64_t signature, FilterStats* stats) {
+    if (y.size() + delta < buffers.prefix.size()) {
+      if (stats) { stats->numLength++; }
+      return false;
+    }
+    if (static_cast<size_t>(__builtin_popcountll(buffers.signature &
+        ~signature)) > delta) {
+      if (stats) { stats->numSignature++; }
+      return false;
+    }
+    return true;
+  }
+
+  // Returns the signature of the given normalized string: one bit per letter
+  // and digit that occurs in it, one more per letter that occurs at least
+  // twice, and two bits for once and twice any other character. Each bit set
+  // for x but not for y is a character of x that an alignment with any prefix
+  // of y must edit, so PED(x, y) >= popcount(sig(x) & ~sig(y)).
+  static uint64_t computeSignature(boost::string_ref normalized);
+
+  // Writes the string ids (see stringId()) of all names and synonyms that
+  // pass the count filter and the filters of FilterStats for the given prefix
+  // to 'candidates', in id order. Returns delta.
+  size_t findCandidates(const std::string& prefix, MatchBuffers& buffers,
+      std::vector<uint32_t>& candidates) const;
+
+  // The names and synonyms have 1-based string ids in entity order, the name
+  // of an entity first, then its synonyms. The inverted lists refer to those,
+  // so the count filter counts per string. Without synonyms, the string id of
+  // a name is the entity id.
+  // Returns the string id of the name (synonym = NO_SYNONYM) or the given
+  // synonym of the entity with the given id.
+  uint32_t stringId(uint32_t entityId, uint32_t synonym) const {
+    return entityId + _synonymOffsets[entityId - 1] +
+        (synonym == NO_SYNONYM ? 0 : synonym + 1);
+  }
+
+  // Returns the entity id of the given string id.
+  uint32_t stringEntity(uint32_t stringId) const {
+    return _stringEntities[stringId - 1];
+  }
+
+  // Returns NO_SYNONYM if the given string id is a name, otherwise the index
+  // of the synonym in Entity::synonyms.
+  uint32_t stringSynonym(uint32_t stringId) const {
+    uint32_t name = this->stringId(stringEntity(stringId), NO_SYNONYM);
+    return stringId == name ? NO_SYNONYM : stringId - name - 1;
+  }
+
+  // Returns the normalized name or synonym with the given string id.
+  boost::string_ref normalizedString(uint32_t stringId) const {
+    return boost::string_ref(
+        _normalizedStrings.data() + _normalizedOffsets[stringId - 1],
+        _normalizedOffsets[stringId] - _normalizedOffsets[stringId - 1]);
+  }
+
+  // Returns the number of synonyms of the given entity in the index (0 if
+  // synonyms are disabled).
+  uint32_t numIndexedSynonyms(uint32_t entityId) const {
+    return _synonymOffsets[entityId] - _synonymOffsets[entityId - 1];
+  }
+
+  // Returns a copy of the entity of the given match, with ped and
+  // matchedSynonym set.
+  Entity materialize(const Match& match) const;
+
   // Ranks the given list of entities (PED, s), where PED is the PED value and s
   // is the popularity score of an entity.
   static std::vector<Entity> rankMatches(const std::vector<Entity>& matches);
 
+  // Ranks the given matches the same way, in place. Since the ids follow the
+  // scores, that's by PED, then by id.
+  static void rankMatches(std::vector<Match>& matches);
+
   // Compute q-grams for padded, normalized version of given string.
-  std::vector<std::string> computeQGrams(const std::string& word) const;
+  std::vector<QGram> computeQGrams(const std::string& word) const;
+
+  // Appends the q-grams of the given (already normalized) string to the given
+  // vector. Doesn't allocate anything per q-gram.
+  void appendQGrams(boost::string_ref normalized, std::vector<QGram>& qGrams)
+      const;
+
+  // The hash of a q-gram for the dictionary: multiplicative hashing.
+  static size_t hashQGram(QGram qGram) {
+    uint32_t hash = qGram * 0x9E3779B1u;
+    return hash ^ (hash >> 16);
+  }
 
-  // Normalize the given string (remove non-word characters and lower case).
-  static std::string normalize(const std::string& str);
+  // Packs the given string of q characters into a QGram (e.g. for lookups).
+  static QGram packQGram(const std::string& qGram);
+
+  // Unpacks the given QGram into a string of q characters.
+  std::string unpackQGram(QGram qGram) const;
+
+  // Normalize the given UTF-8 string (remove non-word characters and case
+  // fold, one byte per character, see Normalizer.h).
+  static std::string normalize(boost::string_ref str);
 
   // Splits the given string on the given delimiter.
   static std::vector<std::string> split(const std::string& text, char sep);
 
+  // Same, but writes views on the parts of the text to 'tokens'.
+  static void split(boost::string_ref text, char sep,
+      std::vector<boost::string_ref>& tokens);
+
   // The value of q.
   size_t _q;
 
   // The padding (q-1 times $).
   std::string _padding;
 
-  // The inverted lists.
-  std::unordered_map<std::string, std::vector<size_t>> _invertedLists;
+  // The q-gram dictionary: an open addressing hash table (linear probing,
+  // size a power of two) with NO_QGRAM in the empty slots.
+  Column<QGram> _qGramSlots;
+
+  // The inverted lists, compressed: list i is the one of the q-gram in slot
+  // i (empty for the empty slots).
+  InvertedListStore _invertedLists;
+
+  // The number of distinct q-grams.
+  size_t _numQGrams = 0;
+
+  // The entities, in id order.
+  EntityStore _entities;
+
+  // The normalized names and synonyms, one after the other in string id
+  // order: the string with id i + 1 is _normalizedStrings[
+  // _normalizedOffsets[i]] to _normalizedStrings[_normalizedOffsets[i + 1] -
+  // 1]. Synonyms are only included if they are enabled.
+  Column<char> _normalizedStrings;
+  Column<uint64_t> _normalizedOffsets;
+
+  // The entities before entity i + 1 have _synonymOffsets[i] synonyms in the
+  // index.
+  Column<uint32_t> _synonymOffsets;
+
+  // The entity id and the signature (see computeSignature()) of the string
+  // with id i + 1 are _stringEntities[i] and _stringSignatures[i].
+  Column<uint32_t> _stringEntities;
+  Column<uint64_t> _stringSignatures;
 
-  // The list of entities.
-  std::vector<Entity> _entities;
+  // The completion table: the distinct prefixes of length 1 to
+  // COMPLETION_MAX_LENGTH of all normalized names and synonyms, packed into
+  // QGrams (left aligned, so integer order is string order) and sorted.
+  // _completionCounts[i] entities match prefix i, and the best of them are
+  // _completionIds[_completionOffsets[i]] to
+  // _completionIds[_completionOffsets[i + 1] - 1].
+  Column<QGram> _completionPrefixes;
+  Column<uint32_t> _completionOffsets;
+  Column<uint32_t> _completionIds;
+  Column<uint32_t> _completionCounts;
+
+  // The vocabulary: the distinct normalized words of the names and synonyms,
+  // sorted, the word with id i + 1 at _words[_wordOffsets[i]] to
+  // _words[_wordOffsets[i + 1] - 1].
+  Column<char> _words;
+  Column<uint32_t> _wordOffsets;
+
+  // The q-grams of the words, sorted, and the inverted list of q-gram i
+  // (word ids and positions) as list i.
+  Column<QGram> _wordQGrams;
+  InvertedListStore _wordQGramLists;
+
+  // List i + 1 has the string ids of the names and synonyms that contain the
+  // word with id i + 1.
+  InvertedListStore _wordStrings;
+
+  // The words of the string with id i + 1, in text order: the word ids
+  // _stringWords[_stringWordOffsets[i]] to
+  // _stringWords[_stringWordOffsets[i + 1] - 1].
+  Column<uint32_t> _stringWords;
+  Column<uint32_t> _stringWordOffsets;
 
   // The boolean flag that indicates whether to use synonyms or not.
   bool _withSynonyms;
+
+  // The number of shards, and the string ids where they start: shard i has
+  // the string ids _shardStrings[i] to _shardStrings[i + 1] - 1, which are
+  // the names and synonyms of a range of entities.
+  size_t _numShards = 1;
+  std::vector<uint32_t> _shardStrings;
+
+  // The snapshot the columns are mapped from, if any.
+  std::shared_ptr<const MappedFile> _file;
+
+ private:
+  // Reads the entities from the given file into _entities, ordered by score.
+  void readEntities(const std::string& fileName, size_t numThreads);
+
+  // Builds the q-gram dictionary and the inverted lists from _entities.
+  void buildInvertedLists(size_t numThreads);
+
+  // Computes the normalized names and synonyms of all entities.
+  void normalizeEntities(size_t numThreads);
+
+  // Builds the completion table from the normalized names and synonyms.
+  void buildCompletionTable(size_t numThreads);
+
+  // Builds the vocabulary, the inverted lists of its q-grams and the words of
+  // each string from the names and synonyms.
+  void buildWordIndex(size_t numThreads);
+
+  // Computes _shardStrings for _numShards shards.
+  void computeShards();
+
+  // Normalizes the prefix, prepares its PED pattern and starts the count
+  // filter on its inverted lists, restricted to the string ids beginString
+  // to endString - 1 (which must be the strings of a range of entities).
+  // Returns delta.
+  size_t startQuery(const std::string& prefix, uint32_t beginString,
+      uint32_t endString, MatchBuffers& buffers) const;
+
+  // findMatches(prefix, buffers, matches) and findTopMatches() without the
+  // completion table, for the given range of string ids (see startQuery()).
+  size_t findRangeMatches(const std::string& prefix, uint32_t beginString,
+      uint32_t endString, MatchBuffers& buffers,
+      std::vector<Match>& matches) const;
+  size_t findTopRangeMatches(const std::string& prefix, uint32_t beginString,
+      uint32_t endString, size_t k, bool exactCount, MatchBuffers& buffers,
+      std::vector<Match>& matches, size_t& numFound, bool& isExact) const;
+
+  // The part of findTopRangeMatches() for a prefix of one word: verifies the
+  // candidates until the top k are known and writes all matches so far
+  // (unranked) to 'matches'.
+  size_t verifyTopCandidates(const std::string& prefix, uint32_t beginString,
+      uint32_t endString, size_t k, bool exactCount, MatchBuffers& buffers,
+      std::vector<Match>& matches, size_t& numFound, bool& isExact) const;
+
+  // The matches of a query of several words in the given range of string
+  // ids, from the word matches in 'words' (see matchWords()). Writes them
+  // unranked.
+  void intersectWordMatches(const MatchBuffers& words, uint32_t beginString,
+      uint32_t endString, MatchBuffers& buffers, std::vector<Match>& matches)
+      const;
+
+  // Ranks the k best matches and drops the rest.
+  void rankTopMatches(size_t k, MatchBuffers& buffers,
+      std::vector<Match>& matches) const;
+
+  // Writes the words of the vocabulary within delta = |word| / 4 of the given
+  // word, by prefix edit distance if isPrefix is true and by edit distance
+  // otherwise, to 'matches' as (word id, distance) in id order. Returns the
+  // number of distance computations.
+  size_t matchWord(const std::string& word, bool isPrefix,
+      MatchBuffers& buffers,
+      std::vector<std::pair<uint32_t, uint32_t> >& matches) const;
+
+  // Takes up to 'maxCandidates' further strings that pass the count filter,
+  // filters and verifies them and appends the matches (unranked), one per
+  // entity. Adds the number of PED computations to numPedComputations.
+  // Returns false iff there are no candidates left.
+  bool verifyNextCandidates(MatchBuffers& buffers, size_t delta,
+      size_t maxCandidates, std::vector<Match>& matches,
+      size_t& numPedComputations) const;
+
+  // Removes the given candidates of the count filter that fail the length or
+  // signature filter.
+  void filterCandidates(MatchBuffers& buffers, size_t delta,
+      std::vector<uint32_t>& candidates) const;
+
+  // Returns the slot of the given q-gram in the dictionary, or the empty slot
+  // where it would be inserted.
+  size_t findSlot(QGram qGram) const;
+
+  // Returns the slot of the given q-gram in the given dictionary (see
+  // _qGramSlots), or the empty slot where it would be inserted.
+  static size_t findSlot(const QGram* slots, size_t numSlots, QGram qGram);
+
+  // Doubles the size of the given dictionary.
+  static void growDictionary(std::vector<QGram>& slots);
 };
 
 #endif  // QGRAMINDEX_H_
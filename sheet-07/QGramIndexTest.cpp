@@ -0,0 +1,760 @@
+// Copyright 2017, University of Freiburg,
+// Chair of Algorithms and Data Structures.
+// Authors: Björn Buchhold <buchholb@cs.uni-freiburg.de>,
+//          Patrick Brosi <brosi@cs.uni-freiburg.de>,
+//          Claudius Korzen <korzen@cs.uni-freiburg.de>.
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include "./PrefixEditDistance.h"
+#include "./Normalizer.h"
+#include "./QGramIndex.h"
+
+// Returns the ids or the positions of the given list as a vector.
+std::vector<uint32_t> listIds(const InvertedList& list) {
+  std::vector<uint32_t> ids;
+  ListCursor cursor;
+  for (cursor.reset(list); !cursor.done(); cursor.next()) {
+    ids.push_back(cursor.id());
+  }
+  return ids;
+}
+std::vector<uint8_t> listPositions(const InvertedList& list) {
+  std::vector<uint8_t> positions;
+  ListCursor cursor;
+  for (cursor.reset(list); !cursor.done(); cursor.next()) {
+    positions.push_back(cursor.position());
+  }
+  return positions;
+}
+
+// Returns the inverted list of the given q-gram as a vector.
+std::vector<uint32_t> getList(const QGramIndex& index, const std::string& q) {
+  return listIds(index.getInvertedList(QGramIndex::packQGram(q)));
+}
+
+// Returns the elements of the given column as a vector.
+template <typename T>
+std::vector<T> toVector(const Column<T>& column) {
+  return std::vector<T>(column.begin(), column.end());
+}
+
+// The textbook DP for PED(x, y), capped at delta + 1.
+size_t referencePed(const std::string& x, const std::string& y,
+    size_t delta) {
+  size_t m = std::min(x.size() + delta + 1, y.size() + 1);
+  std::vector<size_t> prev(m), cur(m);
+  for (size_t j = 0; j < m; j++) prev[j] = j;
+  for (size_t i = 1; i <= x.size(); i++) {
+    cur[0] = i;
+    for (size_t j = 1; j < m; j++) {
+      cur[j] = std::min(prev[j - 1] + (x[i - 1] == y[j - 1] ? 0 : 1),
+                        std::min(cur[j - 1], prev[j]) + 1);
+    }
+    prev.swap(cur);
+  }
+  return std::min(*std::min_element(prev.begin(), prev.end()), delta + 1);
+}
+
+// The textbook DP for ED(x, y), capped at delta + 1.
+size_t referenceEd(const std::string& x, const std::string& y,
+    size_t delta) {
+  std::vector<size_t> prev(y.size() + 1), cur(y.size() + 1);
+  for (size_t j = 0; j <= y.size(); j++) prev[j] = j;
+  for (size_t i = 1; i <= x.size(); i++) {
+    cur[0] = i;
+    for (size_t j = 1; j <= y.size(); j++) {
+      cur[j] = std::min(prev[j - 1] + (x[i - 1] == y[j - 1] ? 0 : 1),
+                        std::min(cur[j - 1], prev[j]) + 1);
+    }
+    prev.swap(cur);
+  }
+  return std::min(prev.back(), delta + 1);
+}
+
+// _____________________________________________________________________________
+TEST(QGramIndexTest, buildFromFile) {
+  QGramIndex index(3, false);
+  index.buildFromFile("example.tsv");
+
+  ASSERT_EQ(7, index.numQGrams());
+  ASSERT_EQ(std::vector<uint32_t>({2}), getList(index, "$$b"));
+  ASSERT_EQ(std::vector<uint32_t>({1}), getList(index, "$$f"));
+  ASSERT_EQ(std::vector<uint32_t>({2}), getList(index, "$br"));
+  ASSERT_EQ(std::vector<uint32_t>({1}), getList(index, "$fr"));
+  ASSERT_EQ(std::vector<uint32_t>({2}), getList(index, "bre"));
+  ASSERT_EQ(std::vector<uint32_t>({1}), getList(index, "fre"));
+  ASSERT_EQ(std::vector<uint32_t>({1, 2}), getList(index, "rei"));
+  ASSERT_EQ(0, getList(index, "xyz").size());
+  ASSERT_EQ(0, getList(index, "$li").size());
+
+  ASSERT_EQ(2, index._entities.size());
+  Entity entity = index.materialize(Match(1, 0, NO_SYNONYM));
+  ASSERT_EQ("frei", entity.name);
+  ASSERT_EQ(3, entity.score);
+  ASSERT_EQ("a word", entity.description);
+  ASSERT_EQ("Q1", entity.wikidataId);
+  ASSERT_EQ(std::vector<std::string>({"freiheit", "liberty"}),
+            entity.synonyms);
+  ASSERT_EQ("brei", index._entities.name(2));
+  ASSERT_EQ(2, index._entities.score(2));
+  ASSERT_EQ("another word", index._entities.description(2));
+  // The empty synonyms field of "brei" is one empty synonym.
+  ASSERT_EQ(1, index._entities.numSynonyms(2));
+}
+
+// _____________________________________________________________________________
+TEST(QGramIndexTest, buildFromFileWithSynonyms) {
+  QGramIndex index(3, true);
+  index.buildFromFile("example.tsv");
+
+  // The string ids: "frei" 1, "freiheit" 2, "liberty" 3, "brei" 4, "" 5.
+  ASSERT_EQ(std::vector<uint32_t>({1, 1, 1, 2, 2}),
+            toVector(index._stringEntities));
+  ASSERT_EQ(3, index.stringId(1, 1));
+  ASSERT_EQ(4, index.stringId(2, NO_SYNONYM));
+  ASSERT_EQ(1, index.stringSynonym(3));
+  ASSERT_EQ(NO_SYNONYM, index.stringSynonym(4));
+  ASSERT_EQ("liberty", index.normalizedString(3));
+  ASSERT_EQ(std::vector<uint32_t>({3}), getList(index, "$li"));
+  ASSERT_EQ(std::vector<uint32_t>({1, 2, 4}), getList(index, "rei"));
+}
+
+// _____________________________________________________________________________
+TEST(QGramIndexTest, buildFromFileThreads) {
+  {
+    // Random names and synonyms, many equal scores, and no newline at the end.
+    std::ofstream out("QGramIndexTest.TMP.tsv");
+    out << "name\tscore\tdescription\twikipediaUrl\twikidataId\tsynonyms";
+    std::mt19937 gen(5);
+    for (size_t i = 0; i < 1000; i++) {
+      out << "\n";
+      for (size_t j = 1 + gen() % 12; j > 0; j--) out << char('a' + gen() % 8);
+      out << "\t" << gen() % 50 << "\tentity " << i << "\t\t";
+      if (gen() % 2) out << "\tsyn" << gen() % 100 << ";X" << i;
+    }
+  }
+  QGramIndex expected(3, true);
+  expected.buildFromFile("QGramIndexTest.TMP.tsv", 1);
+  ASSERT_EQ(1000, expected._entities.size());
+  for (size_t numThreads : {2, 3, 8}) {
+    QGramIndex index(3, true);
+    index.buildFromFile("QGramIndexTest.TMP.tsv", numThreads);
+    ASSERT_EQ(expected._entities.size(), index._entities.size());
+    for (uint32_t id = 1; id <= index._entities.size(); id++) {
+      ASSERT_EQ(expected._entities.name(id), index._entities.name(id));
+      ASSERT_EQ(expected._entities.description(id),
+                index._entities.description(id));
+    }
+    ASSERT_EQ(toVector(expected._normalizedStrings),
+              toVector(index._normalizedStrings));
+    ASSERT_EQ(toVector(expected._normalizedOffsets),
+              toVector(index._normalizedOffsets));
+    ASSERT_EQ(toVector(expected._synonymOffsets),
+              toVector(index._synonymOffsets));
+    ASSERT_EQ(toVector(expected._stringSignatures),
+              toVector(index._stringSignatures));
+    ASSERT_EQ(toVector(expected._completionIds),
+              toVector(index._completionIds));
+    ASSERT_EQ(expected.numQGrams(), index.numQGrams());
+    for (QGram qGram : expected._qGramSlots) {
+      if (qGram == NO_QGRAM) continue;
+      InvertedList a = expected.getInvertedList(qGram);
+      InvertedList b = index.getInvertedList(qGram);
+      ASSERT_EQ(listIds(a), listIds(b));
+      ASSERT_EQ(listPositions(a), listPositions(b));
+    }
+  }
+}
+
+// _____________________________________________________________________________
+TEST(QGramIndexTest, saveAndLoad) {
+  QGramIndex built(3, true);
+  built.buildFromFile("example.tsv");
+  built.save("QGramIndexTest.TMP.bin");
+  for (bool map : {true, false}) {
+    QGramIndex index(2, false);
+    index.load("QGramIndexTest.TMP.bin", map);
+    ASSERT_EQ(3, index._q);
+    ASSERT_TRUE(index._withSynonyms);
+    ASSERT_EQ(built.numQGrams(), index.numQGrams());
+    ASSERT_EQ(built.numWords(), index.numWords());
+    ASSERT_EQ(built.sizeInBytes(), index.sizeInBytes());
+    ASSERT_EQ(std::vector<uint32_t>({1, 2, 4}), getList(index, "rei"));
+    ASSERT_EQ("liberty", index.normalizedString(3));
+    ASSERT_EQ("another word", index._entities.description(2));
+
+    // A copy of a mapped index still refers to the file.
+    QGramIndex copy = index;
+    index = QGramIndex(3, false);
+    MatchBuffers buffers;
+    std::vector<Match> expected, actual;
+    for (const char* prefix : {"Frei", "libe", "br", "x", "frei brei"}) {
+      ASSERT_EQ(built.findMatches(prefix, buffers, expected),
+                copy.findMatches(prefix, buffers, actual));
+      ASSERT_EQ(expected.size(), actual.size());
+      for (size_t i = 0; i < expected.size(); i++) {
+        ASSERT_EQ(expected[i].entityId, actual[i].entityId);
+        ASSERT_EQ(expected[i].ped, actual[i].ped);
+        ASSERT_EQ(expected[i].synonym, actual[i].synonym);
+      }
+    }
+  }
+
+  {
+    std::ofstream out("QGramIndexTest.TMP.bin");
+    out << "no q-gram index";
+  }
+  QGramIndex index(3, false);
+  ASSERT_THROW(index.load("QGramIndexTest.TMP.bin", true),
+               std::runtime_error);
+  ASSERT_THROW(index.load("QGramIndexTest.TMP.missing", true),
+               std::runtime_error);
+}
+
+// _____________________________________________________________________________
+TEST(QGramIndexTest, computeQGrams) {
+  QGramIndex index(3, false);
+  std::vector<QGram> qGrams = index.computeQGrams("Frei-burg");
+  ASSERT_EQ(8, qGrams.size());
+  ASSERT_EQ("$$f", index.unpackQGram(qGrams[0]));
+  ASSERT_EQ("$fr", index.unpackQGram(qGrams[1]));
+  ASSERT_EQ("fre", index.unpackQGram(qGrams[2]));
+  ASSERT_EQ("rei", index.unpackQGram(qGrams[3]));
+  ASSERT_EQ("eib", index.unpackQGram(qGrams[4]));
+  ASSERT_EQ("ibu", index.unpackQGram(qGrams[5]));
+  ASSERT_EQ("bur", index.unpackQGram(qGrams[6]));
+  ASSERT_EQ("urg", index.unpackQGram(qGrams[7]));
+  ASSERT_EQ(0, index.computeQGrams("").size());
+
+  QGramIndex index4(4, false);
+  qGrams = index4.computeQGrams("frei");
+  ASSERT_EQ(4, qGrams.size());
+  ASSERT_EQ("$$$f", index4.unpackQGram(qGrams[0]));
+  ASSERT_EQ("frei", index4.unpackQGram(qGrams[3]));
+}
+
+// _____________________________________________________________________________
+TEST(QGramIndexTest, packQGram) {
+  QGramIndex index(3, false);
+  ASSERT_EQ("abc", index.unpackQGram(QGramIndex::packQGram("abc")));
+  ASSERT_LT(QGramIndex::packQGram("$zz"), QGramIndex::packQGram("a$$"));
+  ASSERT_LT(QGramIndex::packQGram("abc"), QGramIndex::packQGram("abd"));
+  ASSERT_THROW(QGramIndex(5, false), std::invalid_argument);
+}
+
+// _____________________________________________________________________________
+TEST(QGramIndexTest, normalize) {
+  ASSERT_EQ("freiburg", QGramIndex::normalize("Frei, burg !!"));
+  ASSERT_EQ("freiburg", QGramIndex::normalize("freiburg"));
+  // One byte per character, so PED is on characters: one substitution.
+  std::string bjoern = QGramIndex::normalize("Björn");
+  ASSERT_EQ(5, bjoern.size());
+  ASSERT_EQ("björn", normalizedToUtf8(bjoern));
+  ASSERT_EQ(1, QGramIndex::prefixEditDistance(QGramIndex::normalize("bjorn"),
+      bjoern, 1));
+}
+
+// _____________________________________________________________________________
+TEST(QGramIndexTest, mergeLists) {
+  std::vector<uint32_t> list1 = {1, 1, 3, 5};
+  std::vector<uint32_t> list2 = {2, 3, 3, 9, 9};
+  InvertedListStore store;
+  store.add(list1.data(), nullptr, list1.size());
+  store.add(list2.data(), nullptr, list2.size());
+  std::vector<InvertedList> lists = {store.list(0), store.list(1),
+      InvertedList()};
+  std::vector<std::pair<size_t, size_t>> expected = {
+    {1, 2}, {2, 1}, {3, 3}, {5, 1}, {9, 2}
+  };
+  ASSERT_EQ(expected, QGramIndex::mergeLists(lists));
+}
+
+// _____________________________________________________________________________
+TEST(QGramIndexTest, prefixEditDistance) {
+  ASSERT_EQ(0, QGramIndex::prefixEditDistance("frei", "frei", 0));
+  ASSERT_EQ(0, QGramIndex::prefixEditDistance("frei", "freiburg", 0));
+  ASSERT_EQ(1, QGramIndex::prefixEditDistance("frei", "breifurg", 1));
+  ASSERT_EQ(3, QGramIndex::prefixEditDistance("freiburg", "stuttgart", 2));
+  ASSERT_EQ(0, QGramIndex::prefixEditDistance("", "stuttgart", 2));
+  ASSERT_EQ(3, QGramIndex::prefixEditDistance("frei", "", 2));
+  ASSERT_EQ(2, QGramIndex::prefixEditDistance("frei", "fr", 2));
+}
+
+// _____________________________________________________________________________
+TEST(QGramIndexTest, prefixEditDistanceRandom) {
+  // Small alphabet, so that there are many (partial) matches. Lengths around
+  // 64 and beyond cover the single and the multi block case.
+  std::mt19937 gen(42);
+  for (size_t n : {1, 5, 17, 63, 64, 65, 100, 130}) {
+    for (size_t k = 0; k < 200; k++) {
+      std::string x, y;
+      for (size_t i = 0; i < n; i++) x += 'a' + gen() % 3;
+      size_t yLength = gen() % (n + 10);
+      for (size_t i = 0; i < yLength; i++) {
+        // Mostly a perturbed copy of x, sometimes random.
+        y += (i < n && gen() % 4 != 0) ? x[i] : 'a' + gen() % 3;
+      }
+      size_t delta = gen() % (n / 4 + 2);
+      PedPattern pattern(x);
+      ASSERT_EQ(referencePed(x, y, delta), pattern.compute(y, delta))
+          << x << " " << y << " " << delta;
+    }
+  }
+}
+
+// _____________________________________________________________________________
+TEST(QGramIndexTest, editDistance) {
+  ASSERT_EQ(0, PedPattern("frei").computeEditDistance("frei", 0));
+  ASSERT_EQ(1, PedPattern("frei").computeEditDistance("freiburg", 0));
+  ASSERT_EQ(4, PedPattern("frei").computeEditDistance("freiburg", 4));
+  ASSERT_EQ(1, PedPattern("frei").computeEditDistance("brei", 1));
+  ASSERT_EQ(2, PedPattern("").computeEditDistance("ab", 2));
+  std::mt19937 gen(42);
+  for (size_t n : {1, 5, 17, 63, 64, 65, 100}) {
+    for (size_t k = 0; k < 200; k++) {
+      std::string x, y;
+      for (size_t i = 0; i < n; i++) x += 'a' + gen() % 3;
+      size_t yLength = n + gen() % 7 - std::min<size_t>(n, 3);
+      for (size_t i = 0; i < yLength; i++) {
+        y += (i < n && gen() % 4 != 0) ? x[i] : 'a' + gen() % 3;
+      }
+      size_t delta = gen() % (n / 4 + 2);
+      ASSERT_EQ(referenceEd(x, y, delta),
+                PedPattern(x).computeEditDistance(y, delta))
+          << x << " " << y << " " << delta;
+    }
+  }
+}
+
+// _____________________________________________________________________________
+TEST(QGramIndexTest, prefixEditDistanceBatch) {
+  std::mt19937 gen(42);
+  for (size_t n : {0, 3, 8, 9, 16, 17, 32, 33, 64, 65}) {
+    std::string x;
+    for (size_t i = 0; i < n; i++) x += 'a' + gen() % 4;
+    PedPattern pattern(x);
+    // Include an odd number of candidates, so that the last batch is partial.
+    std::vector<std::string> ys(101);
+    std::vector<boost::string_ref> views;
+    for (std::string& y : ys) {
+      size_t yLength = gen() % (n + 10);
+      for (size_t i = 0; i < yLength; i++) {
+        y += (i < n && gen() % 4 != 0) ? x[i] : 'a' + gen() % 4;
+      }
+      views.push_back(y);
+    }
+    for (size_t delta : {n / 4, n / 2 + 3}) {
+      for (PedBatchMode mode : {PED_BATCH_AUTO, PED_BATCH_SCALAR,
+                                PED_BATCH_AVX2, PED_BATCH_AVX512}) {
+        if (!PedPattern::supports(mode)) continue;
+        std::vector<size_t> peds(ys.size());
+        pattern.computeBatch(views.data(), views.size(), delta, peds.data(),
+                             mode);
+        for (size_t i = 0; i < ys.size(); i++) {
+          ASSERT_EQ(referencePed(x, ys[i], delta), peds[i])
+              << x << " " << ys[i] << " " << delta << " " << mode;
+        }
+      }
+    }
+  }
+}
+
+// _____________________________________________________________________________
+TEST(QGramIndexTest, findMatches) {
+  QGramIndex index(3, false);
+  index.buildFromFile("example.tsv");
+
+  // delta = 1 for prefixes of length 4.
+  auto result = index.findMatches("Frei");
+  ASSERT_EQ(2, result.second);
+  ASSERT_EQ(2, result.first.size());
+  ASSERT_EQ("frei", result.first[0].name);
+  ASSERT_EQ(0, result.first[0].ped);
+  ASSERT_EQ("brei", result.first[1].name);
+  ASSERT_EQ(1, result.first[1].ped);
+
+  // "frei" passes the count filter, but is too short for a PED of 1.
+  result = index.findMatches("freibu");
+  ASSERT_EQ(0, result.second);
+  ASSERT_EQ(0, result.first.size());
+
+  result = index.findMatches("liber");
+  ASSERT_EQ(0, result.second);
+  ASSERT_EQ(0, result.first.size());
+}
+
+// _____________________________________________________________________________
+TEST(QGramIndexTest, findMatchesWithSynonyms) {
+  QGramIndex index(3, true);
+  index.buildFromFile("example.tsv");
+
+  auto result = index.findMatches("liber");
+  ASSERT_EQ(1, result.first.size());
+  ASSERT_EQ("frei", result.first[0].name);
+  ASSERT_EQ("liberty", result.first[0].matchedSynonym);
+  ASSERT_EQ(0, result.first[0].ped);
+
+  // The name matches, so the synonyms are not considered.
+  result = index.findMatches("frei");
+  ASSERT_EQ(2, result.first.size());
+  ASSERT_EQ("", result.first[0].matchedSynonym);
+}
+
+// _____________________________________________________________________________
+TEST(QGramIndexTest, findMatchesRecords) {
+  QGramIndex index(3, true);
+  index.buildFromFile("example.tsv");
+  // split() turns the empty synonyms field of "brei" into one empty synonym.
+  ASSERT_EQ("freiheit", index.normalizedString(2));
+  ASSERT_EQ("liberty", index.normalizedString(3));
+  ASSERT_EQ("", index.normalizedString(5));
+  ASSERT_EQ(std::vector<uint32_t>({0, 2, 3}), toVector(index._synonymOffsets));
+
+  // The same buffers for several queries.
+  MatchBuffers buffers;
+  std::vector<Match> matches;
+  // "frei", "freiheit" and "brei" pass the filters. The name of entity 1
+  // beats the synonym with the same PED.
+  ASSERT_EQ(3, index.findMatches("Frei", buffers, matches));
+  ASSERT_EQ(2, matches.size());
+  ASSERT_EQ(1, matches[0].entityId);
+  ASSERT_EQ(0, matches[0].ped);
+  ASSERT_EQ(NO_SYNONYM, matches[0].synonym);
+  ASSERT_EQ(2, matches[1].entityId);
+  ASSERT_EQ(1, matches[1].ped);
+
+  // Only "liberty" passes the count filter, not the other strings of entity 1.
+  ASSERT_EQ(1, index.findMatches("liber", buffers, matches));
+  ASSERT_EQ(0, buffers.stats.numLength);
+  ASSERT_EQ(0, buffers.stats.numSignature);
+  ASSERT_EQ(0, buffers.stats.numPosition);
+  ASSERT_EQ(1, matches.size());
+  ASSERT_EQ(1, matches[0].entityId);
+  ASSERT_EQ(1, matches[0].synonym);
+  Entity entity = index.materialize(matches[0]);
+  ASSERT_EQ("frei", entity.name);
+  ASSERT_EQ("liberty", entity.matchedSynonym);
+  ASSERT_EQ(0, entity.ped);
+
+  ASSERT_EQ(0, index.findMatches("", buffers, matches));
+  ASSERT_EQ(0, matches.size());
+}
+
+// _____________________________________________________________________________
+TEST(QGramIndexTest, stageTimes) {
+  QGramIndex index(3, true);
+  index.buildFromFile("example.tsv");
+  MatchBuffers buffers;
+  std::vector<Match> matches;
+  index.findMatches("Frei", buffers, matches);
+  for (double seconds : buffers.times.seconds) { ASSERT_EQ(0, seconds); }
+
+  // Every stage of a query with matches takes some time, and the times add
+  // up over queries.
+  buffers.times.enabled = true;
+  index.findMatches("Frei", buffers, matches);
+  StageTimes times = buffers.times;
+  for (double seconds : times.seconds) { ASSERT_GT(seconds, 0); }
+  index.findMatches("Frei", buffers, matches);
+  for (size_t i = 0; i < NUM_QUERY_STAGES; i++) {
+    ASSERT_GT(buffers.times.seconds[i], times.seconds[i]);
+  }
+  ASSERT_EQ(2, matches.size());
+}
+
+// _____________________________________________________________________________
+TEST(QGramIndexTest, computeSignature) {
+  ASSERT_EQ(0, QGramIndex::computeSignature(""));
+  // a, a twice, b and 1.
+  ASSERT_EQ((1ull << 0) | (1ull << 36) | (1ull << 1) | (1ull << 27),
+            QGramIndex::computeSignature("aab1"));
+  // Digits get no second bit.
+  ASSERT_EQ(1ull << 26, QGramIndex::computeSignature("00"));
+}
+
+// _____________________________________________________________________________
+TEST(QGramIndexTest, filters) {
+  {
+    std::ofstream out("QGramIndexTest.TMP.tsv");
+    out << "name\tscore\n";
+    out << "xyzabcd\t3\n";
+    out << "zabcdqqqxyz\t2\n";
+    out << "xyz\t1\n";
+  }
+  QGramIndex index(3, false);
+  index.buildFromFile("QGramIndexTest.TMP.tsv");
+  ASSERT_EQ(std::vector<uint32_t>({1, 2}), getList(index, "abc"));
+  ASSERT_EQ(std::vector<uint8_t>({5, 3}), listPositions(
+      index.getInvertedList(QGramIndex::packQGram("abc"))));
+
+  // delta = 1 and T = 4. The second entity shares 4 q-grams with the prefix,
+  // but all of them at positions that differ by 2 or more.
+  MatchBuffers buffers;
+  std::vector<uint32_t> candidates;
+  ASSERT_EQ(1, index.findCandidates("xyzabcd", buffers, candidates));
+  ASSERT_EQ(std::vector<uint32_t>({1}), candidates);
+  ASSERT_EQ(1, buffers.stats.numPosition);
+
+  // delta = 1 and T = 2. "xyz" is too short.
+  std::vector<Match> matches;
+  ASSERT_EQ(1, index.findMatches("xyzab", buffers, matches));
+  ASSERT_EQ(1, buffers.stats.numLength);
+  ASSERT_EQ(0, buffers.stats.numSignature);
+  ASSERT_EQ(1, buffers.stats.numPosition);
+  ASSERT_EQ(1, matches.size());
+  ASSERT_EQ(1, matches[0].entityId);
+}
+
+// _____________________________________________________________________________
+TEST(QGramIndexTest, findTopMatches) {
+  // Entity "freiI" has score I, so the ids are in reverse file order.
+  {
+    std::ofstream out("QGramIndexTest.TMP.tsv");
+    out << "name\tscore\n";
+    for (size_t i = 0; i < 1000; i++) out << "frei" << i << "\t" << i << "\n";
+    out << "brei\t5000\n";
+  }
+  QGramIndex index(3, false);
+  index.buildFromFile("QGramIndexTest.TMP.tsv");
+  ASSERT_EQ("brei", index._entities.name(1));
+  ASSERT_EQ("frei999", index._entities.name(2));
+
+  // The first batch of candidates already has 5 matches with PED 0.
+  MatchBuffers buffers;
+  std::vector<Match> matches;
+  size_t numFound;
+  bool isExact;
+  size_t numPeds = index.findTopMatches("frei", 5, false, buffers, matches,
+      numFound, isExact);
+  ASSERT_EQ(VERIFY_BATCH_SIZE, numPeds);
+  ASSERT_FALSE(isExact);
+  ASSERT_NEAR(1001, numFound, 10);
+  ASSERT_EQ(5, matches.size());
+  ASSERT_EQ(2, matches[0].entityId);
+  ASSERT_EQ(0, matches[0].ped);
+  ASSERT_EQ("frei995", index.materialize(matches[4]).name);
+
+  numPeds = index.findTopMatches("frei", 5, true, buffers, matches, numFound,
+      isExact);
+  ASSERT_EQ(1001, numPeds);
+  ASSERT_TRUE(isExact);
+  ASSERT_EQ(1001, numFound);
+  ASSERT_EQ(2, matches[0].entityId);
+
+  // Only a match with PED 1, so all candidates are checked.
+  numPeds = index.findTopMatches("brai", 5, false, buffers, matches, numFound,
+      isExact);
+  ASSERT_TRUE(isExact);
+  ASSERT_EQ(1, numFound);
+  ASSERT_EQ(1, matches[0].entityId);
+  ASSERT_EQ(1, matches[0].ped);
+}
+
+// _____________________________________________________________________________
+TEST(QGramIndexTest, findWordMatches) {
+  {
+    std::ofstream out("QGramIndexTest.TMP.tsv");
+    out << "name\tscore\tdescription\twikipediaUrl\twikidataId\tsynonyms\n";
+    out << "University of Freiburg\t9\t\t\t\tUni Freiburg;Albert-Ludwigs\n";
+    out << "Freiburg im Breisgau\t8\t\t\t\tFreiburg\n";
+    out << "University of Stuttgart\t7\t\t\t\t\n";
+  }
+  QGramIndex index(3, true);
+  index.buildFromFile("QGramIndexTest.TMP.tsv");
+  ASSERT_TRUE(QGramIndex::hasSeveralWords("uni frei"));
+  ASSERT_FALSE(QGramIndex::hasSeveralWords("  uni!"));
+  ASSERT_EQ("albert", index.word(1));
+  ASSERT_EQ("university", index.word(index.numWords()));
+
+  // "universty" has ED 1 to "university" as a complete word and PED 1 as a
+  // prefix, "frie" has PED 1 to "freiburg". The order of the words in the
+  // name doesn't matter.
+  MatchBuffers buffers;
+  std::vector<Match> matches;
+  index.findMatches("universty frie", buffers, matches);
+  ASSERT_EQ(1, matches.size());
+  ASSERT_EQ(1, matches[0].entityId);
+  ASSERT_EQ(2, matches[0].ped);
+  ASSERT_EQ(NO_SYNONYM, matches[0].synonym);
+  index.findMatches("Freiburg, universty", buffers, matches);
+  ASSERT_EQ(1, matches.size());
+  ASSERT_EQ(1, matches[0].ped);
+  // The synonym matches better than the name.
+  index.findMatches("uni freib", buffers, matches);
+  ASSERT_EQ(1, matches.size());
+  ASSERT_EQ(0, matches[0].synonym);
+  ASSERT_EQ(0, matches[0].ped);
+  // "univ" is a complete word here, and not within delta = 1 of any.
+  index.findMatches("univ of", buffers, matches);
+  ASSERT_EQ(0, matches.size());
+  index.findMatches("freiburg i", buffers, matches);
+  ASSERT_EQ(1, matches.size());
+  ASSERT_EQ(2, matches[0].entityId);
+  size_t numFound;
+  bool isExact;
+  index.findTopMatches("of univ", 1, false, buffers, matches, numFound,
+      isExact);
+  ASSERT_TRUE(isExact);
+  ASSERT_EQ(2, numFound);
+  ASSERT_EQ(1, matches.size());
+  ASSERT_EQ(1, matches[0].entityId);
+
+  // Random names of a few words over a small alphabet, compared to the
+  // definition, and the shards to the whole.
+  std::mt19937 gen(42);
+  auto randomText = [&gen](size_t maxWords) {
+    std::string text;
+    size_t numWords = 1 + gen() % maxWords;
+    for (size_t i = 0; i < numWords; i++) {
+      if (i > 0) text += " ";
+      size_t length = 1 + gen() % 9;
+      for (size_t j = 0; j < length; j++) text += 'a' + gen() % 3;
+    }
+    return text;
+  };
+  {
+    std::ofstream out("QGramIndexTest.TMP.tsv");
+    out << "name\tscore\tdescription\twikipediaUrl\twikidataId\tsynonyms\n";
+    for (size_t i = 0; i < 300; i++) {
+      out << randomText(3) << "\t" << 300 - i << "\t\t\t\t"
+          << randomText(3) << ";" << randomText(3) << "\n";
+    }
+  }
+  index = QGramIndex(3, true);
+  index.buildFromFile("QGramIndexTest.TMP.tsv");
+  for (size_t k = 0; k < 100; k++) {
+    std::string query = randomText(3) + " " + randomText(1);
+    std::vector<std::string> words;
+    tokenizeUtf8(query.data(), query.size(), words);
+
+    // The distance of a string: the sum over the words of the query.
+    std::vector<Match> expected;
+    for (uint32_t id = 1; id <= index._entities.size(); id++) {
+      Match best(id, UINT32_MAX, NO_SYNONYM);
+      for (uint32_t s = index.stringId(id, NO_SYNONYM);
+           s <= index.stringId(id, NO_SYNONYM) + index.numIndexedSynonyms(id);
+           s++) {
+        uint32_t synonym = index.stringSynonym(s);
+        boost::string_ref str = synonym == NO_SYNONYM ?
+            index._entities.name(id) : index._entities.synonym(id, synonym);
+        std::vector<std::string> strWords;
+        tokenizeUtf8(str.data(), str.size(), strWords);
+        size_t sum = 0;
+        for (size_t i = 0; i < words.size() && sum != UINT32_MAX; i++) {
+          size_t delta = words[i].size() / 4;
+          size_t distance = delta + 1;
+          for (const std::string& y : strWords) {
+            distance = std::min(distance, i + 1 == words.size() ?
+                referencePed(words[i], y, delta) :
+                referenceEd(words[i], y, delta));
+          }
+          sum = distance <= delta ? sum + distance : UINT32_MAX;
+        }
+        if (sum < best.ped) {
+          best = Match(id, sum, synonym);
+          if (synonym == NO_SYNONYM) { break; }
+        }
+      }
+      if (best.ped != UINT32_MAX) { expected.push_back(best); }
+    }
+    QGramIndex::rankMatches(expected);
+
+    index.findMatches(query, buffers, matches);
+    ASSERT_EQ(expected.size(), matches.size()) << query;
+    for (size_t i = 0; i < matches.size(); i++) {
+      ASSERT_EQ(expected[i].entityId, matches[i].entityId) << query;
+      ASSERT_EQ(expected[i].ped, matches[i].ped) << query;
+      ASSERT_EQ(expected[i].synonym, matches[i].synonym) << query;
+    }
+    index.setNumShards(3);
+    std::vector<std::vector<Match> > parts(3);
+    for (size_t shard = 0; shard < 3; shard++) {
+      index.findShardMatches(query, shard, buffers, parts[shard]);
+    }
+    index.setNumShards(1);
+    QGramIndex::mergeRankedMatches(parts, SIZE_MAX, matches);
+    ASSERT_EQ(expected.size(), matches.size()) << query;
+    for (size_t i = 0; i < matches.size(); i++) {
+      ASSERT_EQ(expected[i].entityId, matches[i].entityId) << query;
+    }
+  }
+}
+
+// _____________________________________________________________________________
+TEST(QGramIndexTest, findCompletions) {
+  QGramIndex index(3, true);
+  index.buildFromFile("example.tsv");
+  std::vector<Match> matches;
+  size_t numFound;
+  ASSERT_TRUE(index.findCompletions("fr", 5, matches, numFound));
+  ASSERT_EQ(1, numFound);
+  ASSERT_EQ(1, matches.size());
+  ASSERT_EQ(1, matches[0].entityId);
+  ASSERT_EQ(NO_SYNONYM, matches[0].synonym);
+  // Only the synonym "liberty" starts with "lib".
+  ASSERT_TRUE(index.findCompletions("lib", 5, matches, numFound));
+  ASSERT_EQ(1, matches.size());
+  ASSERT_EQ(1, matches[0].synonym);
+  ASSERT_TRUE(index.findCompletions("r", 5, matches, numFound));
+  ASSERT_EQ(0, numFound);
+  ASSERT_EQ(0, matches.size());
+  ASSERT_FALSE(index.findCompletions("frei", 5, matches, numFound));
+  ASSERT_FALSE(index.findCompletions("", 5, matches, numFound));
+  ASSERT_FALSE(index.findCompletions("fr", COMPLETION_TOP_N + 1, matches,
+      numFound));
+
+  // All prefixes up to length 3 over a small alphabet, compared to the full
+  // search.
+  std::mt19937 gen(42);
+  {
+    std::ofstream out("QGramIndexTest.TMP.tsv");
+    out << "name\tscore\tdescription\twikipediaUrl\twikidataId\tsynonyms\n";
+    for (size_t i = 0; i < 500; i++) {
+      std::string fields[3];
+      for (std::string& field : fields) {
+        size_t length = gen() % 6;
+        for (size_t j = 0; j < length; j++) field += 'a' + gen() % 3;
+      }
+      out << "x" << fields[0] << "\t" << gen() % 100 << "\t\t\t\t"
+          << fields[1] << ";" << fields[2] << "\n";
+    }
+  }
+  index = QGramIndex(3, true);
+  index.buildFromFile("QGramIndexTest.TMP.tsv");
+  MatchBuffers buffers;
+  std::vector<Match> expected;
+  for (std::string prefix : {"a", "b", "x", "ab", "ca", "xa", "aaa", "bca",
+      "xab", "xxx"}) {
+    index.findMatches(prefix, buffers, expected);
+    ASSERT_TRUE(index.findCompletions(prefix, 5, matches, numFound));
+    ASSERT_EQ(expected.size(), numFound);
+    expected.resize(std::min<size_t>(5, expected.size()));
+    ASSERT_EQ(expected.size(), matches.size());
+    for (size_t i = 0; i < matches.size(); i++) {
+      ASSERT_EQ(expected[i].entityId, matches[i].entityId) << prefix;
+      ASSERT_EQ(expected[i].synonym, matches[i].synonym) << prefix;
+      ASSERT_EQ(0, matches[i].ped);
+    }
+  }
+}
+
+// _____________________________________________________________________________
+TEST(QGramIndexTest, rankMatches) {
+  std::vector<Entity> matches = {
+    Entity("foo", 3), Entity("bar", 7), Entity("baz", 2), Entity("boo", 5)
+  };
+  matches[0].ped = 2;
+  matches[1].ped = 0;
+  matches[2].ped = 1;
+  matches[3].ped = 1;
+  std::vector<Entity> ranked = QGramIndex::rankMatches(matches);
+  ASSERT_EQ("bar", ranked[0].name);
+  ASSERT_EQ("boo", ranked[1].name);
+  ASSERT_EQ("baz", ranked[2].name);
+  ASSERT_EQ("foo", ranked[3].name);
+}
@@ -8,68 +8,91 @@
 #include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <regex>
+#include <thread>
+#include <vector>
 
 #include "./SearchServer.h"
 
 
-// _____________________________________________________________________________
-void SearchServer::run() {
-  // The main server loop.
-  while (true) {
-    // Wait for the client.
-    std::cout << "\n\nWaiting on port " << _server.port()
-        << " ... " << std::flush;
-    _acceptor.accept(_client);
-    std::cout << "client connected from "
-        << _client.remote_endpoint().address().to_string() << std::endl;
+thread_local SearchServer::Searcher* SearchServer::_searcher = nullptr;
 
-    try {
-      // Set the timeout for the client.
-      _timer.expires_from_now(boost::posix_time::seconds(1));
-      _timer.async_wait(boost::bind(&SearchServer::handleTimeout, this, _1));
-
-      // Read only the first line of the request from the client.
-      boost::asio::async_read_until(_client, _requestBuffer,
-          DEFAULT_LINE_DELIMITER,
-          boost::bind(&SearchServer::handleRequest, this, _1));
-
-      _ioService.run();
-      _ioService.reset();
-    } catch (boost::exception& e) {
-      // Socket was close by remote, continue listening
-      std::cout << "WARN: " << boost::diagnostic_information(e) << std::endl;
-      continue;
-    }
-  }
+// One client connection. Its handlers run on a strand, so never at the same
+// time, and each holds the connection, which closes when the last one is
+// done: after the response, or after a timeout of one second while reading
+// the request.
+class SearchServer::Connection
+    : public std::enable_shared_from_this<Connection> {
+ public:
+  explicit Connection(SearchServer& server) : _server(server),
+      _socket(server._ioService), _strand(server._ioService),
+      _timer(server._ioService) {}
+
+  boost::asio::ip::tcp::socket& socket() { return _socket; }
+
+  // Starts reading the request.
+  void start();
+
+ private:
+  // Handles a timeout of the client.
+  void handleTimeout(const boost::system::error_code& error);
+
+  // Handles the first line of the request: posts it to the workers.
+  void handleRequest(const boost::system::error_code& error);
+
+  // Creates the response, on a worker, and has the strand write it.
+  void respond(const std::string& request);
+
+  // Closes the connection to the client.
+  void close();
+
+  SearchServer& _server;
+  boost::asio::ip::tcp::socket _socket;
+  boost::asio::io_service::strand _strand;
+  boost::asio::deadline_timer _timer;
+
+  // The request buffer and the response.
+  boost::asio::streambuf _requestBuffer;
+  std::string _response;
+};
+
+// _____________________________________________________________________________
+void SearchServer::Connection::start() {
+  // Set the timeout for the client.
+  _timer.expires_from_now(boost::posix_time::seconds(1));
+  _timer.async_wait(_strand.wrap(boost::bind(&Connection::handleTimeout,
+      shared_from_this(), _1)));
+
+  // Read only the first line of the request from the client.
+  boost::asio::async_read_until(_socket, _requestBuffer,
+      DEFAULT_LINE_DELIMITER, _strand.wrap(boost::bind(
+          &Connection::handleRequest, shared_from_this(), _1)));
 }
 
 // _____________________________________________________________________________
-void SearchServer::handleTimeout(const boost::system::error_code& e) {
+void SearchServer::Connection::handleTimeout(
+    const boost::system::error_code& e) {
   if (e) {
     return;
   }
 
-  std::cout << "Timeout. " << std::endl;
-
-  // Clear the request buffer.
-  _requestBuffer.consume(_requestBuffer.size());
-
-  // Cancel the timeout timer.
-  _timer.cancel();
-
-  // Close the connection to the client.
-  _client.shutdown(boost::asio::ip::tcp::socket::shutdown_send);
-  _client.close();
+  _server.log("Timeout.\n");
+  close();
 }
 
 // _____________________________________________________________________________
-void SearchServer::handleRequest(const boost::system::error_code& e) {
+void SearchServer::Connection::handleRequest(
+    const boost::system::error_code& e) {
   if (e) {
     return;
   }
 
+  // The request is complete, the worker may take its time.
+  _timer.cancel();
+
   std::string request;
   std::istream istream(&_requestBuffer);
   std::getline(istream, request);
@@ -86,33 +109,116 @@ void SearchServer::handleRequest(const boost::system::error_code& e) {
     request = request.replace(pos2, 1, "");
   }
 
+  std::shared_ptr<Connection> self = shared_from_this();
+  _server._workService.post([self, request]() { self->respond(request); });
+}
+
+// _____________________________________________________________________________
+void SearchServer::Connection::respond(const std::string& request) {
   // Handle the request line and create the response.
-  std::stringstream response = createResponse(request);
+  std::stringstream log;
+  _response = _server.createResponse(request, *_searcher, log).str();
+  _server.log(log.str());
+
+  // Send the response to the client, then close the connection.
+  std::shared_ptr<Connection> self = shared_from_this();
+  _strand.post([self]() {
+    boost::asio::async_write(self->_socket,
+        boost::asio::buffer(self->_response), self->_strand.wrap(
+            [self](const boost::system::error_code&, size_t) {
+              self->close();
+            }));
+  });
+}
+
+// _____________________________________________________________________________
+void SearchServer::Connection::close() {
+  // The client may be gone already.
+  boost::system::error_code ignored;
+  _socket.shutdown(boost::asio::ip::tcp::socket::shutdown_send, ignored);
+  _socket.close(ignored);
+}
+
+// _____________________________________________________________________________
+void SearchServer::run() {
+  log("\n\nWaiting on port " + std::to_string(port()) + " ...\n");
+  startAccept();
+
+  // The workers, and the I/O threads besides this one. The work object keeps
+  // the workers waiting while there are no requests.
+  size_t numThreads = _numThreads > 0 ? _numThreads :
+      std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  std::unique_ptr<boost::asio::io_service::work> idle(
+      new boost::asio::io_service::work(_workService));
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < numThreads; i++) {
+    threads.emplace_back(&SearchServer::work, this);
+  }
+  for (size_t i = 1; i < numThreads; i++) {
+    threads.emplace_back([this]() { runService(_ioService); });
+  }
+  runService(_ioService);
 
-  // Send the response to the client.
-  boost::asio::write(_client, boost::asio::buffer(response.str()),
-      boost::asio::transfer_all());
+  // Drop the requests that are still queued.
+  _workService.stop();
+  for (std::thread& thread : threads) { thread.join(); }
+}
 
-  // Clear the request buffer.
-  _requestBuffer.consume(_requestBuffer.size());
+// _____________________________________________________________________________
+void SearchServer::stop() {
+  _ioService.stop();
+}
 
-  // Cancel the timeout timer.
-  _timer.cancel();
+// _____________________________________________________________________________
+void SearchServer::startAccept() {
+  std::shared_ptr<Connection> connection = std::make_shared<Connection>(*this);
+  _acceptor.async_accept(connection->socket(),
+      [this, connection](const boost::system::error_code& error) {
+        if (!error) {
+          boost::system::error_code ignored;
+          log("client connected from " + connection->socket()
+              .remote_endpoint(ignored).address().to_string() + "\n");
+          connection->start();
+        }
+        if (error != boost::asio::error::operation_aborted) { startAccept(); }
+      });
+}
 
-  // Close the connection to the client.
-  _client.shutdown(boost::asio::ip::tcp::socket::shutdown_send);
-  _client.close();
+// _____________________________________________________________________________
+void SearchServer::work() {
+  Searcher searcher(*this);
+  _searcher = &searcher;
+  runService(_workService);
+  _searcher = nullptr;
 }
 
 // _____________________________________________________________________________
-std::stringstream SearchServer::createResponse(const std::string& requestLine)
-    const {
+void SearchServer::runService(boost::asio::io_service& service) {
+  while (true) {
+    try {
+      service.run();
+      return;
+    } catch (const std::exception& e) {
+      log(std::string("WARN: ") + e.what() + "\n");
+    }
+  }
+}
+
+// _____________________________________________________________________________
+void SearchServer::log(const std::string& text) const {
+  std::lock_guard<std::mutex> lock(_logMutex);
+  std::cout << text << std::flush;
+}
+
+// _____________________________________________________________________________
+std::stringstream SearchServer::createResponse(const std::string& requestLine,
+    Searcher& searcher, std::ostream& log) const {
   std::stringstream response;
 
   std::smatch matcher;
   if (!std::regex_search(requestLine, matcher, HTTP_REQUEST_HEADER_REGEX)) {
     // The request contains no valid HTTP header.
-    std::cout << "RESPONSE: 405 (No valid HTTP request)." << std::endl;
+    log << "RESPONSE: 405 (No valid HTTP request).\n";
     response << HTTP_ERROR_RESPONSES.find(405)->second;
     return response;
   }
@@ -122,26 +228,25 @@ std::stringstream SearchServer::createResponse(const std::string& requestLine)
   std::string fileName = matcher[2];
   std::string parameters = matcher[3];
 
-  std::cout << "REQUEST: HTTP_METHOD: " << httpMethod << ", FILE_NAME: "
-            << fileName << ", PARAMETERS: " << parameters << std::endl;
+  log << "REQUEST: HTTP_METHOD: " << httpMethod << ", FILE_NAME: "
+      << fileName << ", PARAMETERS: " << parameters << "\n";
 
   if (httpMethod.compare("GET") != 0) {
     // Only GET requests are supported.
-    std::cout << "RESPONSE: 405 (No GET request)." << std::endl;
+    log << "RESPONSE: 405 (No GET request).\n";
     response << HTTP_ERROR_RESPONSES.find(405)->second;
     return response;
   }
 
   if (fileName.length() == 0) {
     // No fileName is given, take the default one.
-    std::cout << "Setting fileName to default '"<< DEFAULT_FILE_NAME << "'."
-              << std::endl;
+    log << "Setting fileName to default '"<< DEFAULT_FILE_NAME << "'.\n";
     fileName = DEFAULT_FILE_NAME;
   }
 
   if (!std::regex_match(fileName, std::regex("[a-zA-Z.]+"))) {
     // The fileName contains invalid characters.
-    std::cout << "RESPONSE: 403 (fileName with invalid chars)." << std::endl;
+    log << "RESPONSE: 403 (fileName with invalid chars).\n";
     response << HTTP_ERROR_RESPONSES.find(403)->second;
     return response;
   }
@@ -149,7 +254,7 @@ std::stringstream SearchServer::createResponse(const std::string& requestLine)
   std::ifstream fstream((SERVE_DIR + fileName).c_str(), std::ios_base::in);
   if (!fstream && fileName.compare(API_URL) != 0) {
     // The requested file does not exist or is not readable.
-    std::cout << "RESPONSE: 404 (File does not exist)." << std::endl;
+    log << "RESPONSE: 404 (File does not exist).\n";
         response << HTTP_ERROR_RESPONSES.find(404)->second;
     return response;
   }
@@ -160,12 +265,12 @@ std::stringstream SearchServer::createResponse(const std::string& requestLine)
 
   if (fileName.compare(API_URL) == 0) {
     // Handle a fuzzy prefix search request.
-    std::cout << "API call" << std::endl;
-    ss = handleFuzzyPrefixSearchRequest(parameters, ss);
+    log << "API call\n";
+    ss = handleFuzzyPrefixSearchRequest(parameters, ss, searcher, log);
   }
 
   // Create the HTTP response.
-  std::cout << "RESPONSE: 200 (OK)." << std::endl;
+  log << "RESPONSE: 200 (OK).\n";
   std::string contentType = getContentType(fileName);
   response << HTTP_OK_HEADER << DEFAULT_LINE_DELIMITER
            << "Content-type: " << contentType << DEFAULT_LINE_DELIMITER
@@ -178,32 +283,94 @@ std::stringstream SearchServer::createResponse(const std::string& requestLine)
 
 // _____________________________________________________________________________
 std::stringstream SearchServer::handleFuzzyPrefixSearchRequest(
-    const std::string& params, const std::stringstream& stream) const {
-  // Check if there is a query given in the parameters.
+    const std::string& params, const std::stringstream& stream,
+    Searcher& searcher, std::ostream& log) const {
+  // Check if there is a query given in the parameters, whether the client
+  // wants the exact number of matches (exact=1) rather than an estimate, and
+  // whether the query belongs to an as-you-type session.
   std::string query = "";
-  size_t pos = params.find("?q=");
-  if (pos != std::string::npos) {
-    query = params.substr(pos + 3);
+  bool exactCount = false;
+  std::string sessionToken;
+  if (params.size() > 0 && params[0] == '?') {
+    for (const std::string& param : QGramIndex::split(params.substr(1), '&')) {
+      if (param.compare(0, 2, "q=") == 0) { query = param.substr(2); }
+      if (param == "exact=1") { exactCount = true; }
+      if (param.compare(0, 8, "session=") == 0) {
+        sessionToken = param.substr(8);
+      }
+    }
   }
 
   // TODO(i): spaces + special chars
   query = urlDecode(query);
-  std::cout << "query = " << query << "\n";
-
-  // size_t numResultsTotal = 0;
-  size_t numResultsToShow = 0;
+  log << "query = " << query << "\n";
 
   // Pass the query to the q-gram index and create JSON.
   std::stringstream resultJSON;
   if (query.length() != 0) {
-    auto result = _index.findMatches(query);
-    std::vector<Entity> matches = result.first;
-    numResultsToShow = std::min(matches.size(), NUM_SEARCH_RESULTS_TO_SHOW);
-    resultJSON << translateToJSON(matches, numResultsToShow);
+    size_t numFound = 0;
+    bool isExact = true;
+    PerfRegions::Stats before = searcher.perf.get("findMatches");
+    {
+      PerfRegion region(searcher.perf, "findMatches");
+      if (sessionToken.empty()) {
+        bool isSharded = _index.numShards() > 1;
+        size_t numPedComputations = isSharded ?
+            findTopMatches(searcher.parallelSearch, _trie, query,
+                NUM_SEARCH_RESULTS_TO_SHOW, exactCount, searcher.matchBuffers,
+                searcher.matches, numFound, isExact) :
+            findTopMatches(_index, _trie, query, NUM_SEARCH_RESULTS_TO_SHOW,
+                exactCount, searcher.matchBuffers, searcher.matches, numFound,
+                isExact);
+        FilterStats stats = isSharded ? searcher.parallelSearch.stats() :
+            searcher.matchBuffers.stats;
+        log << "PED computations: " << numPedComputations
+            << ", filtered: " << stats.numPosition << " by position, "
+            << stats.numLength << " by length, " << stats.numSignature
+            << " by signature\n";
+      } else {
+        // The session knows all matches, so the count is always exact. Its
+        // requests may come in over several connections at once.
+        std::shared_ptr<Session> session = getSession(sessionToken);
+        std::lock_guard<std::mutex> lock(session->mutex);
+        session->session.findTopMatches(query, NUM_SEARCH_RESULTS_TO_SHOW,
+            searcher.matches, numFound);
+      }
+    }
+    searcher.perf.report(log, "findMatches",
+        searcher.perf.get("findMatches") - before);
+
+    // Copy only the entities that are actually sent back.
+    std::vector<Entity> entities;
+    for (const Match& match : searcher.matches) {
+      entities.push_back(_index.materialize(match));
+    }
+    resultJSON << translateToJSON(entities, numFound, isExact);
   }
   return resultJSON;
 }
 
+// _____________________________________________________________________________
+std::shared_ptr<SearchServer::Session> SearchServer::getSession(
+    const std::string& token) const {
+  std::lock_guard<std::mutex> lock(_sessionsMutex);
+  _numRequests++;
+  auto it = _sessions.find(token);
+  if (it == _sessions.end()) {
+    if (_sessions.size() >= MAX_NUM_SESSIONS) {
+      auto oldest = _sessions.begin();
+      for (auto jt = _sessions.begin(); jt != _sessions.end(); ++jt) {
+        if (jt->second.second < oldest->second.second) { oldest = jt; }
+      }
+      _sessions.erase(oldest);
+    }
+    it = _sessions.insert(std::make_pair(token,
+        std::make_pair(std::make_shared<Session>(_index), size_t(0)))).first;
+  }
+  it->second.second = _numRequests;
+  return it->second.first;
+}
+
 // _____________________________________________________________________________
 std::string SearchServer::translateToHtml(const Entity& entity) const {
   std::string html = std::string(_entityHtmlPattern);
@@ -279,9 +446,11 @@ void SearchServer::replaceAll(std::string& str, const std::string& from,
 
 // _____________________________________________________________________________
 std::string SearchServer::translateToJSON(const std::vector<Entity>& entities,
-    size_t numResultsToShow) const {
+    size_t numFound, bool isExact) const {
+  size_t numResultsToShow = entities.size();
   std::string json;
-  json += "{\"found\":" + std::to_string(entities.size()) + ",";
+  json += "{\"found\":" + std::to_string(numFound) + ",";
+  json += std::string("\"exact\":") + (isExact ? "true" : "false") + ",";
   json += "\"res\":[";
   for (size_t i = 0; i < numResultsToShow; i++) {
     json += "{";
@@ -10,7 +10,16 @@
 #include <regex>
 #include <locale>
 #include <codecvt>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "./ParallelSearch.h"
 #include "./QGramIndex.h"
+#include "./PerfCounters.h"
+#include "./PrefixTrie.h"
+#include "./SearchSession.h"
 
 // The base directory of the files to serve.
 const char SERVE_DIR[] = "./resources/";
@@ -69,19 +78,30 @@ const char ENTITY_TEMPLATE_FILE[] = "entity.pattern.html";
 // The number of search results to show per default.
 const size_t NUM_SEARCH_RESULTS_TO_SHOW = 5;
 
+// The maximal number of as-you-type sessions kept; the least recently used
+// one is dropped beyond that.
+const size_t MAX_NUM_SESSIONS = 64;
+
 // URL, where API is reachable
 const char API_URL[] = "api";
 
-// A simple server that handles fuzzy prefix search requests and file requests.
+// A server that handles fuzzy prefix search requests and file requests
+// concurrently. Connections are accepted asynchronously, and each one reads
+// the first line of its request, has a worker answer it and writes the
+// response. A few threads run the I/O, and the queries (the CPU-heavy part)
+// run on a separate pool of workers, each with its own scratch memory.
 class SearchServer {
  public:
-  // Creates a new search server.
-  SearchServer(const QGramIndex& index, uint16_t port) :
-        _index(index),
+  // Creates a new search server with the given number of I/O threads and of
+  // workers each (0 for one per hardware thread). If the index has several
+  // shards, each query searches them in parallel, on one thread per shard.
+  SearchServer(const QGramIndex& index, uint16_t port, size_t numThreads = 0)
+      : _index(index),
+        _trie(_index),
+        _pool(_index.numShards() - 1),
         _server(boost::asio::ip::tcp::v4(), port),
         _acceptor(_ioService, _server),
-        _client(_ioService),
-        _timer(_ioService) {
+        _numThreads(numThreads) {
     // Read the HTML template for the entities of the q-gram index.
     // This is no longer necessary since we serve json
     // std::ifstream ifstream(SERVE_DIR + std::string(ENTITY_TEMPLATE_FILE));
@@ -90,34 +110,93 @@ class SearchServer {
     // _entityHtmlPattern = buffer.str();
   }
 
-  // Starts the server loop.
+  // Same, but loads the trie from the given file (written by PrefixTrie::save
+  // for the same index) instead of building it.
+  SearchServer(const QGramIndex& index, const std::string& trieFileName,
+      uint16_t port, size_t numThreads = 0)
+      : _index(index),
+        _trie(_index, trieFileName, true),
+        _pool(_index.numShards() - 1),
+        _server(boost::asio::ip::tcp::v4(), port),
+        _acceptor(_ioService, _server),
+        _numThreads(numThreads) {}
+
+  // Runs the server until stop() is called, on the calling thread and the
+  // threads it starts.
   void run();
 
+  // Makes run() return: stops accepting and drops the open connections. Can
+  // be called from any thread, also before run().
+  void stop();
+
+  // Returns the port the server listens on (chosen by the system if it was
+  // created with port 0).
+  uint16_t port() const { return _acceptor.local_endpoint().port(); }
+
   // Decode an URL-encoded UTF-8 string
   std::string urlDecode(std::string encoded) const;
 
  private:
-  // Handles a timeout of the client.
-  void handleTimeout(const boost::system::error_code& error);
-
-  // Handles a HTTP request.
-  void handleRequest(const boost::system::error_code& error);
-
-  // Creates the HTTP response for the given HTTP request.
-  std::stringstream createResponse(const std::string& request) const;
+  // One client connection, see SearchServer.cpp.
+  class Connection;
+
+  // The state of one worker: the search over the shards, the scratch memory
+  // and the result of the current query (kept across queries so that they
+  // don't allocate), and the hardware counters of the query path, which
+  // count the thread that creates them.
+  struct Searcher {
+    explicit Searcher(SearchServer& server)
+        : parallelSearch(server._index, server._pool) {}
+    ParallelSearch parallelSearch;
+    MatchBuffers matchBuffers;
+    std::vector<Match> matches;
+    PerfRegions perf;
+  };
+
+  // An as-you-type session, which one request at a time may use.
+  struct Session {
+    explicit Session(const QGramIndex& index) : session(index) {}
+    std::mutex mutex;
+    SearchSession session;
+  };
+
+  // Accepts the next connection, asynchronously, and then the one after.
+  void startAccept();
+
+  // The loop of a worker: creates its Searcher and answers the requests
+  // posted to _workService until the server stops.
+  void work();
+
+  // Runs the given service until it is stopped; an exception thrown by a
+  // handler is logged and drops only that handler.
+  void runService(boost::asio::io_service& service);
+
+  // Writes the given text to std::cout in one piece.
+  void log(const std::string& text) const;
+
+  // Creates the HTTP response for the given HTTP request, with the given
+  // worker. Writes what it does to 'log'.
+  std::stringstream createResponse(const std::string& request,
+      Searcher& searcher, std::ostream& log) const;
 
   // Handles a fuzzy prefix search request for the query given in 'params', and
   // plugs the result into the given stream (that holds the content of
   // search.html).
   std::stringstream handleFuzzyPrefixSearchRequest(const std::string& params,
-      const std::stringstream& stream) const;
+      const std::stringstream& stream, Searcher& searcher, std::ostream& log)
+      const;
+
+  // Returns the session with the given token, creating it (and dropping the
+  // least recently used one) if necessary.
+  std::shared_ptr<Session> getSession(const std::string& token) const;
 
   // Translates the given entity to HTML.
   std::string translateToHtml(const Entity& entity) const;
 
-  // Translates the given entity to JSON.
+  // Translates the given entities (the top results out of numFound, which may
+  // be an estimate) to JSON.
   std::string translateToJSON(const std::vector<Entity>& entities,
-      size_t numResultsToShow) const;
+      size_t numFound, bool isExact) const;
 
 
   // Returns the content type of the given file.
@@ -130,26 +209,47 @@ class SearchServer {
   // The q-gram index to use in this server.
   QGramIndex _index;
 
+  // The trie over the same entities, for short prefixes.
+  PrefixTrie _trie;
+
+  // The threads that search the shards of the index (each worker searches
+  // one of them itself), shared by all workers.
+  ThreadPool _pool;
+
   // The server socket.
   boost::asio::ip::tcp::endpoint _server;
 
-  // The service that handles the I/= functionality.
+  // The service that handles the I/O functionality: the accept loop and the
+  // reads, writes and timeouts of the connections.
   boost::asio::io_service _ioService;
 
   // The acceptor.
   boost::asio::ip::tcp::acceptor _acceptor;
 
-  // The client socket.
-  boost::asio::ip::tcp::socket _client;
+  // The service that the workers run: the requests to answer. Declared after
+  // _ioService, so that its pending requests (and their connections) are
+  // destroyed first.
+  boost::asio::io_service _workService;
+
+  // The number of I/O threads and of workers each (0 for one per hardware
+  // thread).
+  size_t _numThreads;
 
-  // The timeout timer.
-  boost::asio::deadline_timer _timer;
+  // The worker of the calling thread (nullptr outside of the workers).
+  static thread_local Searcher* _searcher;
 
-  // The request buffer.
-  boost::asio::streambuf _requestBuffer;
+  // Guards std::cout, so that the logs of concurrent requests don't mix.
+  mutable std::mutex _logMutex;
 
   // The template for the HTML representation of an entity.
   std::string _entityHtmlPattern;
+
+  // The as-you-type sessions by token, with the time of their last use.
+  // Guarded by _sessionsMutex, like _numRequests.
+  mutable std::mutex _sessionsMutex;
+  mutable std::map<std::string, std::pair<std::shared_ptr<Session>, size_t> >
+      _sessions;
+  mutable size_t _numRequests = 0;
 };
 
 #endif  // SEARCHSERVER_H_
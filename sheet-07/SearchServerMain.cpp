@@ -4,40 +4,93 @@
 // Authors: Claudius Korzen <korzen@cs.uni-freiburg.de>.
 
 #include <boost/asio.hpp>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <memory>
 #include <string>
 
 #include "./QGramIndex.h"
 #include "./SearchServer.h"
+#include "./PerfCounters.h"
+#include "./PrefixTrie.h"
 
 // A simple server that handles fuzzy prefix search requests and file requests.
 int main(int argc, char** argv) {
   // Parse the command line arguments.
   if (argc < 3) {
-    std::cerr << "Usage: " << argv[0] << " <file> <port> [--with-synonyms]";
-    std::cerr << std::endl;
+    std::cerr << "Usage: " << argv[0] << " <file> <port> [--with-synonyms]"
+              << " [--snapshot <snapshot file>] [--shards <n>] [--threads <n>]"
+              << std::endl;
+    std::cerr << "With --snapshot, the index is mapped from the snapshot file "
+              << "if it exists (with the settings it was built with), and "
+              << "built from <file> and written to it otherwise." << std::endl;
+    std::cerr << "With --shards, the q-gram index is split into n shards by "
+              << "entity ids, which each query searches in parallel."
+              << std::endl;
+    std::cerr << "With --threads, the server answers requests on n threads "
+              << "(default: one per hardware thread)." << std::endl;
     exit(1);
   }
   std::string fileName = argv[1];
   uint16_t port = atoi(argv[2]);
   bool withSynonyms = false;
-  if (argc > 3) {
-    std::string withSynonymsStr = argv[3];
-    withSynonyms = withSynonymsStr.compare("--with-synonyms") == 0;
+  std::string snapshotFileName;
+  size_t numShards = 1;
+  size_t numThreads = 0;
+  for (int i = 3; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--with-synonyms") {
+      withSynonyms = true;
+    } else if (arg == "--snapshot" && i + 1 < argc) {
+      snapshotFileName = argv[++i];
+    } else if (arg == "--shards" && i + 1 < argc) {
+      numShards = std::max(atoi(argv[++i]), 1);
+    } else if (arg == "--threads" && i + 1 < argc) {
+      numThreads = std::max(atoi(argv[++i]), 1);
+    }
   }
+  std::string trieFileName = snapshotFileName + ".trie";
 
-  // Build the q-gram index.
-  std::cout << "Building the q-gram index from '" << fileName << "' ... ";
-  std::cout << std::flush;
   QGramIndex index(3, withSynonyms);
-  index.buildFromFile(fileName);
-  std::cout << "Done!" << std::endl;
+  index.setNumShards(numShards);
+  PerfRegions perf;
+  bool mapped = !snapshotFileName.empty() &&
+      std::ifstream(snapshotFileName.c_str()).good();
+  if (mapped) {
+    // Map the snapshot, which takes the same time for any number of entities.
+    std::cout << "Mapping the q-gram index from '" << snapshotFileName
+              << "' ... " << std::flush;
+    PerfRegion region(perf, "load");
+    index.load(snapshotFileName, true);
+  } else {
+    // Build the q-gram index.
+    std::cout << "Building the q-gram index from '" << fileName << "' ... ";
+    std::cout << std::flush;
+    PerfRegion region(perf, "buildFromFile");
+    index.buildFromFile(fileName);
+  }
+  std::cout << "Done! " << index._entities.size() << " entities, "
+            << index.numQGrams() << " q-grams, "
+            << index.sizeInBytes() / 1024 << " KB of q-gram lists, "
+            << index._entities.sizeInBytes() / 1024 << " KB of entities."
+            << std::endl;
+  if (!mapped && !snapshotFileName.empty()) {
+    std::cout << "Writing the snapshot '" << snapshotFileName << "' ... ";
+    std::cout << std::flush;
+    PerfRegion region(perf, "save");
+    index.save(snapshotFileName);
+    PrefixTrie(index).save(trieFileName);
+    std::cout << "Done!" << std::endl;
+  }
+  perf.report(std::cout);
 
   // Start the server loop.
   std::cout << "Starting the server on port '" << port << "' ... ";
-  SearchServer server(index, port);
+  std::unique_ptr<SearchServer> server(snapshotFileName.empty() ?
+      new SearchServer(index, port, numThreads) :
+      new SearchServer(index, trieFileName, port, numThreads));
   std::cout << "Done!" << std::endl;
 
-  server.run();
+  server->run();
 }
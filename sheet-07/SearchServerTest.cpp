@@ -2,9 +2,27 @@
 // Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
 
 #include <gtest/gtest.h>
+#include <boost/asio.hpp>
+#include <string>
+#include <thread>
+#include <vector>
 #include "./SearchServer.h"
 #include "./QGramIndex.h"
 
+// Sends the given request line to the server on the given port and returns
+// the whole response.
+std::string sendRequest(uint16_t port, const std::string& requestLine) {
+  boost::asio::io_service ioService;
+  boost::asio::ip::tcp::socket socket(ioService);
+  socket.connect(boost::asio::ip::tcp::endpoint(
+      boost::asio::ip::address_v4::loopback(), port));
+  boost::asio::write(socket, boost::asio::buffer(requestLine + "\r\n\r\n"));
+  boost::asio::streambuf response;
+  boost::system::error_code error;
+  boost::asio::read(socket, response, error);
+  return std::string(boost::asio::buffers_begin(response.data()),
+      boost::asio::buffers_end(response.data()));
+}
 
 // _____________________________________________________________________________
 TEST(SearchServerTest, urlDecodeTest) {
@@ -17,3 +35,35 @@ TEST(SearchServerTest, urlDecodeTest) {
   ASSERT_EQ("Mikrösoft Windos", s.urlDecode("Mikr%C3%B6soft+Windos"));
   ASSERT_EQ("The hitschheiker guide", s.urlDecode("The+hitschheiker%20guide"));
 }
+
+// _____________________________________________________________________________
+TEST(SearchServerTest, concurrentRequests) {
+  // Several clients at once, on a sharded index, with and without sessions
+  // (two clients share each session).
+  QGramIndex index(3, true);
+  index.setNumShards(2);
+  index.buildFromFile("example.tsv");
+  SearchServer server(index, 0, 3);
+  std::thread serverThread(&SearchServer::run, &server);
+  std::vector<std::string> responses(8 * 20);
+  std::vector<std::thread> clients;
+  for (size_t c = 0; c < 8; c++) {
+    clients.emplace_back([&, c]() {
+      for (size_t i = 0; i < 20; i++) {
+        std::string session = c % 2 ? "&session=" + std::to_string(c / 4) : "";
+        responses[20 * c + i] = sendRequest(server.port(),
+            "GET /api?q=frei" + session + " HTTP/1.1");
+      }
+    });
+  }
+  for (std::thread& client : clients) { client.join(); }
+  ASSERT_EQ(0, sendRequest(server.port(), "no request").find("HTTP/1.1 405"));
+  server.stop();
+  serverThread.join();
+
+  for (const std::string& response : responses) {
+    ASSERT_EQ(0, response.find(HTTP_OK_HEADER)) << response;
+    ASSERT_NE(std::string::npos, response.find(
+        "{\"found\":2,\"exact\":true,\"res\":[{\"name\":\"frei\"")) << response;
+  }
+}
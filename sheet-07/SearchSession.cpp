@@ -0,0 +1,185 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#include "./SearchSession.h"
+#include <stddef.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Writes the band of row 0 of the PED matrix (D[0][j] = j) of the string y,
+// that is, the columns -delta to delta.
+void firstRow(boost::string_ref y, size_t delta, uint8_t* row) {
+  const uint8_t cap = delta + 1;
+  for (size_t k = 0; k <= 2 * delta; k++) {
+    row[k] = (k < delta || k - delta > y.size()) ? cap : k - delta;
+  }
+}
+
+// Computes the band of row i + 1 (columns i + 1 - delta to i + 1 + delta) from
+// the band of row i, where c is the (i + 1)-th character of the prefix.
+// Returns the minimum of the new row, that is, the PED capped at delta + 1.
+uint8_t nextRow(const uint8_t* row, size_t i, char c, boost::string_ref y,
+    size_t delta, uint8_t* next) {
+  const size_t width = 2 * delta + 1;
+  const uint8_t cap = delta + 1;
+  uint8_t min = cap;
+  for (size_t k = 0; k < width; k++) {
+    ptrdiff_t j = static_cast<ptrdiff_t>(i + 1 + k) -
+        static_cast<ptrdiff_t>(delta);
+    uint8_t value = cap;
+    if (j == 0) {
+      value = std::min<size_t>(i + 1, cap);
+    } else if (j > 0 && j <= static_cast<ptrdiff_t>(y.size())) {
+      // Cells outside of the band are > delta, so they count as the cap.
+      size_t replace = row[k] + (y[j - 1] == c ? 0 : 1);
+      size_t remove = (k + 1 < width ? row[k + 1] : cap) + 1;
+      size_t insert = (k > 0 ? next[k - 1] : cap) + 1;
+      value = std::min<size_t>(std::min(replace, remove),
+                               std::min<size_t>(insert, cap));
+    }
+    next[k] = value;
+    min = std::min(min, value);
+  }
+  return min;
+}
+}  // namespace
+
+// _____________________________________________________________________________
+size_t SearchSession::findMatches(const std::string& prefix,
+    std::vector<Match>& matches) {
+  if (QGramIndex::hasSeveralWords(prefix)) {
+    _started = false;
+    return _index->findMatches(prefix, _buffers, matches);
+  }
+  size_t numPedComputations = update(prefix);
+  collectMatches(matches);
+  QGramIndex::rankMatches(matches);
+  return numPedComputations;
+}
+
+// _____________________________________________________________________________
+size_t SearchSession::findTopMatches(const std::string& prefix, size_t k,
+    std::vector<Match>& matches, size_t& numFound) {
+  if (QGramIndex::hasSeveralWords(prefix)) {
+    _started = false;
+    bool isExact;
+    return _index->findTopMatches(prefix, k, true, _buffers, matches,
+        numFound, isExact);
+  }
+  size_t numPedComputations = update(prefix);
+  collectMatches(matches);
+  numFound = matches.size();
+  size_t numTop = std::min(k, matches.size());
+  std::partial_sort(matches.begin(), matches.begin() + numTop, matches.end(),
+      _matchComparator);
+  matches.resize(numTop);
+  return numPedComputations;
+}
+
+// _____________________________________________________________________________
+size_t SearchSession::update(const std::string& prefix) {
+  std::string nPrefix = QGramIndex::normalize(prefix);
+  size_t delta = nPrefix.size() / 4;
+  size_t numPedComputations = 0;
+
+  if (_started && delta == _delta && _prefix.size() > 0 &&
+      nPrefix.compare(0, _prefix.size(), _prefix) == 0) {
+    // The prefix was extended, without changing delta.
+    for (size_t i = _prefix.size(); i < nPrefix.size(); i++) {
+      numPedComputations += _entityIds.size();
+      extend(i, nPrefix[i]);
+    }
+    _prefix = nPrefix;
+    _numIncremental++;
+  } else {
+    _prefix = nPrefix;
+    _delta = delta;
+    numPedComputations = restart();
+  }
+  return numPedComputations;
+}
+
+// _____________________________________________________________________________
+size_t SearchSession::restart() {
+  _entityIds.clear();
+  _synonyms.clear();
+  _strings.clear();
+  _peds.clear();
+  _rows.clear();
+  _started = _prefix.size() > 0;
+  if (!_started) { return 0; }
+
+  _index->findCandidates(_prefix, _buffers, _candidates);
+  const PedPattern& pattern = _buffers.pattern;
+  const size_t width = 2 * _delta + 1;
+  std::vector<uint8_t>& row = _nextRow;
+  row.resize(2 * width);
+  size_t numPedComputations = 0;
+
+  for (uint32_t stringId : _candidates) {
+    // Every name and synonym that passes the filters, since any of them may
+    // be the best match for a longer prefix.
+    boost::string_ref y = _index->normalizedString(stringId);
+    size_t ped = pattern.compute(y, _delta);
+    numPedComputations++;
+    if (ped > _delta) { continue; }
+
+    // Compute the last row of the match from scratch.
+    uint8_t* current = &row[0];
+    uint8_t* next = &row[width];
+    firstRow(y, _delta, current);
+    for (size_t i = 0; i < _prefix.size(); i++) {
+      nextRow(current, i, _prefix[i], y, _delta, next);
+      std::swap(current, next);
+    }
+    _entityIds.push_back(_index->stringEntity(stringId));
+    _synonyms.push_back(_index->stringSynonym(stringId));
+    _strings.push_back(y);
+    _peds.push_back(ped);
+    _rows.insert(_rows.end(), current, current + width);
+  }
+  return numPedComputations;
+}
+
+// _____________________________________________________________________________
+void SearchSession::extend(size_t i, char c) {
+  const size_t width = 2 * _delta + 1;
+  _nextRow.resize(width);
+  size_t numKept = 0;
+  for (size_t k = 0; k < _entityIds.size(); k++) {
+    uint8_t ped = nextRow(&_rows[k * width], i, c, _strings[k], _delta,
+        &_nextRow[0]);
+    if (ped > _delta) { continue; }
+    _entityIds[numKept] = _entityIds[k];
+    _synonyms[numKept] = _synonyms[k];
+    _strings[numKept] = _strings[k];
+    _peds[numKept] = ped;
+    std::copy(_nextRow.begin(), _nextRow.end(), &_rows[numKept * width]);
+    numKept++;
+  }
+  _entityIds.resize(numKept);
+  _synonyms.resize(numKept);
+  _strings.resize(numKept);
+  _peds.resize(numKept);
+  _rows.resize(numKept * width);
+}
+
+// _____________________________________________________________________________
+void SearchSession::collectMatches(std::vector<Match>& matches) const {
+  // Like QGramIndex::findMatches: the name if it matches, otherwise the
+  // synonym with the lowest PED (the first one on ties).
+  matches.clear();
+  for (size_t k = 0; k < _entityIds.size(); k++) {
+    bool sameEntity = !matches.empty() &&
+        matches.back().entityId == _entityIds[k];
+    if (!sameEntity) {
+      matches.push_back(Match(_entityIds[k], _peds[k], _synonyms[k]));
+    } else if (matches.back().synonym != NO_SYNONYM &&
+        _peds[k] < matches.back().ped) {
+      matches.back() = Match(_entityIds[k], _peds[k], _synonyms[k]);
+    }
+  }
+}
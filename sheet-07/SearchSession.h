@@ -0,0 +1,85 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#ifndef SEARCHSESSION_H_
+#define SEARCHSESSION_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "./QGramIndex.h"
+
+// The state of one as-you-type search over a q-gram index. For the last
+// (normalized) prefix x, it keeps every name and synonym y with
+// PED(x, y) <= delta, together with the last row of their PED matrix. Since
+// PED(xc, y) >= PED(x, y), the matches of an extended prefix xc are among
+// those strings, and one more DP row per string gives their new PEDs.
+//
+// Only cells within delta of the diagonal can be <= delta, so a row is stored
+// as a band of 2 * delta + 1 values, capped at delta + 1. When delta changes
+// (every 4 characters) or the new prefix doesn't extend the last one, the
+// session starts over from the candidates of the q-gram index. Queries of
+// several words go to the index as they are (see QGramIndex::findMatches).
+class SearchSession {
+ public:
+  explicit SearchSession(const QGramIndex& index) : _index(&index),
+      _delta(0), _started(false), _numIncremental(0) {}
+
+  // Same as QGramIndex::findMatches(prefix, buffers, matches), using the state
+  // of the previous call where possible.
+  size_t findMatches(const std::string& prefix, std::vector<Match>& matches);
+
+  // Same as above, but only writes the k best matches (ranked) and sets
+  // numFound to the number of all matches.
+  size_t findTopMatches(const std::string& prefix, size_t k,
+      std::vector<Match>& matches, size_t& numFound);
+
+  // Returns the number of calls that were answered incrementally.
+  size_t numIncremental() const { return _numIncremental; }
+
+ private:
+  // Computes the state for _prefix from the candidates of the index. Returns
+  // the number of PED computations.
+  size_t restart();
+
+  // Appends one row (for the character c, which becomes the i-th character of
+  // the prefix) to the state and drops the strings with a PED > delta.
+  void extend(size_t i, char c);
+
+  // Brings the state to the given prefix. Returns the number of PED
+  // computations (or DP rows).
+  size_t update(const std::string& prefix);
+
+  // Writes the matches of the current state to 'matches', unranked.
+  void collectMatches(std::vector<Match>& matches) const;
+
+  const QGramIndex* _index;
+
+  // The normalized prefix of the state and its delta.
+  std::string _prefix;
+  size_t _delta;
+  bool _started;
+
+  // The strings of the state: entity id and synonym index (NO_SYNONYM for the
+  // name), grouped by entity, name first.
+  std::vector<uint32_t> _entityIds;
+  std::vector<uint32_t> _synonyms;
+
+  // The normalized strings themselves.
+  std::vector<boost::string_ref> _strings;
+
+  // Their PEDs, all <= _delta.
+  std::vector<uint8_t> _peds;
+
+  // The last DP rows of the strings, 2 * _delta + 1 values each.
+  std::vector<uint8_t> _rows;
+
+  // Scratch memory.
+  std::vector<uint8_t> _nextRow;
+  std::vector<uint32_t> _candidates;
+  MatchBuffers _buffers;
+
+  size_t _numIncremental;
+};
+
+#endif  // SEARCHSESSION_H_
@@ -0,0 +1,71 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+#include "./QGramIndex.h"
+#include "./SearchSession.h"
+#include "./TestHelpers.h"
+
+// _____________________________________________________________________________
+TEST(SearchSessionTest, findMatches) {
+  QGramIndex index(3, true);
+  index.buildFromFile("example.tsv");
+  SearchSession session(index);
+  std::vector<Match> matches;
+
+  // "fr" starts the session, "fre" and "frei" don't change delta.
+  session.findMatches("fr", matches);
+  ASSERT_EQ(1, matches.size());
+  ASSERT_EQ(0, session.numIncremental());
+  // One DP row each for "frei" and its synonym "freiheit".
+  ASSERT_EQ(2, session.findMatches("fre", matches));
+  ASSERT_EQ(1, session.numIncremental());
+  ASSERT_EQ(1, matches.size());
+  ASSERT_EQ(1, matches[0].entityId);
+
+  // Delta becomes 1: start over, "brei" matches now.
+  session.findMatches("Frei", matches);
+  ASSERT_EQ(1, session.numIncremental());
+  ASSERT_EQ(2, matches.size());
+  ASSERT_EQ(2, matches[1].entityId);
+  ASSERT_EQ(1, matches[1].ped);
+
+  // Only the synonym "freiheit" is left.
+  session.findMatches("freihe", matches);
+  ASSERT_EQ(2, session.numIncremental());
+  ASSERT_EQ(1, matches.size());
+  ASSERT_EQ(0, matches[0].synonym);
+
+  session.findMatches("", matches);
+  ASSERT_EQ(0, matches.size());
+}
+
+// _____________________________________________________________________________
+TEST(SearchSessionTest, findMatchesRandom) {
+  // Random names and synonyms over a small alphabet, typed character by
+  // character with some backspaces, compared to the search from scratch.
+  writeRandomEntities("SearchSessionTest.TMP.tsv", 42, 500, 4, 12);
+  std::mt19937 gen(42);
+  QGramIndex index(3, true);
+  index.buildFromFile("SearchSessionTest.TMP.tsv");
+  SearchSession session(index);
+  MatchBuffers buffers;
+  std::vector<Match> expected, actual;
+  for (size_t k = 0; k < 30; k++) {
+    std::string query;
+    for (size_t i = 0; i < 14; i++) {
+      if (query.size() > 0 && gen() % 5 == 0) {
+        query.erase(query.size() - 1);
+      } else {
+        query += 'a' + gen() % 4;
+      }
+      index.findMatches(query, buffers, expected);
+      session.findMatches(query, actual);
+      EXPECT_EQ(expected, actual) << query;
+    }
+  }
+  ASSERT_GT(session.numIncremental(), 100);
+}
@@ -0,0 +1,47 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#ifndef TESTHELPERS_H_
+#define TESTHELPERS_H_
+
+#include <fstream>
+#include <random>
+#include <string>
+
+// Helpers shared by the tests (header only, so that they don't end up in the
+// objects of the main binaries).
+
+// Returns the given number of random words of 1 to maxLength of the first
+// alphabetSize letters, separated by spaces.
+inline std::string randomWords(std::mt19937& gen, size_t numWords,
+    size_t alphabetSize, size_t maxLength) {
+  std::string words;
+  for (size_t i = 0; i < numWords; i++) {
+    if (i > 0) words += ' ';
+    size_t length = 1 + gen() % maxLength;
+    for (size_t j = 0; j < length; j++) words += 'a' + gen() % alphabetSize;
+  }
+  return words;
+}
+
+// Writes an entity file with the given number of entities with random names
+// of 1 to maxNumWords random words (see above), over a small alphabet, so
+// that short prefixes match many entities. Each entity has a random score,
+// a random synonym and its name without the first character as a second one.
+inline void writeRandomEntities(const std::string& fileName, unsigned seed,
+    size_t numEntities, size_t alphabetSize, size_t maxLength,
+    size_t maxNumWords = 1) {
+  std::mt19937 gen(seed);
+  std::ofstream out(fileName.c_str());
+  out << "name\tscore\tdescription\twikipediaUrl\twikidataId\tsynonyms\n";
+  for (size_t i = 0; i < numEntities; i++) {
+    std::string name = randomWords(gen, 1 + gen() % maxNumWords,
+        alphabetSize, maxLength);
+    std::string synonym = randomWords(gen, 1 + gen() % maxNumWords,
+        alphabetSize, maxLength);
+    out << name << "\t" << gen() % 1000 << "\t\t\t\t" << synonym << ";"
+        << name.substr(1) << "\n";
+  }
+}
+
+#endif  // TESTHELPERS_H_
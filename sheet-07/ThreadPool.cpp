@@ -0,0 +1,82 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#include "./ThreadPool.h"
+
+// _____________________________________________________________________________
+ThreadPool::ThreadPool(size_t numThreads) : _stopping(false) {
+  for (size_t i = 0; i < numThreads; i++) {
+    _threads.emplace_back(&ThreadPool::work, this);
+  }
+}
+
+// _____________________________________________________________________________
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopping = true;
+  }
+  _hasTasks.notify_all();
+  for (std::thread& thread : _threads) { thread.join(); }
+}
+
+// _____________________________________________________________________________
+void ThreadPool::run(size_t numTasks,
+    const std::function<void(size_t)>& task) {
+  if (numTasks == 0) { return; }
+  Job job;
+  job.task = &task;
+  job.numLeft = numTasks;
+  if (numTasks > 1) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (size_t i = 1; i < numTasks; i++) {
+      _queue.push_back(std::make_pair(&job, i));
+    }
+  }
+  _hasTasks.notify_all();
+  runTask(job, 0);
+
+  // Help with the queued tasks (of this job or earlier ones) instead of
+  // just waiting.
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (job.numLeft > 0) {
+    if (_queue.empty()) {
+      job.done.wait(lock);
+      continue;
+    }
+    std::pair<Job*, size_t> next = _queue.front();
+    _queue.pop_front();
+    lock.unlock();
+    runTask(*next.first, next.second);
+    lock.lock();
+  }
+  if (job.error) { std::rethrow_exception(job.error); }
+}
+
+// _____________________________________________________________________________
+void ThreadPool::runTask(Job& job, size_t i) {
+  std::exception_ptr error;
+  try {
+    (*job.task)(i);
+  } catch(...) {
+    error = std::current_exception();
+  }
+  // Notify under the lock: the job is gone once run() sees numLeft == 0.
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (error && !job.error) { job.error = error; }
+  if (--job.numLeft == 0) { job.done.notify_all(); }
+}
+
+// _____________________________________________________________________________
+void ThreadPool::work() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (true) {
+    while (!_stopping && _queue.empty()) { _hasTasks.wait(lock); }
+    if (_queue.empty()) { return; }
+    std::pair<Job*, size_t> next = _queue.front();
+    _queue.pop_front();
+    lock.unlock();
+    runTask(*next.first, next.second);
+    lock.lock();
+  }
+}
@@ -0,0 +1,67 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <stddef.h>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// A fixed set of threads for fork-join jobs: run() hands the tasks of a job
+// to the threads and waits for them. Several threads may call run() at the
+// same time; their tasks are queued in order. The calling thread works on
+// the tasks too, so a job finishes even when all threads of the pool are
+// busy.
+class ThreadPool {
+ public:
+  // Starts the given number of threads. With 0 threads, run() runs all tasks
+  // on the calling thread.
+  explicit ThreadPool(size_t numThreads);
+
+  // Stops the threads, after the tasks queued so far.
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Returns the number of threads.
+  size_t size() const { return _threads.size(); }
+
+  // Runs task(i) for i = 0 to numTasks - 1 and waits for all of them. Task 0
+  // runs on the calling thread. If tasks throw, rethrows the first exception
+  // after all tasks are done.
+  void run(size_t numTasks, const std::function<void(size_t)>& task);
+
+ private:
+  // The state of one call of run().
+  struct Job {
+    const std::function<void(size_t)>* task;
+    size_t numLeft;
+    std::exception_ptr error;
+    std::condition_variable done;
+  };
+
+  // Runs task i of the given job and counts it as done.
+  void runTask(Job& job, size_t i);
+
+  // The loop of each thread: runs queued tasks until the pool stops.
+  void work();
+
+  // The queued tasks as (job, task index), and whether the pool stops.
+  // Guarded by _mutex, like the numLeft and error of the jobs.
+  std::mutex _mutex;
+  std::condition_variable _hasTasks;
+  std::deque<std::pair<Job*, size_t> > _queue;
+  bool _stopping;
+
+  std::vector<std::thread> _threads;
+};
+
+#endif  // THREADPOOL_H_
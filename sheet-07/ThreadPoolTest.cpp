@@ -0,0 +1,52 @@
+// Copyright 2017, University of Freiburg
+// Author: Przemyslaw Joniak <prz dot joniak at gmail dot com>
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "./ThreadPool.h"
+
+// _____________________________________________________________________________
+TEST(ThreadPoolTest, run) {
+  for (size_t numThreads : {0, 1, 4}) {
+    ThreadPool pool(numThreads);
+    ASSERT_EQ(numThreads, pool.size());
+    std::vector<int> counts(100, 0);
+    pool.run(counts.size(), [&](size_t i) { counts[i]++; });
+    ASSERT_EQ(std::vector<int>(100, 1), counts);
+    pool.run(0, [&](size_t i) { counts[i]++; });
+  }
+}
+
+// _____________________________________________________________________________
+TEST(ThreadPoolTest, runConcurrently) {
+  // Several callers, with jobs that run jobs themselves.
+  ThreadPool pool(2);
+  std::atomic<size_t> sum(0);
+  std::vector<std::thread> callers;
+  for (size_t c = 0; c < 4; c++) {
+    callers.emplace_back([&]() {
+      for (size_t r = 0; r < 20; r++) {
+        pool.run(5, [&](size_t i) {
+          pool.run(3, [&](size_t j) { sum += i * j; });
+        });
+      }
+    });
+  }
+  for (std::thread& caller : callers) { caller.join(); }
+  // The sum of i * j over one job is 10 * 3 = 30.
+  ASSERT_EQ(4 * 20 * 30, sum);
+}
+
+// _____________________________________________________________________________
+TEST(ThreadPoolTest, exceptions) {
+  ThreadPool pool(2);
+  std::atomic<size_t> numRun(0);
+  ASSERT_THROW(pool.run(10, [&](size_t i) {
+    numRun++;
+    if (i % 3 == 1) throw std::runtime_error("task failed");
+  }), std::runtime_error);
+  ASSERT_EQ(10, numRun);
+}
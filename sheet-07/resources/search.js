@@ -4,17 +4,23 @@ $(document).ready(function() {
   var api  = "http://" + host + ":" + port + "/api";
   console.log("API location: " + api);
 
+  // Identifies this page to the server, which then answers each keystroke
+  // incrementally from the state of the previous one.
+  var session = Math.random().toString(36).substring(2);
+
   // Handle keyup on search input
   $("#input").keyup(function() {
     var query = $("#input").val();
-    var url   = api + "?q=" + query;
+    var url   = api + "?q=" + query + "&session=" + session;
 
     $.getJSON(url, function(response) {
       console.log("Got response for query: " + query);
       if ( $("#input").val() != "" ) {
         $("#qry").html("\"" + esc(query) + "\": ")
         $("#results").html(jsonToHtml(response.res));
-        $("#number").html("found: " + response.found);
+        // Without exact=1, large counts are extrapolated by the server.
+        var found = (response.exact ? "" : "~") + response.found;
+        $("#number").html("found: " + found);
       }
       else {
         console.log("EMPTY");